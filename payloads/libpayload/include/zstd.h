@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: BSD-3-Clause OR GPL-2.0-only */
+
+#ifndef __ZSTD_H_
+#define __ZSTD_H_
+
+#include <stddef.h>
+
+/* Decompresses one or more Zstandard frames from src to dst, ensuring that it
+ * doesn't read more than srcn bytes and doesn't write more than dstn. The part
+ * of dst past the decompressed data is used as scratch space and may be
+ * overwritten. Frames that need a dictionary are not supported, and checksums
+ * are not verified. Not reentrant, and cannot decompress in-place.
+ * Returns amount of decompressed bytes, or 0 on error.
+ */
+size_t uzstdn(const void *src, size_t srcn, void *dst, size_t dstn);
+
+#endif /* __ZSTD_H_ */
@@ -38,6 +38,10 @@
 #  include <lz4.h>
 #  define CBFS_CORE_WITH_LZ4
 # endif
+# if CONFIG(LP_ZSTD)
+#  include <zstd.h>
+#  define CBFS_CORE_WITH_ZSTD
+# endif
 # define CBFS_MINI_BUILD
 #elif defined(__SMM__)
 # define CBFS_MINI_BUILD
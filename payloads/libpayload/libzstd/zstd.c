@@ -0,0 +1,968 @@
+/* SPDX-License-Identifier: BSD-3-Clause OR GPL-2.0-only */
+
+#include <endian.h>
+#include <libpayload.h>
+#include <stdint.h>
+#include <string.h>
+#include <zstd.h>
+
+/*
+ * A small Zstandard (RFC 8878) decoder. It needs no heap: the output buffer
+ * doubles as the window, decoded literals are staged at the end of the output
+ * buffer and the entropy tables live in a static context (about 10KiB).
+ * Dictionaries aren't supported and the content checksum isn't verified, CBFS
+ * verification already covers the compressed data.
+ */
+
+#define ZSTD_MAGIC		0xfd2fb528
+#define ZSTD_SKIPPABLE_MAGIC	0x184d2a50	/* Low 4 bits are ignored. */
+#define ZSTD_BLOCK_SIZE_MAX	(128 * 1024)
+
+#define HUF_MAX_BITS		11
+#define HUF_MAX_SYMBOLS		256
+#define HUF_WEIGHTS_LOG		6
+
+#define FSE_MAX_LOG		9
+#define FSE_MAX_SYMBOLS		53
+#define LL_MAX_LOG		9
+#define ML_MAX_LOG		9
+#define OF_MAX_LOG		8
+#define LL_MAX_SYMBOL		35
+#define ML_MAX_SYMBOL		52
+#define OF_MAX_SYMBOL		31
+
+enum {
+	MODE_PREDEFINED = 0,
+	MODE_RLE = 1,
+	MODE_FSE = 2,
+	MODE_REPEAT = 3,
+};
+
+struct fse_entry {
+	uint8_t symbol;
+	uint8_t nb_bits;
+	uint16_t base;
+};
+
+struct fse_table {
+	int log;
+	int valid;
+	struct fse_entry entries[1 << FSE_MAX_LOG];
+};
+
+struct huf_entry {
+	uint8_t symbol;
+	uint8_t nb_bits;
+};
+
+static struct {
+	struct huf_entry huf[1 << HUF_MAX_BITS];
+	int huf_bits;	/* 0 if there is no table to reuse for treeless literals */
+	struct fse_table ll, of, ml;
+	uint32_t rep[3];
+} ctx;
+
+/* Baselines and number of extra bits of the literal and match length codes. */
+static const uint32_t ll_base[LL_MAX_SYMBOL + 1] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+	8192, 16384, 32768, 65536,
+};
+static const uint8_t ll_bits[LL_MAX_SYMBOL + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+	13, 14, 15, 16,
+};
+static const uint32_t ml_base[ML_MAX_SYMBOL + 1] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+	19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+	35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+	4099, 8195, 16387, 32771, 65539,
+};
+static const uint8_t ml_bits[ML_MAX_SYMBOL + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+	12, 13, 14, 15, 16,
+};
+
+/* Predefined distributions, used by sequences in MODE_PREDEFINED. */
+static const int16_t ll_default[LL_MAX_SYMBOL + 1] = {
+	4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+	-1, -1, -1, -1,
+};
+static const int16_t ml_default[ML_MAX_SYMBOL + 1] = {
+	1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+	-1, -1, -1, -1, -1,
+};
+static const int16_t of_default[29] = {
+	1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1,
+};
+
+static inline int highbit(uint32_t x)
+{
+	return 31 - __builtin_clz(x);
+}
+
+static inline uint32_t read_le32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return le32toh(v);
+}
+
+static inline uint64_t read_le64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return le64toh(v);
+}
+
+/* Reads up to 64 bits little endian from a buffer shorter than 8 bytes. */
+static uint64_t read_le_short(const uint8_t *p, size_t n)
+{
+	uint64_t v = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		v |= (uint64_t)p[i] << (8 * i);
+	return v;
+}
+
+/*
+ * The entropy coded streams are read backwards, starting from the highest bit
+ * below the end marker in their last byte. Bits past the start of the stream
+ * read as zero, br_overflowed() tells whether that happened.
+ */
+struct bit_reader {
+	const uint8_t *start;
+	const uint8_t *ptr;
+	uint64_t bits;
+	unsigned int consumed;
+};
+
+static int br_init(struct bit_reader *br, const uint8_t *src, size_t srcn)
+{
+	if (srcn == 0 || src[srcn - 1] == 0)
+		return -1;
+
+	br->start = src;
+	if (srcn >= sizeof(br->bits)) {
+		br->ptr = src + srcn - sizeof(br->bits);
+		br->bits = read_le64(br->ptr);
+		br->consumed = 0;
+	} else {
+		br->ptr = src;
+		br->bits = read_le_short(src, srcn);
+		br->consumed = (sizeof(br->bits) - srcn) * 8;
+	}
+	br->consumed += 8 - highbit(src[srcn - 1]);
+	return 0;
+}
+
+/* Leaves at least 57 bits to read, unless the stream has fewer left. */
+static inline void br_reload(struct bit_reader *br)
+{
+	size_t n = br->consumed / 8;
+
+	if (br->ptr == br->start || br->consumed > 64)
+		return;
+	if (n > (size_t)(br->ptr - br->start))
+		n = br->ptr - br->start;
+	br->ptr -= n;
+	br->consumed -= n * 8;
+	br->bits = read_le64(br->ptr);
+}
+
+static inline uint64_t br_peek(const struct bit_reader *br, unsigned int n)
+{
+	if (n == 0 || br->consumed >= 64)
+		return 0;
+	return (br->bits << br->consumed) >> (64 - n);
+}
+
+static inline uint64_t br_read(struct bit_reader *br, unsigned int n)
+{
+	uint64_t v = br_peek(br, n);
+
+	br->consumed += n;
+	return v;
+}
+
+static inline int br_overflowed(const struct bit_reader *br)
+{
+	return br->consumed > 64;
+}
+
+static inline int br_finished(const struct bit_reader *br)
+{
+	return br->ptr == br->start && br->consumed == 64;
+}
+
+/* Reads n <= 16 bits at bit offset pos of a forward stream, past its end
+   the bits read as zero. */
+static uint32_t read_bits_fwd(const uint8_t *src, size_t srcn, size_t pos,
+			      int n)
+{
+	size_t byte = pos / 8;
+	uint32_t v;
+
+	if (byte >= srcn)
+		return 0;
+	if (srcn - byte >= sizeof(v))
+		v = read_le32(src + byte);
+	else
+		v = read_le_short(src + byte, srcn - byte);
+	return (v >> (pos % 8)) & ((1 << n) - 1);
+}
+
+/*
+ * Reads the normalized counts of an FSE table description. Returns the number
+ * of bytes used, or -1 on error.
+ */
+static int fse_read_counts(const uint8_t *src, size_t srcn, int16_t *counts,
+			   int *nb_symbols, int max_symbol, int max_log,
+			   int *log)
+{
+	int remaining, symbol = 0;
+	size_t pos = 4;
+
+	if (srcn < 1)
+		return -1;
+	*log = (src[0] & 0xf) + 5;
+	if (*log > max_log)
+		return -1;
+
+	remaining = 1 << *log;
+	while (remaining > 0 && symbol <= max_symbol) {
+		int bits = highbit(remaining + 1) + 1;
+		uint32_t lower_mask = (1 << (bits - 1)) - 1;
+		uint32_t threshold = (1 << bits) - 1 - (remaining + 1);
+		uint32_t val;
+		int count;
+
+		val = read_bits_fwd(src, srcn, pos, bits);
+		if ((val & lower_mask) < threshold) {
+			val &= lower_mask;
+			pos += bits - 1;
+		} else {
+			if (val > lower_mask)
+				val -= threshold;
+			pos += bits;
+		}
+
+		count = (int)val - 1;
+		remaining -= count < 0 ? -count : count;
+		counts[symbol++] = count;
+
+		if (count == 0) {
+			uint32_t repeat;
+
+			do {
+				repeat = read_bits_fwd(src, srcn, pos, 2);
+				pos += 2;
+				for (uint32_t i = 0; i < repeat; i++) {
+					if (symbol > max_symbol)
+						return -1;
+					counts[symbol++] = 0;
+				}
+			} while (repeat == 3);
+		}
+		if ((pos + 7) / 8 > srcn)
+			return -1;
+	}
+	if (remaining != 0)
+		return -1;
+
+	*nb_symbols = symbol;
+	return (pos + 7) / 8;
+}
+
+static int fse_build(struct fse_entry *table, const int16_t *counts,
+		     int nb_symbols, int log)
+{
+	uint16_t next[FSE_MAX_SYMBOLS];
+	uint32_t size = 1 << log;
+	uint32_t high = size, pos = 0;
+	uint32_t step = (size >> 1) + (size >> 3) + 3;
+	int s;
+
+	/* "Less than 1" probability symbols get one cell at the top. */
+	for (s = 0; s < nb_symbols; s++) {
+		if (counts[s] == -1) {
+			table[--high].symbol = s;
+			next[s] = 1;
+		}
+	}
+
+	for (s = 0; s < nb_symbols; s++) {
+		if (counts[s] <= 0)
+			continue;
+		next[s] = counts[s];
+		for (int i = 0; i < counts[s]; i++) {
+			table[pos].symbol = s;
+			do {
+				pos = (pos + step) & (size - 1);
+			} while (pos >= high);
+		}
+	}
+	if (pos != 0)
+		return -1;
+
+	for (uint32_t i = 0; i < size; i++) {
+		uint16_t state = next[table[i].symbol]++;
+		table[i].nb_bits = log - highbit(state);
+		table[i].base = (state << table[i].nb_bits) - size;
+	}
+	return 0;
+}
+
+/* Decodes the FSE compressed Huffman weights, returns their count or -1. */
+static int huf_read_fse_weights(const uint8_t *src, size_t srcn,
+				uint8_t *weights)
+{
+	struct fse_entry table[1 << HUF_WEIGHTS_LOG];
+	int16_t counts[HUF_MAX_BITS + 2];
+	struct bit_reader br;
+	uint32_t state1, state2;
+	int nb_symbols, log, used, count = 0;
+
+	used = fse_read_counts(src, srcn, counts, &nb_symbols,
+			       ARRAY_SIZE(counts) - 1, HUF_WEIGHTS_LOG, &log);
+	if (used < 0 || fse_build(table, counts, nb_symbols, log) ||
+	    br_init(&br, src + used, srcn - used))
+		return -1;
+
+	state1 = br_read(&br, log);
+	state2 = br_read(&br, log);
+
+	/* Two interleaved states, the last symbol is the one of the state
+	   that wasn't updated when the stream ran out. */
+	for (;;) {
+		if (count > HUF_MAX_SYMBOLS - 3)
+			return -1;
+		br_reload(&br);
+
+		weights[count++] = table[state1].symbol;
+		state1 = table[state1].base +
+			 br_read(&br, table[state1].nb_bits);
+		if (br_overflowed(&br)) {
+			weights[count++] = table[state2].symbol;
+			break;
+		}
+
+		weights[count++] = table[state2].symbol;
+		state2 = table[state2].base +
+			 br_read(&br, table[state2].nb_bits);
+		if (br_overflowed(&br)) {
+			weights[count++] = table[state1].symbol;
+			break;
+		}
+	}
+	return count;
+}
+
+/* Builds the decoding table from the weights of all but the last symbol. */
+static int huf_build(uint8_t *weights, int count)
+{
+	uint32_t rank_start[HUF_MAX_BITS + 1] = { 0 };
+	uint32_t sum = 0, left, next = 0;
+	int max_bits, w, s;
+
+	for (s = 0; s < count; s++) {
+		if (weights[s] > HUF_MAX_BITS)
+			return -1;
+		if (weights[s])
+			sum += 1 << (weights[s] - 1);
+	}
+	if (sum == 0)
+		return -1;
+
+	max_bits = highbit(sum) + 1;
+	if (max_bits > HUF_MAX_BITS)
+		return -1;
+	left = (1 << max_bits) - sum;
+	if (left & (left - 1))
+		return -1;
+	weights[count++] = highbit(left) + 1;
+
+	/* Symbols of weight w use 1 << (w - 1) cells, the longest codes
+	   (weight 1) come first. */
+	for (s = 0; s < count; s++)
+		if (weights[s])
+			rank_start[weights[s]] += 1 << (weights[s] - 1);
+	for (w = 1; w <= max_bits; w++) {
+		uint32_t cells = rank_start[w];
+		rank_start[w] = next;
+		next += cells;
+	}
+
+	for (s = 0; s < count; s++) {
+		struct huf_entry e = {
+			.symbol = s,
+			.nb_bits = max_bits + 1 - weights[s],
+		};
+
+		if (!weights[s])
+			continue;
+		for (uint32_t i = 0; i < 1U << (weights[s] - 1); i++)
+			ctx.huf[rank_start[weights[s]]++] = e;
+	}
+	ctx.huf_bits = max_bits;
+	return 0;
+}
+
+/* Reads a Huffman tree description, returns the number of bytes used or -1. */
+static int huf_read_table(const uint8_t *src, size_t srcn)
+{
+	uint8_t weights[HUF_MAX_SYMBOLS];
+	int count, size;
+
+	if (srcn < 1)
+		return -1;
+
+	if (src[0] >= 128) {
+		count = src[0] - 127;
+		size = (count + 1) / 2;
+		if ((size_t)size + 1 > srcn)
+			return -1;
+		for (int i = 0; i < count; i++) {
+			uint8_t b = src[1 + i / 2];
+			weights[i] = i % 2 ? b & 0xf : b >> 4;
+		}
+	} else {
+		size = src[0];
+		if (size == 0 || (size_t)size + 1 > srcn)
+			return -1;
+		count = huf_read_fse_weights(src + 1, size, weights);
+		if (count < 0)
+			return -1;
+	}
+
+	if (count >= HUF_MAX_SYMBOLS || huf_build(weights, count))
+		return -1;
+	return size + 1;
+}
+
+static int huf_decode_stream(const uint8_t *src, size_t srcn, uint8_t *out,
+			     size_t n)
+{
+	const struct huf_entry *e;
+	struct bit_reader br;
+	uint8_t *end = out + n;
+
+	if (br_init(&br, src, srcn))
+		return -1;
+
+	/* A reload leaves room for 5 codes of at most 11 bits. */
+	while (end - out >= 4) {
+		br_reload(&br);
+		for (int i = 0; i < 4; i++) {
+			e = &ctx.huf[br_peek(&br, ctx.huf_bits)];
+			br.consumed += e->nb_bits;
+			*out++ = e->symbol;
+		}
+	}
+	br_reload(&br);
+	while (out < end) {
+		e = &ctx.huf[br_peek(&br, ctx.huf_bits)];
+		br.consumed += e->nb_bits;
+		*out++ = e->symbol;
+	}
+
+	return br_finished(&br) ? 0 : -1;
+}
+
+static int huf_decode(const uint8_t *src, size_t srcn, uint8_t *out,
+		      size_t n, int streams)
+{
+	size_t sizes[4], seg;
+	int i;
+
+	if (streams == 1)
+		return huf_decode_stream(src, srcn, out, n);
+
+	/* Jump table with the sizes of the first three streams. */
+	if (srcn < 6)
+		return -1;
+	sizes[3] = srcn - 6;
+	for (i = 0; i < 3; i++) {
+		sizes[i] = src[2 * i] | (src[2 * i + 1] << 8);
+		if (sizes[i] > sizes[3])
+			return -1;
+		sizes[3] -= sizes[i];
+	}
+	src += 6;
+
+	seg = (n + 3) / 4;
+	if (3 * seg > n)
+		return -1;
+	for (i = 0; i < 4; i++) {
+		size_t len = i < 3 ? seg : n - 3 * seg;
+
+		if (huf_decode_stream(src, sizes[i], out, len))
+			return -1;
+		src += sizes[i];
+		out += len;
+	}
+	return 0;
+}
+
+struct literals {
+	const uint8_t *ptr;
+	const uint8_t *end;
+	int in_dst;	/* Staged at the end of the output buffer. */
+};
+
+/*
+ * Decodes the literals section of a block. Literals that need decoding are
+ * staged at the end of the output buffer, the sequences never overwrite them
+ * before they are read (see exec_sequence()). Returns the number of bytes used
+ * or -1.
+ */
+static int decode_literals(const uint8_t *src, size_t srcn, uint8_t *op,
+			   uint8_t *dend, struct literals *lits)
+{
+	int type = src[0] & 3, format = (src[0] >> 2) & 3;
+	int bits = format < 2 ? 10 : format == 2 ? 14 : 18;
+	size_t hlen, size, csize, used;
+	uint64_t header;
+	uint8_t *buf;
+
+	if (type < 2) {
+		/* Raw or RLE literals */
+		switch (format) {
+		case 1:
+			hlen = 2;
+			break;
+		case 3:
+			hlen = 3;
+			break;
+		default:
+			hlen = 1;
+			break;
+		}
+		if (srcn < hlen + (type == 1))
+			return -1;
+		size = read_le_short(src, hlen) >> (hlen == 1 ? 3 : 4);
+
+		if (type == 0) {
+			if (srcn - hlen < size)
+				return -1;
+			lits->ptr = src + hlen;
+			lits->end = lits->ptr + size;
+			lits->in_dst = 0;
+			return hlen + size;
+		}
+		if (size > (size_t)(dend - op))
+			return -1;
+		buf = dend - size;
+		memset(buf, src[hlen], size);
+		lits->ptr = buf;
+		lits->end = dend;
+		lits->in_dst = 1;
+		return hlen + 1;
+	}
+
+	/* Huffman coded literals, type 3 reuses the previous table. */
+	hlen = format < 2 ? 3 : format + 2;
+	if (srcn < hlen)
+		return -1;
+	header = read_le_short(src, hlen);
+	size = (header >> 4) & ((1 << bits) - 1);
+	csize = (header >> (4 + bits)) & ((1 << bits) - 1);
+	if (srcn - hlen < csize || size > ZSTD_BLOCK_SIZE_MAX ||
+	    size > (size_t)(dend - op))
+		return -1;
+	used = hlen + csize;
+
+	src += hlen;
+	if (type == 2) {
+		int table = huf_read_table(src, csize);
+		if (table < 0)
+			return -1;
+		src += table;
+		csize -= table;
+	} else if (!ctx.huf_bits) {
+		return -1;
+	}
+
+	buf = dend - size;
+	if (huf_decode(src, csize, buf, size, format == 0 ? 1 : 4))
+		return -1;
+	lits->ptr = buf;
+	lits->end = dend;
+	lits->in_dst = 1;
+	return used;
+}
+
+/* Sets up a sequence decoding table, returns the number of bytes used or -1. */
+static int seq_read_table(struct fse_table *t, int mode, const uint8_t *src,
+			  size_t srcn, const int16_t *defaults, int nb_defaults,
+			  int default_log, int max_symbol, int max_log)
+{
+	int16_t counts[FSE_MAX_SYMBOLS];
+	int nb_symbols, used = 0;
+
+	switch (mode) {
+	case MODE_PREDEFINED:
+		t->log = default_log;
+		if (fse_build(t->entries, defaults, nb_defaults, t->log))
+			return -1;
+		break;
+	case MODE_RLE:
+		if (srcn < 1 || src[0] > max_symbol)
+			return -1;
+		t->log = 0;
+		t->entries[0].symbol = src[0];
+		t->entries[0].nb_bits = 0;
+		t->entries[0].base = 0;
+		used = 1;
+		break;
+	case MODE_FSE:
+		used = fse_read_counts(src, srcn, counts, &nb_symbols,
+				       max_symbol, max_log, &t->log);
+		if (used < 0 || fse_build(t->entries, counts, nb_symbols,
+					  t->log))
+			return -1;
+		break;
+	case MODE_REPEAT:
+		if (!t->valid)
+			return -1;
+		break;
+	}
+	t->valid = 1;
+	return used;
+}
+
+static inline uint32_t fse_update(const struct fse_table *t, uint32_t state,
+				  struct bit_reader *br)
+{
+	return t->entries[state].base + br_read(br, t->entries[state].nb_bits);
+}
+
+/* Resolves the offset value of a sequence, returns 0 if it is invalid. */
+static inline size_t resolve_offset(uint32_t value, size_t ll)
+{
+	uint32_t *rep = ctx.rep;
+	uint32_t offset;
+	int idx;
+
+	if (value > 3) {
+		offset = value - 3;
+		rep[2] = rep[1];
+		rep[1] = rep[0];
+		rep[0] = offset;
+		return offset;
+	}
+
+	idx = value - 1 + (ll == 0);
+	if (idx == 0)
+		return rep[0];
+	offset = idx == 3 ? rep[0] - 1 : rep[idx];
+	if (idx != 1)
+		rep[2] = rep[1];
+	rep[1] = rep[0];
+	rep[0] = offset;
+	return offset;
+}
+
+/*
+ * Copies forward, 8 bytes at a time. Works for overlapping buffers as long as
+ * dst is below src or at least 8 bytes above it.
+ */
+static inline void copy_forward(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	uint64_t v;
+
+	for (; n >= sizeof(v); n -= sizeof(v)) {
+		memcpy(&v, src, sizeof(v));
+		memcpy(dst, &v, sizeof(v));
+		dst += sizeof(v);
+		src += sizeof(v);
+	}
+	while (n--)
+		*dst++ = *src++;
+}
+
+/*
+ * Copies the literals and the match of a sequence. Staged literals sit at the
+ * end of the output buffer, since a block never produces fewer bytes than it
+ * has literals, writing up to the next unread literal is always safe.
+ */
+static int exec_sequence(uint8_t **opp, uint8_t *fstart, uint8_t *dend,
+			 struct literals *lits, size_t ll, size_t ml,
+			 size_t offset)
+{
+	uint8_t *op = *opp;
+	const uint8_t *match;
+
+	if (ll > (size_t)(lits->end - lits->ptr))
+		return -1;
+	if (lits->in_dst ? ml > (size_t)(lits->ptr - op) :
+			   ll + ml > (size_t)(dend - op))
+		return -1;
+
+	copy_forward(op, lits->ptr, ll);
+	op += ll;
+	lits->ptr += ll;
+
+	if (offset == 0 || offset > (size_t)(op - fstart))
+		return -1;
+	match = op - offset;
+	if (offset >= sizeof(uint64_t)) {
+		copy_forward(op, match, ml);
+		op += ml;
+	} else {
+		while (ml--)
+			*op++ = *match++;
+	}
+
+	*opp = op;
+	return 0;
+}
+
+static int decode_sequences(const uint8_t *src, size_t srcn, uint8_t **opp,
+			    uint8_t *fstart, uint8_t *dend,
+			    struct literals *lits, uint32_t nb_seq)
+{
+	struct bit_reader br;
+	uint32_t ll_state, of_state, ml_state;
+
+	if (br_init(&br, src, srcn))
+		return -1;
+
+	ll_state = br_read(&br, ctx.ll.log);
+	of_state = br_read(&br, ctx.of.log);
+	ml_state = br_read(&br, ctx.ml.log);
+
+	while (nb_seq--) {
+		uint8_t ll_code = ctx.ll.entries[ll_state].symbol;
+		uint8_t of_code = ctx.of.entries[of_state].symbol;
+		uint8_t ml_code = ctx.ml.entries[ml_state].symbol;
+		uint32_t of_value;
+		size_t ll, ml;
+
+		/* Offset codes take up to 31 bits, the lengths up to 16 each
+		   and the state updates up to 26. */
+		br_reload(&br);
+		of_value = (1U << of_code) + br_read(&br, of_code);
+		br_reload(&br);
+		ml = ml_base[ml_code] + br_read(&br, ml_bits[ml_code]);
+		ll = ll_base[ll_code] + br_read(&br, ll_bits[ll_code]);
+		br_reload(&br);
+
+		if (exec_sequence(opp, fstart, dend, lits, ll, ml,
+				  resolve_offset(of_value, ll)))
+			return -1;
+
+		if (nb_seq) {
+			ll_state = fse_update(&ctx.ll, ll_state, &br);
+			ml_state = fse_update(&ctx.ml, ml_state, &br);
+			of_state = fse_update(&ctx.of, of_state, &br);
+		}
+	}
+
+	return br_finished(&br) ? 0 : -1;
+}
+
+static int decode_block(const uint8_t *src, size_t srcn, uint8_t **opp,
+			uint8_t *fstart, uint8_t *dend)
+{
+	struct literals lits;
+	uint32_t nb_seq;
+	size_t rest;
+	int used;
+
+	if (srcn < 1)
+		return -1;
+	used = decode_literals(src, srcn, *opp, dend, &lits);
+	if (used < 0 || (size_t)used >= srcn)
+		return -1;
+	src += used;
+	srcn -= used;
+
+	nb_seq = src[0];
+	if (nb_seq >= 128) {
+		if (srcn < 2 || (nb_seq == 255 && srcn < 3))
+			return -1;
+		if (nb_seq == 255) {
+			nb_seq = src[1] + (src[2] << 8) + 0x7f00;
+			used = 3;
+		} else {
+			nb_seq = ((nb_seq - 128) << 8) + src[1];
+			used = 2;
+		}
+	} else {
+		used = 1;
+	}
+	src += used;
+	srcn -= used;
+
+	if (nb_seq) {
+		int modes, ll, of, ml;
+
+		if (srcn < 1 || (src[0] & 3))
+			return -1;
+		modes = src[0];
+		src++;
+		srcn--;
+
+		ll = seq_read_table(&ctx.ll, modes >> 6, src, srcn, ll_default,
+				    ARRAY_SIZE(ll_default), 6, LL_MAX_SYMBOL,
+				    LL_MAX_LOG);
+		if (ll < 0)
+			return -1;
+		of = seq_read_table(&ctx.of, (modes >> 4) & 3, src + ll,
+				    srcn - ll, of_default,
+				    ARRAY_SIZE(of_default), 5, OF_MAX_SYMBOL,
+				    OF_MAX_LOG);
+		if (of < 0)
+			return -1;
+		ml = seq_read_table(&ctx.ml, (modes >> 2) & 3, src + ll + of,
+				    srcn - ll - of, ml_default,
+				    ARRAY_SIZE(ml_default), 6, ML_MAX_SYMBOL,
+				    ML_MAX_LOG);
+		if (ml < 0)
+			return -1;
+		used = ll + of + ml;
+
+		if (decode_sequences(src + used, srcn - used, opp, fstart,
+				     dend, &lits, nb_seq))
+			return -1;
+	}
+
+	/* The literals left after the last sequence. */
+	rest = lits.end - lits.ptr;
+	if (lits.in_dst ? *opp > lits.ptr : rest > (size_t)(dend - *opp))
+		return -1;
+	memmove(*opp, lits.ptr, rest);
+	*opp += rest;
+	return 0;
+}
+
+/* Decodes a frame following its magic, returns the number of bytes used or 0. */
+static size_t decode_frame(const uint8_t *src, size_t srcn, uint8_t **opp,
+			   uint8_t *dend)
+{
+	static const uint8_t did_sizes[] = { 0, 1, 2, 4 };
+	uint8_t *fstart = *opp;
+	size_t pos = 1, fcs_size, did_size;
+	uint64_t fcs = 0, did;
+	uint8_t fhd;
+	int last;
+
+	if (srcn < 1)
+		return 0;
+	fhd = src[0];
+	if (fhd & 0x08)
+		return 0;
+
+	/* The window descriptor isn't needed, the output is the window. */
+	if (!(fhd & 0x20))
+		pos++;
+	did_size = did_sizes[fhd & 3];
+	fcs_size = (fhd >> 6) ? 1 << (fhd >> 6) : !!(fhd & 0x20);
+	if (srcn < pos + did_size + fcs_size)
+		return 0;
+
+	did = read_le_short(src + pos, did_size);
+	pos += did_size;
+	if (did)
+		return 0;
+	if (fcs_size) {
+		fcs = read_le_short(src + pos, fcs_size);
+		if (fcs_size == 2)
+			fcs += 256;
+		pos += fcs_size;
+	}
+
+	ctx.rep[0] = 1;
+	ctx.rep[1] = 4;
+	ctx.rep[2] = 8;
+	ctx.huf_bits = 0;
+	ctx.ll.valid = ctx.of.valid = ctx.ml.valid = 0;
+
+	do {
+		uint32_t header;
+		size_t size;
+
+		if (srcn - pos < 3)
+			return 0;
+		header = read_le_short(src + pos, 3);
+		pos += 3;
+		last = header & 1;
+		size = header >> 3;
+
+		switch ((header >> 1) & 3) {
+		case 0:
+			if (srcn - pos < size || size > (size_t)(dend - *opp))
+				return 0;
+			memcpy(*opp, src + pos, size);
+			*opp += size;
+			pos += size;
+			break;
+		case 1:
+			if (srcn - pos < 1 || size > (size_t)(dend - *opp))
+				return 0;
+			memset(*opp, src[pos], size);
+			*opp += size;
+			pos++;
+			break;
+		case 2:
+			if (srcn - pos < size || size > ZSTD_BLOCK_SIZE_MAX ||
+			    decode_block(src + pos, size, opp, fstart, dend))
+				return 0;
+			pos += size;
+			break;
+		default:
+			return 0;
+		}
+	} while (!last);
+
+	/* Content checksum */
+	if (fhd & 0x04) {
+		if (srcn - pos < 4)
+			return 0;
+		pos += 4;
+	}
+
+	if (fcs_size && fcs != (uint64_t)(*opp - fstart))
+		return 0;
+	return pos;
+}
+
+size_t uzstdn(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	const uint8_t *in = src, *end = in + srcn;
+	uint8_t *op = dst, *dend = op + dstn;
+
+	while (in < end) {
+		uint32_t magic;
+		size_t used;
+
+		if (end - in < 4)
+			return 0;
+		magic = read_le32(in);
+
+		if ((magic & ~0xfU) == ZSTD_SKIPPABLE_MAGIC) {
+			if (end - in < 8 || read_le32(in + 4) > (size_t)(end - in - 8))
+				return 0;
+			in += 8 + read_le32(in + 4);
+			continue;
+		}
+		if (magic != ZSTD_MAGIC)
+			return 0;
+
+		used = decode_frame(in + 4, end - in - 4, &op, dend);
+		if (!used)
+			return 0;
+		in += 4 + used;
+	}
+
+	return op - (uint8_t *)dst;
+}
@@ -28,6 +28,9 @@
 
 static acpi_rsdp_t *valid_rsdp(acpi_rsdp_t *rsdp);
 
+/* RSDP of the tables written by write_acpi_tables() during this boot */
+static acpi_rsdp_t *written_rsdp;
+
 u8 acpi_checksum(u8 *table, u32 length)
 {
 	u8 ret = 0;
@@ -448,6 +451,7 @@ static void acpi_ssdt_write_cbtable(void)
 void acpi_create_ssdt_generator(acpi_header_t *ssdt, const char *oem_table_id)
 {
 	unsigned long current = (unsigned long)ssdt + sizeof(acpi_header_t);
+	size_t aml_size;
 
 	memset((void *)ssdt, 0, sizeof(acpi_header_t));
 
@@ -473,6 +477,11 @@ void acpi_create_ssdt_generator(acpi_header_t *ssdt, const char *oem_table_id)
 		current = (unsigned long) acpigen_get_current();
 	}
 
+	aml_size = current - (unsigned long)ssdt - sizeof(acpi_header_t);
+	if (acpigen_get_saved())
+		printk(BIOS_DEBUG, "ACPI: SSDT AML optimized from %zu to %zu bytes\n",
+		       aml_size + acpigen_get_saved(), aml_size);
+
 	/* (Re)calculate length and checksum. */
 	ssdt->length = current - (unsigned long)ssdt;
 	ssdt->checksum = acpi_checksum((void *)ssdt, ssdt->length);
@@ -1296,6 +1305,7 @@ unsigned long write_acpi_tables(unsigned long start)
 	size_t slic_size, dsdt_size;
 	char oem_id[6], oem_table_id[8];
 
+	written_rsdp = NULL;
 	current = start;
 
 	/* Align ACPI tables to 16byte */
@@ -1314,6 +1324,7 @@ unsigned long write_acpi_tables(unsigned long start)
 		}
 		if (!rsdp)
 			return fw;
+		written_rsdp = rsdp;
 
 		/* Add BOOT0000 for Linux google firmware driver */
 		printk(BIOS_DEBUG, "ACPI:     * SSDT\n");
@@ -1383,6 +1394,7 @@ unsigned long write_acpi_tables(unsigned long start)
 
 	/* We need at least an RSDP and an RSDT Table */
 	rsdp = (acpi_rsdp_t *) current;
+	written_rsdp = rsdp;
 	current += sizeof(acpi_rsdp_t);
 	current = acpi_align_current(current);
 	rsdt = (acpi_rsdt_t *) current;
@@ -1530,6 +1542,11 @@ static acpi_rsdp_t *valid_rsdp(acpi_rsdp_t *rsdp)
 	return rsdp;
 }
 
+acpi_rsdp_t *acpi_get_rsdp(void)
+{
+	return written_rsdp;
+}
+
 void *acpi_find_wakeup_vector(void)
 {
 	char *p, *end;
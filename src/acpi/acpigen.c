@@ -10,6 +10,10 @@
 
 #define ACPIGEN_MAXLEN 0xfffff
 
+/* Longest namespace path data objects are shared in, and how many are remembered. */
+#define ACPIGEN_PATH_MAX 48
+#define ACPIGEN_SHARED_MAX 32
+
 #include <lib.h>
 #include <string.h>
 #include <acpi/acpigen.h>
@@ -25,15 +29,45 @@ static char *gencurrent;
 char *len_stack[ACPIGEN_LENSTACK_SIZE];
 int ltop = 0;
 
+static bool optimize = CONFIG(ACPIGEN_OPTIMIZE);
+static size_t saved;
+
+/* Absolute path of the namespace scope opened on each level, empty if it isn't one. */
+static char scope_path[ACPIGEN_LENSTACK_SIZE][ACPIGEN_PATH_MAX];
+
+/* Data objects written so far that identical ones can refer to. */
+static struct acpigen_shared {
+	char name[5];
+	char path[ACPIGEN_PATH_MAX];
+	const char *data;
+	size_t size;
+} shared[ACPIGEN_SHARED_MAX];
+static size_t num_shared;
+
 void acpigen_write_len_f(void)
 {
 	ASSERT(ltop < (ACPIGEN_LENSTACK_SIZE - 1))
+	scope_path[ltop][0] = '\0';
 	len_stack[ltop++] = gencurrent;
 	acpigen_emit_byte(0);
 	acpigen_emit_byte(0);
 	acpigen_emit_byte(0);
 }
 
+/* Drop |count| of the 3 bytes reserved for the package length at |p|. */
+static void acpigen_shrink_len(char *p, int count)
+{
+	size_t i;
+
+	memmove(p + 3 - count, p + 3, gencurrent - (p + 3));
+	gencurrent -= count;
+	saved += count;
+
+	for (i = 0; i < num_shared; i++)
+		if (shared[i].data > p)
+			shared[i].data -= count;
+}
+
 void acpigen_pop_len(void)
 {
 	int len;
@@ -41,16 +75,109 @@ void acpigen_pop_len(void)
 	char *p = len_stack[--ltop];
 	len = gencurrent - p;
 	ASSERT(len <= ACPIGEN_MAXLEN)
-	/* generate store length for 0xfffff max */
-	p[0] = (0x80 | (len & 0xf));
-	p[1] = (len >> 4 & 0xff);
-	p[2] = (len >> 12 & 0xff);
-
+	if (optimize && len - 2 <= 0x3f) {
+		acpigen_shrink_len(p, 2);
+		p[0] = len - 2;
+	} else if (optimize && len - 1 <= 0xfff) {
+		acpigen_shrink_len(p, 1);
+		len--;
+		p[0] = (0x40 | (len & 0xf));
+		p[1] = (len >> 4 & 0xff);
+	} else {
+		/* generate store length for 0xfffff max */
+		p[0] = (0x80 | (len & 0xf));
+		p[1] = (len >> 4 & 0xff);
+		p[2] = (len >> 12 & 0xff);
+	}
 }
 
 void acpigen_set_current(char *curr)
 {
 	gencurrent = curr;
+	saved = 0;
+	num_shared = 0;
+}
+
+void acpigen_set_optimize(bool enable)
+{
+	optimize = enable;
+}
+
+size_t acpigen_get_saved(void)
+{
+	return saved;
+}
+
+/* Record the path of the scope, device or processor that was just opened. */
+static void acpigen_set_scope_path(const char *name)
+{
+	const char *parent = ltop > 1 ? scope_path[ltop - 2] : "\\";
+	char *path = scope_path[ltop - 1];
+
+	if (!optimize)
+		return;
+
+	if (name[0] == '\\')
+		parent = "";
+	else if (!parent[0] || strchr(name, '^'))
+		return;
+
+	if (snprintf(path, ACPIGEN_PATH_MAX, "%s%s%s", parent,
+		     parent[0] && parent[1] ? "." : "", name) >= ACPIGEN_PATH_MAX)
+		path[0] = '\0';
+}
+
+/*
+ * Called after a data object Name (name, ...) that started at |start| was written. If an
+ * identical object was written before, replace it with a method returning that one:
+ * Method (name, 0, NotSerialized) { Return (\path.name) }
+ */
+static void acpigen_share_name(const char *name, char *start)
+{
+	const char *scope = ltop ? scope_path[ltop - 1] : "\\";
+	const char *data = start + 1 + 4;
+	size_t size = gencurrent - data;
+	char ref[ACPIGEN_PATH_MAX + 5];
+	struct acpigen_shared *obj;
+	size_t saved_before, i;
+	char *method;
+
+	if (!optimize || !scope[0] || strlen(name) != 4)
+		return;
+
+	for (i = 0; i < num_shared; i++) {
+		obj = &shared[i];
+		if (obj->size != size || strcmp(obj->name, name) || memcmp(obj->data, data, size))
+			continue;
+
+		/* Write the method behind the object and keep it only if it is smaller. */
+		method = gencurrent;
+		saved_before = saved;
+		snprintf(ref, sizeof(ref), "%s%s%s", obj->path, obj->path[1] ? "." : "", name);
+		acpigen_write_method(name, 0);
+		acpigen_emit_byte(RETURN_OP);
+		acpigen_emit_namestring(ref);
+		acpigen_pop_len();
+		saved = saved_before;
+
+		if (gencurrent - method < method - start) {
+			memmove(start, method, gencurrent - method);
+			saved += method - start - (gencurrent - method);
+			gencurrent = start + (gencurrent - method);
+		} else {
+			gencurrent = method;
+		}
+		return;
+	}
+
+	if (num_shared == ARRAY_SIZE(shared))
+		return;
+
+	obj = &shared[num_shared++];
+	strcpy(obj->name, name);
+	strcpy(obj->path, scope);
+	obj->data = data;
+	obj->size = size;
 }
 
 char *acpigen_get_current(void)
@@ -149,16 +276,37 @@ void acpigen_write_integer(uint64_t data)
 		acpigen_write_qword(data);
 }
 
+/* Integer in a data package, |width| bytes wide unless optimizing. */
+static void acpigen_write_package_integer(uint64_t data, size_t width)
+{
+	char *start = gencurrent;
+
+	if (optimize) {
+		acpigen_write_integer(data);
+		saved += 1 + width - (gencurrent - start);
+		return;
+	}
+
+	if (width == 1)
+		acpigen_write_byte(data);
+	else if (width == 2)
+		acpigen_write_word(data);
+	else if (width == 4)
+		acpigen_write_dword(data);
+	else
+		acpigen_write_qword(data);
+}
+
 void acpigen_write_name_zero(const char *name)
 {
 	acpigen_write_name(name);
-	acpigen_write_one();
+	acpigen_write_zero();
 }
 
 void acpigen_write_name_one(const char *name)
 {
 	acpigen_write_name(name);
-	acpigen_write_zero();
+	acpigen_write_one();
 }
 
 void acpigen_write_name_byte(const char *name, uint8_t val)
@@ -335,6 +483,7 @@ void acpigen_write_scope(const char *name)
 {
 	acpigen_emit_byte(SCOPE_OP);
 	acpigen_write_len_f();
+	acpigen_set_scope_path(name);
 	acpigen_emit_namestring(name);
 }
 
@@ -362,6 +511,7 @@ void acpigen_write_processor(u8 cpuindex, u32 pblock_addr, u8 pblock_len)
 
 	snprintf(pscope, sizeof(pscope),
 		 CONFIG_ACPI_CPU_STRING, (unsigned int) cpuindex);
+	acpigen_set_scope_path(pscope);
 	acpigen_emit_namestring(pscope);
 	acpigen_emit_byte(cpuindex);
 	acpigen_emit_dword(pblock_addr);
@@ -727,6 +877,7 @@ void acpigen_write_device(const char *name)
 {
 	acpigen_emit_ext_op(DEVICE_OP);
 	acpigen_write_len_f();
+	acpigen_set_scope_path(name);
 	acpigen_emit_namestring(name);
 }
 
@@ -820,12 +971,12 @@ void acpigen_write_PSS_package(u32 coreFreq, u32 power, u32 transLat,
 			      u32 busmLat, u32 control, u32 status)
 {
 	acpigen_write_package(6);
-	acpigen_write_dword(coreFreq);
-	acpigen_write_dword(power);
-	acpigen_write_dword(transLat);
-	acpigen_write_dword(busmLat);
-	acpigen_write_dword(control);
-	acpigen_write_dword(status);
+	acpigen_write_package_integer(coreFreq, 4);
+	acpigen_write_package_integer(power, 4);
+	acpigen_write_package_integer(transLat, 4);
+	acpigen_write_package_integer(busmLat, 4);
+	acpigen_write_package_integer(control, 4);
+	acpigen_write_package_integer(status, 4);
 	acpigen_pop_len();
 
 	printk(BIOS_DEBUG, "PSS: %uMHz power %u control 0x%x status 0x%x\n",
@@ -834,6 +985,7 @@ void acpigen_write_PSS_package(u32 coreFreq, u32 power, u32 transLat,
 
 void acpigen_write_pss_object(const struct acpi_sw_pstate *pstate_values, size_t nentries)
 {
+	char *start = acpigen_get_current();
 	size_t pstate;
 
 	acpigen_write_name("_PSS");
@@ -847,6 +999,7 @@ void acpigen_write_pss_object(const struct acpi_sw_pstate *pstate_values, size_t
 	}
 
 	acpigen_pop_len();
+	acpigen_share_name("_PSS", start);
 }
 
 void acpigen_write_PSD_package(u32 domain, u32 numprocs, PSD_coord coordtype)
@@ -854,11 +1007,11 @@ void acpigen_write_PSD_package(u32 domain, u32 numprocs, PSD_coord coordtype)
 	acpigen_write_name("_PSD");
 	acpigen_write_package(1);
 	acpigen_write_package(5);
-	acpigen_write_byte(5);	// 5 values
-	acpigen_write_byte(0);	// revision 0
-	acpigen_write_dword(domain);
-	acpigen_write_dword(coordtype);
-	acpigen_write_dword(numprocs);
+	acpigen_write_package_integer(5, 1);	// 5 values
+	acpigen_write_package_integer(0, 1);	// revision 0
+	acpigen_write_package_integer(domain, 4);
+	acpigen_write_package_integer(coordtype, 4);
+	acpigen_write_package_integer(numprocs, 4);
 	acpigen_pop_len();
 	acpigen_pop_len();
 }
@@ -867,14 +1020,15 @@ void acpigen_write_CST_package_entry(acpi_cstate_t *cstate)
 {
 	acpigen_write_package(4);
 	acpigen_write_register_resource(&cstate->resource);
-	acpigen_write_byte(cstate->ctype);
-	acpigen_write_word(cstate->latency);
-	acpigen_write_dword(cstate->power);
+	acpigen_write_package_integer(cstate->ctype, 1);
+	acpigen_write_package_integer(cstate->latency, 2);
+	acpigen_write_package_integer(cstate->power, 4);
 	acpigen_pop_len();
 }
 
 void acpigen_write_CST_package(acpi_cstate_t *cstate, int nentries)
 {
+	char *start = acpigen_get_current();
 	int i;
 	acpigen_write_name("_CST");
 	acpigen_write_package(nentries+1);
@@ -884,6 +1038,7 @@ void acpigen_write_CST_package(acpi_cstate_t *cstate, int nentries)
 		acpigen_write_CST_package_entry(cstate + i);
 
 	acpigen_pop_len();
+	acpigen_share_name("_CST", start);
 }
 
 void acpigen_write_CSD_package(u32 domain, u32 numprocs, CSD_coord coordtype,
@@ -893,11 +1048,11 @@ void acpigen_write_CSD_package(u32 domain, u32 numprocs, CSD_coord coordtype,
 	acpigen_write_package(1);
 	acpigen_write_package(6);
 	acpigen_write_integer(6);	// 6 values
-	acpigen_write_byte(0);	// revision 0
-	acpigen_write_dword(domain);
-	acpigen_write_dword(coordtype);
-	acpigen_write_dword(numprocs);
-	acpigen_write_dword(index);
+	acpigen_write_package_integer(0, 1);	// revision 0
+	acpigen_write_package_integer(domain, 4);
+	acpigen_write_package_integer(coordtype, 4);
+	acpigen_write_package_integer(numprocs, 4);
+	acpigen_write_package_integer(index, 4);
 	acpigen_pop_len();
 	acpigen_pop_len();
 }
@@ -912,6 +1067,7 @@ void acpigen_write_TSS_package(int entries, acpi_tstate_t *tstate_list)
 		Package(){50, 520, 0, 0x18, 0)
 	})
 */
+	char *start = acpigen_get_current();
 	int i;
 	acpi_tstate_t *tstate = tstate_list;
 
@@ -920,16 +1076,17 @@ void acpigen_write_TSS_package(int entries, acpi_tstate_t *tstate_list)
 
 	for (i = 0; i < entries; i++) {
 		acpigen_write_package(5);
-		acpigen_write_dword(tstate->percent);
-		acpigen_write_dword(tstate->power);
-		acpigen_write_dword(tstate->latency);
-		acpigen_write_dword(tstate->control);
-		acpigen_write_dword(tstate->status);
+		acpigen_write_package_integer(tstate->percent, 4);
+		acpigen_write_package_integer(tstate->power, 4);
+		acpigen_write_package_integer(tstate->latency, 4);
+		acpigen_write_package_integer(tstate->control, 4);
+		acpigen_write_package_integer(tstate->status, 4);
 		acpigen_pop_len();
 		tstate++;
 	}
 
 	acpigen_pop_len();
+	acpigen_share_name("_TSS", start);
 }
 
 void acpigen_write_TSD_package(u32 domain, u32 numprocs, PSD_coord coordtype)
@@ -937,11 +1094,11 @@ void acpigen_write_TSD_package(u32 domain, u32 numprocs, PSD_coord coordtype)
 	acpigen_write_name("_TSD");
 	acpigen_write_package(1);
 	acpigen_write_package(5);
-	acpigen_write_byte(5);	// 5 values
-	acpigen_write_byte(0);	// revision 0
-	acpigen_write_dword(domain);
-	acpigen_write_dword(coordtype);
-	acpigen_write_dword(numprocs);
+	acpigen_write_package_integer(5, 1);	// 5 values
+	acpigen_write_package_integer(0, 1);	// revision 0
+	acpigen_write_package_integer(domain, 4);
+	acpigen_write_package_integer(coordtype, 4);
+	acpigen_write_package_integer(numprocs, 4);
 	acpigen_pop_len();
 	acpigen_pop_len();
 }
@@ -1428,9 +1585,9 @@ void acpigen_write_upc(enum acpi_upc_type type)
 	acpigen_write_name("_UPC");
 	acpigen_write_package(4);
 	/* Connectable */
-	acpigen_write_byte(type == UPC_TYPE_UNUSED ? 0 : 0xff);
+	acpigen_write_package_integer(type == UPC_TYPE_UNUSED ? 0 : 0xff, 1);
 	/* Type */
-	acpigen_write_byte(type);
+	acpigen_write_package_integer(type, 1);
 	/* Reserved0 */
 	acpigen_write_zero();
 	/* Reserved1 */
@@ -1440,6 +1597,7 @@ void acpigen_write_upc(enum acpi_upc_type type)
 
 void acpigen_write_pld(const struct acpi_pld *pld)
 {
+	char *start = acpigen_get_current();
 	uint8_t buf[20];
 
 	if (acpi_pld_to_buffer(pld, buf, ARRAY_SIZE(buf)) < 0)
@@ -1449,6 +1607,7 @@ void acpigen_write_pld(const struct acpi_pld *pld)
 	acpigen_write_package(1);
 	acpigen_write_byte_buffer(buf, ARRAY_SIZE(buf));
 	acpigen_pop_len();
+	acpigen_share_name("_PLD", start);
 }
 
 void acpigen_write_dsm(const char *uuid, void (**callbacks)(void *),
@@ -2033,10 +2192,10 @@ void acpigen_write_pct_package(const acpi_addr_t *perf_ctrl, const acpi_addr_t *
 void acpigen_write_xpss_package(const struct acpi_xpss_sw_pstate *pstate_value)
 {
 	acpigen_write_package(0x08);
-	acpigen_write_dword(pstate_value->core_freq);
-	acpigen_write_dword(pstate_value->power);
-	acpigen_write_dword(pstate_value->transition_latency);
-	acpigen_write_dword(pstate_value->bus_master_latency);
+	acpigen_write_package_integer(pstate_value->core_freq, 4);
+	acpigen_write_package_integer(pstate_value->power, 4);
+	acpigen_write_package_integer(pstate_value->transition_latency, 4);
+	acpigen_write_package_integer(pstate_value->bus_master_latency, 4);
 
 	acpigen_write_byte_buffer((uint8_t *)&pstate_value->control_value, sizeof(uint64_t));
 	acpigen_write_byte_buffer((uint8_t *)&pstate_value->status_value, sizeof(uint64_t));
@@ -2048,6 +2207,7 @@ void acpigen_write_xpss_package(const struct acpi_xpss_sw_pstate *pstate_value)
 
 void acpigen_write_xpss_object(const struct acpi_xpss_sw_pstate *pstate_values, size_t nentries)
 {
+	char *start = acpigen_get_current();
 	size_t pstate;
 
 	acpigen_write_name("XPSS");
@@ -2058,4 +2218,5 @@ void acpigen_write_xpss_object(const struct acpi_xpss_sw_pstate *pstate_values,
 	}
 
 	acpigen_pop_len();
+	acpigen_share_name("XPSS", start);
 }
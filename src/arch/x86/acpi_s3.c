@@ -64,6 +64,8 @@ static void acpi_jump_to_wakeup(void *vector)
 
 	timestamp_add_now(TS_ACPI_WAKE_JUMP);
 
+	console_drain();
+
 	acpi_do_wakeup((uintptr_t)vector);
 }
 
@@ -77,7 +79,9 @@ void __noreturn acpi_resume(void *wake_vec)
 	apm_control(APM_CNT_GNVS_UPDATE);
 
 	/* Call mainboard resume handler first, if defined. */
+	timestamp_add_now(TS_START_MAINBOARD_RESUME);
 	mainboard_suspend_resume();
+	timestamp_add_now(TS_END_MAINBOARD_RESUME);
 
 	post_code(POST_OS_RESUME);
 	acpi_jump_to_wakeup(wake_vec);
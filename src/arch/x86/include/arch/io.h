@@ -3,6 +3,7 @@
 #ifndef __ARCH_IO_H__
 #define __ARCH_IO_H__
 
+#include <hw_access.h>
 #include <stdint.h>
 
 /*
@@ -12,37 +13,52 @@
  */
 static inline void outb(uint8_t value, uint16_t port)
 {
+	uint64_t start = hw_access_start();
+
 	__asm__ __volatile__ ("outb %b0, %w1" : : "a" (value), "Nd" (port));
+	hw_access_end(HW_ACCESS_IO, start);
 }
 
 static inline void outw(uint16_t value, uint16_t port)
 {
+	uint64_t start = hw_access_start();
+
 	__asm__ __volatile__ ("outw %w0, %w1" : : "a" (value), "Nd" (port));
+	hw_access_end(HW_ACCESS_IO, start);
 }
 
 static inline void outl(uint32_t value, uint16_t port)
 {
+	uint64_t start = hw_access_start();
+
 	__asm__ __volatile__ ("outl %0, %w1" : : "a" (value), "Nd" (port));
+	hw_access_end(HW_ACCESS_IO, start);
 }
 
 static inline uint8_t inb(uint16_t port)
 {
+	uint64_t start = hw_access_start();
 	uint8_t value;
 	__asm__ __volatile__ ("inb %w1, %b0" : "=a"(value) : "Nd" (port));
+	hw_access_end(HW_ACCESS_IO, start);
 	return value;
 }
 
 static inline uint16_t inw(uint16_t port)
 {
+	uint64_t start = hw_access_start();
 	uint16_t value;
 	__asm__ __volatile__ ("inw %w1, %w0" : "=a"(value) : "Nd" (port));
+	hw_access_end(HW_ACCESS_IO, start);
 	return value;
 }
 
 static inline uint32_t inl(uint16_t port)
 {
+	uint64_t start = hw_access_start();
 	uint32_t value;
 	__asm__ __volatile__ ("inl %w1, %0" : "=a"(value) : "Nd" (port));
+	hw_access_end(HW_ACCESS_IO, start);
 	return value;
 }
 
@@ -3,46 +3,75 @@
 #ifndef __ARCH_MMIO_H__
 #define __ARCH_MMIO_H__
 
+#include <hw_access.h>
 #include <stdint.h>
 
 static __always_inline uint8_t read8(const volatile void *addr)
 {
-	return *((volatile uint8_t *)(addr));
+	uint64_t start = hw_access_start();
+	uint8_t value = *((volatile uint8_t *)(addr));
+
+	hw_access_end(HW_ACCESS_MMIO, start);
+	return value;
 }
 
 static __always_inline uint16_t read16(const volatile void *addr)
 {
-	return *((volatile uint16_t *)(addr));
+	uint64_t start = hw_access_start();
+	uint16_t value = *((volatile uint16_t *)(addr));
+
+	hw_access_end(HW_ACCESS_MMIO, start);
+	return value;
 }
 
 static __always_inline uint32_t read32(const volatile void *addr)
 {
-	return *((volatile uint32_t *)(addr));
+	uint64_t start = hw_access_start();
+	uint32_t value = *((volatile uint32_t *)(addr));
+
+	hw_access_end(HW_ACCESS_MMIO, start);
+	return value;
 }
 
 static __always_inline uint64_t read64(const volatile void *addr)
 {
-	return *((volatile uint64_t *)(addr));
+	uint64_t start = hw_access_start();
+	uint64_t value = *((volatile uint64_t *)(addr));
+
+	hw_access_end(HW_ACCESS_MMIO, start);
+	return value;
 }
 
 static __always_inline void write8(volatile void *addr, uint8_t value)
 {
+	uint64_t start = hw_access_start();
+
 	*((volatile uint8_t *)(addr)) = value;
+	hw_access_end(HW_ACCESS_MMIO, start);
 }
 
 static __always_inline void write16(volatile void *addr, uint16_t value)
 {
+	uint64_t start = hw_access_start();
+
 	*((volatile uint16_t *)(addr)) = value;
+	hw_access_end(HW_ACCESS_MMIO, start);
 }
 
 static __always_inline void write32(volatile void *addr, uint32_t value)
 {
+	uint64_t start = hw_access_start();
+
 	*((volatile uint32_t *)(addr)) = value;
+	hw_access_end(HW_ACCESS_MMIO, start);
 }
 
 static __always_inline void write64(volatile void *addr, uint64_t value)
 {
+	uint64_t start = hw_access_start();
+
 	*((volatile uint64_t *)(addr)) = value;
+	hw_access_end(HW_ACCESS_MMIO, start);
 }
 
 #endif /* __ARCH_MMIO_H__ */
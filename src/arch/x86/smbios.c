@@ -21,9 +21,11 @@
 #endif
 #include <drivers/vpd/vpd.h>
 #include <stdlib.h>
+#include <timer.h>
 
 #define update_max(len, max_len, stmt)		\
 	do {					\
+		smbios_string_table_reset();	\
 		int tmp = stmt;			\
 						\
 		max_len = MAX(max_len, tmp);	\
@@ -73,10 +75,118 @@ static u8 smbios_get_device_type_from_dev(struct device *dev)
 	}
 }
 
-int smbios_add_string(u8 *start, const char *str)
+#define SMBIOS_STRING_SLOTS	64
+/* Strings beyond this are looked up by scanning the table */
+#define SMBIOS_STRING_HASHED	48
+
+/*
+ * String table of the structure that is currently being written. The hashes of its strings
+ * and its length are tracked, so adding a string and getting the length of the table don't
+ * have to scan all strings every time. The tracking starts over when strings are added to
+ * another structure and is reset before every structure writer runs.
+ */
+static struct {
+	u8 *start;
+	size_t len;		/* Without the final terminator */
+	size_t unhashed;	/* Offset of the first string that is not hashed */
+	int count;
+	struct {
+		u32 hash;
+		u16 offset;
+		u8 index;	/* 0 if the slot is unused */
+	} slots[SMBIOS_STRING_SLOTS];
+} string_table;
+
+static struct {
+	int strings;
+	int shared;
+} string_stats;
+
+static u32 smbios_string_hash(const char *str, size_t len)
+{
+	u32 hash = 2166136261;	/* FNV-1a */
+
+	while (len--) {
+		hash ^= (u8)*str++;
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+static void smbios_string_insert(const char *str, size_t len)
+{
+	u32 hash = smbios_string_hash(str, len);
+	size_t slot;
+
+	string_table.count++;
+	if (string_table.count > SMBIOS_STRING_HASHED)
+		return;
+
+	slot = hash % SMBIOS_STRING_SLOTS;
+	while (string_table.slots[slot].index)
+		slot = (slot + 1) % SMBIOS_STRING_SLOTS;
+
+	string_table.slots[slot].hash = hash;
+	string_table.slots[slot].offset = (u8 *)str - string_table.start;
+	string_table.slots[slot].index = string_table.count;
+	string_table.unhashed = (u8 *)str - string_table.start + len + 1;
+}
+
+void smbios_string_table_reset(void)
+{
+	string_table.start = NULL;
+}
+
+static void smbios_string_table_init(u8 *start)
 {
-	int i = 1;
 	char *p = (char *)start;
+	size_t len;
+
+	memset(&string_table, 0, sizeof(string_table));
+	string_table.start = start;
+
+	/* Callers may have put strings in the table without smbios_add_string(). */
+	while (*p) {
+		len = strlen(p);
+		smbios_string_insert(p, len);
+		p += len + 1;
+	}
+
+	string_table.len = p - (char *)start;
+}
+
+static int smbios_string_find(const char *str, size_t len)
+{
+	u32 hash = smbios_string_hash(str, len);
+	size_t slot = hash % SMBIOS_STRING_SLOTS;
+	const char *p;
+	int i;
+
+	for (; string_table.slots[slot].index; slot = (slot + 1) % SMBIOS_STRING_SLOTS) {
+		p = (char *)string_table.start + string_table.slots[slot].offset;
+		if (string_table.slots[slot].hash == hash && !strcmp(p, str))
+			return string_table.slots[slot].index;
+	}
+
+	if (string_table.count <= SMBIOS_STRING_HASHED)
+		return 0;
+
+	p = (char *)string_table.start + string_table.unhashed;
+	for (i = SMBIOS_STRING_HASHED + 1; *p; i++) {
+		if (!strcmp(p, str))
+			return i;
+		p += strlen(p) + 1;
+	}
+
+	return 0;
+}
+
+int smbios_add_string(u8 *start, const char *str)
+{
+	size_t len = strlen(str);
+	char *p;
+	int i;
 
 	/*
 	 * Return 0 as required for empty strings.
@@ -85,21 +195,24 @@ int smbios_add_string(u8 *start, const char *str)
 	if (*str == '\0')
 		return 0;
 
-	for (;;) {
-		if (!*p) {
-			strcpy(p, str);
-			p += strlen(str);
-			*p++ = '\0';
-			*p++ = '\0';
-			return i;
-		}
+	if (string_table.start != start)
+		smbios_string_table_init(start);
 
-		if (!strcmp(p, str))
-			return i;
-
-		p += strlen(p)+1;
-		i++;
+	i = smbios_string_find(str, len);
+	if (i) {
+		string_stats.shared++;
+		return i;
 	}
+
+	p = (char *)start + string_table.len;
+	memcpy(p, str, len + 1);
+	p[len + 1] = '\0';
+
+	smbios_string_insert(p, len);
+	string_table.len += len + 1;
+	string_stats.strings++;
+
+	return string_table.count;
 }
 
 int smbios_string_table_len(u8 *start)
@@ -107,6 +220,9 @@ int smbios_string_table_len(u8 *start)
 	char *p = (char *)start;
 	int i, len = 0;
 
+	if (string_table.start == start)
+		return string_table.len ? string_table.len + 1 : 2;
+
 	while (*p) {
 		i = strlen(p) + 1;
 		p += i;
@@ -1234,9 +1350,12 @@ static int smbios_walk_device_tree(struct device *tree, int *handle, unsigned lo
 	for (dev = tree; dev; dev = dev->next) {
 		if (dev->enabled && dev->ops && dev->ops->get_smbios_data) {
 			printk(BIOS_INFO, "%s (%s)\n", dev_path(dev), dev_name(dev));
+			smbios_string_table_reset();
 			len += dev->ops->get_smbios_data(dev, handle, current);
 		}
+		smbios_string_table_reset();
 		len += smbios_walk_device_tree_type9(dev, handle, current);
+		smbios_string_table_reset();
 		len += smbios_walk_device_tree_type41(dev, handle, current);
 	}
 	return len;
@@ -1250,6 +1369,10 @@ unsigned long smbios_write_tables(unsigned long current)
 	int len = 0;
 	int max_struct_size = 0;
 	int handle = 0;
+	struct stopwatch sw;
+
+	stopwatch_init(&sw);
+	memset(&string_stats, 0, sizeof(string_stats));
 
 	current = ALIGN_UP(current, 16);
 	printk(BIOS_DEBUG, "%s: %08lx\n", __func__, current);
@@ -1319,5 +1442,44 @@ unsigned long smbios_write_tables(unsigned long current)
 
 	se3->checksum = smbios_checksum((u8 *)se3, sizeof(struct smbios_entry30));
 
+	printk(BIOS_DEBUG, "SMBIOS: %d structures, %d bytes (largest %d), %d strings "
+	       "(%d shared), took %ld us\n", handle, len, max_struct_size,
+	       string_stats.strings, string_stats.shared, stopwatch_duration_usecs(&sw));
+
 	return current;
 }
+
+unsigned long smbios_move_tables(unsigned long start, unsigned long end, unsigned long to)
+{
+	struct smbios_entry *se;
+	struct smbios_entry30 *se3;
+	long delta = to - start;
+
+	/* The offsets of the entry points and tables only stay the same with equal alignment. */
+	if (!IS_ALIGNED(start ^ to, 16)) {
+		printk(BIOS_ERR, "SMBIOS: Can't move tables to %lx\n", to);
+		return end;
+	}
+
+	memmove((void *)to, (void *)start, end - start);
+
+	se = (struct smbios_entry *)to;
+	se3 = (struct smbios_entry30 *)ALIGN_UP(to + sizeof(struct smbios_entry), 16);
+
+	se->struct_table_address += delta;
+	se->intermediate_checksum = 0;
+	se->intermediate_checksum = smbios_checksum((u8 *)se + 0x10,
+						    sizeof(struct smbios_entry) - 0x10);
+	se->checksum = 0;
+	se->checksum = smbios_checksum((u8 *)se, sizeof(struct smbios_entry));
+
+	se3->struct_table_address += delta;
+	se3->checksum = 0;
+	se3->checksum = smbios_checksum((u8 *)se3, sizeof(struct smbios_entry30));
+
+#if CONFIG(CHROMEOS) && CONFIG(HAVE_ACPI_TABLES)
+	chromeos_get_chromeos_acpi()->vbt10 += delta;
+#endif
+
+	return end + delta;
+}
@@ -15,28 +15,28 @@
 static unsigned long write_pirq_table(unsigned long rom_table_end)
 {
 	unsigned long high_table_pointer;
+	size_t size;
 
-#define MAX_PIRQ_TABLE_SIZE (4 * 1024)
 	post_code(0x9a);
 
 	/* This table must be between 0x0f0000 and 0x100000 */
-	rom_table_end = write_pirq_routing_table(rom_table_end);
-	rom_table_end = ALIGN_UP(rom_table_end, 1024);
+	rom_table_end = ALIGN_UP(rom_table_end, 16);
+	size = write_pirq_routing_table(rom_table_end) - rom_table_end;
+	rom_table_end = ALIGN_UP(rom_table_end + size, 1024);
+
+	if (!size)
+		return rom_table_end;
 
 	/* And add a high table version for those payloads that
-	 * want to live in the F segment
+	 * want to live in the F segment. The table is placed on
+	 * a 16 byte boundary, so written to an aligned address it
+	 * needs exactly as much space as the low copy.
 	 */
-	high_table_pointer = (unsigned long)cbmem_add(CBMEM_ID_PIRQ,
-		MAX_PIRQ_TABLE_SIZE);
-	if (high_table_pointer) {
+	high_table_pointer = (unsigned long)cbmem_add(CBMEM_ID_PIRQ, size);
+	if (high_table_pointer && IS_ALIGNED(high_table_pointer, 16)) {
 		unsigned long new_high_table_pointer;
 		new_high_table_pointer =
 			write_pirq_routing_table(high_table_pointer);
-		// FIXME make pirq table code intelligent enough to know how
-		// much space it's going to need.
-		if (new_high_table_pointer > (high_table_pointer
-			+ MAX_PIRQ_TABLE_SIZE))
-			printk(BIOS_ERR, "ERROR: Increase PIRQ size.\n");
 		printk(BIOS_DEBUG, "PIRQ table: %ld bytes.\n",
 				new_high_table_pointer - high_table_pointer);
 	}
@@ -47,24 +47,23 @@ static unsigned long write_pirq_table(unsigned long rom_table_end)
 static unsigned long write_mptable(unsigned long rom_table_end)
 {
 	unsigned long high_table_pointer;
+	size_t size;
 
-#define MAX_MP_TABLE_SIZE (4 * 1024)
 	post_code(0x9b);
 
 	/* The smp table must be in 0-1K, 639K-640K, or 960K-1M */
-	rom_table_end = write_smp_table(rom_table_end);
-	rom_table_end = ALIGN_UP(rom_table_end, 1024);
+	rom_table_end = ALIGN_UP(rom_table_end, 16);
+	size = write_smp_table(rom_table_end) - rom_table_end;
+	rom_table_end = ALIGN_UP(rom_table_end + size, 1024);
 
-	high_table_pointer = (unsigned long)cbmem_add(CBMEM_ID_MPTABLE,
-		MAX_MP_TABLE_SIZE);
-	if (high_table_pointer) {
+	if (!size)
+		return rom_table_end;
+
+	/* Like the low copy, the high copy starts on a 16 byte boundary. */
+	high_table_pointer = (unsigned long)cbmem_add(CBMEM_ID_MPTABLE, size);
+	if (high_table_pointer && IS_ALIGNED(high_table_pointer, 16)) {
 		unsigned long new_high_table_pointer;
 		new_high_table_pointer = write_smp_table(high_table_pointer);
-		// FIXME make mp table code intelligent enough to know how
-		// much space it's going to need.
-		if (new_high_table_pointer > (high_table_pointer
-			+ MAX_MP_TABLE_SIZE))
-			printk(BIOS_ERR, "ERROR: Increase MP table size.\n");
 
 		printk(BIOS_DEBUG, "MP table: %ld bytes.\n",
 				new_high_table_pointer - high_table_pointer);
@@ -95,8 +94,8 @@ static unsigned long write_acpi_table(unsigned long rom_table_end)
 	high_table_pointer = (unsigned long)cbmem_add(CBMEM_ID_ACPI,
 		max_acpi_size);
 	if (high_table_pointer) {
-		unsigned long acpi_start = high_table_pointer;
 		unsigned long new_high_table_pointer;
+		acpi_rsdp_t *high_rsdp;
 
 		rom_table_end = ALIGN_UP(rom_table_end, 16);
 		new_high_table_pointer = write_acpi_tables(high_table_pointer);
@@ -106,22 +105,12 @@ static unsigned long write_acpi_table(unsigned long rom_table_end)
 		printk(BIOS_DEBUG, "ACPI tables: %ld bytes.\n",
 				new_high_table_pointer - high_table_pointer);
 
-		/* Now we need to create a low table copy of the RSDP. */
-
-		/* First we look for the high table RSDP */
-		while (acpi_start < new_high_table_pointer) {
-			if (memcmp(((acpi_rsdp_t *)acpi_start)->signature,
-				RSDP_SIG, 8) == 0)
-				break;
-			acpi_start++;
-		}
-
-		/* Now, if we found the RSDP, we take the RSDT and XSDT pointer
-		 * from it in order to write the low RSDP
+		/* Now we need to create a low table copy of the RSDP, which
+		 * has the RSDT and XSDT pointers of the high tables.
 		 */
-		if (acpi_start < new_high_table_pointer) {
-			acpi_rsdp_t *low_rsdp = (acpi_rsdp_t *)rom_table_end,
-				    *high_rsdp = (acpi_rsdp_t *)acpi_start;
+		high_rsdp = acpi_get_rsdp();
+		if (high_rsdp) {
+			acpi_rsdp_t *low_rsdp = (acpi_rsdp_t *)rom_table_end;
 
 			/* Technically rsdp length varies but coreboot always
 			   writes longest size available.  */
@@ -139,19 +128,46 @@ static unsigned long write_acpi_table(unsigned long rom_table_end)
 	return rom_table_end;
 }
 
+/*
+ * Shrink the SMBIOS area from MAX_SMBIOS_SIZE to the size of the tables. CBMEM grows
+ * downwards, so the tables move up into the smaller area. That is only possible as long as
+ * the SMBIOS area is the last one that was added.
+ */
+static unsigned long shrink_smbios_table(unsigned long *high_table_pointer,
+					 unsigned long new_high_table_pointer)
+{
+	const struct cbmem_entry *e = cbmem_entry_find(CBMEM_ID_SMBIOS);
+	size_t size = new_high_table_pointer - *high_table_pointer;
+	void *area;
+
+	if (!e || cbmem_entry_remove(e))
+		return new_high_table_pointer;
+
+	/* The freed area is at least as large, so this can't fail. */
+	area = cbmem_add(CBMEM_ID_SMBIOS, size);
+	new_high_table_pointer = smbios_move_tables(*high_table_pointer,
+						    new_high_table_pointer, (uintptr_t)area);
+	*high_table_pointer = (uintptr_t)area;
+
+	return new_high_table_pointer;
+}
+
 static unsigned long write_smbios_table(unsigned long rom_table_end)
 {
 	unsigned long high_table_pointer;
 
-#define MAX_SMBIOS_SIZE 2048
+/* Systems with dozens of DIMMs and slots need several KiB. */
+#define MAX_SMBIOS_SIZE (32 * KiB)
 
 	high_table_pointer = (unsigned long)cbmem_add(CBMEM_ID_SMBIOS,
 		MAX_SMBIOS_SIZE);
 	if (high_table_pointer) {
 		unsigned long new_high_table_pointer;
 
-		new_high_table_pointer =
-			smbios_write_tables(high_table_pointer);
+		new_high_table_pointer = smbios_write_tables(high_table_pointer);
+		if (new_high_table_pointer <= high_table_pointer + MAX_SMBIOS_SIZE)
+			new_high_table_pointer = shrink_smbios_table(
+				&high_table_pointer, new_high_table_pointer);
 		rom_table_end = ALIGN_UP(rom_table_end, 16);
 		memcpy((void *)rom_table_end, (void *)high_table_pointer,
 			sizeof(struct smbios_entry));
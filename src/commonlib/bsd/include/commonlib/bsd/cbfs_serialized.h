@@ -13,6 +13,7 @@
 #define CBFS_COMPRESS_NONE  0
 #define CBFS_COMPRESS_LZMA  1
 #define CBFS_COMPRESS_LZ4   2
+#define CBFS_COMPRESS_ZSTD  3
 
 /** These are standard component types for well known
     components (i.e - those that coreboot needs to consume.
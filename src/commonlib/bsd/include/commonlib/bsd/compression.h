@@ -18,4 +18,13 @@ size_t ulz4fn(const void *src, size_t srcn, void *dst, size_t dstn);
 /* Same as ulz4fn() but does not perform any bounds checks. */
 size_t ulz4f(const void *src, void *dst);
 
+/* Decompresses one or more Zstandard frames from src to dst, ensuring that it
+ * doesn't read more than srcn bytes and doesn't write more than dstn. The part
+ * of dst past the decompressed data is used as scratch space and may be
+ * overwritten. Frames that need a dictionary are not supported, and checksums
+ * are not verified. Not reentrant, and cannot decompress in-place.
+ * Returns amount of decompressed bytes, or 0 on error.
+ */
+size_t uzstdn(const void *src, size_t srcn, void *dst, size_t dstn);
+
 #endif	/* _COMMONLIB_COMPRESSION_H_ */
@@ -22,6 +22,7 @@
 #define CBMEM_ID_FSP_RUNTIME	0x52505346
 #define CBMEM_ID_GDT		0x4c474454
 #define CBMEM_ID_HOB_POINTER	0x484f4221
+#define CBMEM_ID_HW_ACCESS	0x48574143
 #define CBMEM_ID_IGD_OPREGION	0x4f444749
 #define CBMEM_ID_IMD_ROOT	0xff4017ff
 #define CBMEM_ID_IMD_SMALL	0x53a11439
@@ -33,6 +34,7 @@
 #define CBMEM_ID_VAR_MRCDATA	0x4d524345
 #define CBMEM_ID_MTC		0xcb31d31c
 #define CBMEM_ID_NONE		0x00000000
+#define CBMEM_ID_PCI_ROM_CACHE	0x4f50524d
 #define CBMEM_ID_PIRQ		0x49525154
 #define CBMEM_ID_POWER_STATE	0x50535454
 #define CBMEM_ID_RAM_OOPS	0x05430095
@@ -89,6 +91,7 @@
 	{ CBMEM_ID_FSP_RUNTIME,		"FSP RUNTIME" }, \
 	{ CBMEM_ID_GDT,			"GDT        " }, \
 	{ CBMEM_ID_HOB_POINTER,		"HOB        " }, \
+	{ CBMEM_ID_HW_ACCESS,		"HW ACCESS  " }, \
 	{ CBMEM_ID_IMD_ROOT,		"IMD ROOT   " }, \
 	{ CBMEM_ID_IMD_SMALL,		"IMD SMALL  " }, \
 	{ CBMEM_ID_MEMINFO,		"MEM INFO   " }, \
@@ -98,6 +101,7 @@
 	{ CBMEM_ID_MRCDATA,		"MRC DATA   " }, \
 	{ CBMEM_ID_VAR_MRCDATA,		"VARMRC DATA" }, \
 	{ CBMEM_ID_MTC,			"MTC        " }, \
+	{ CBMEM_ID_PCI_ROM_CACHE,	"OPROM $    " }, \
 	{ CBMEM_ID_PIRQ,		"IRQ TABLE  " }, \
 	{ CBMEM_ID_POWER_STATE,		"POWER STATE" }, \
 	{ CBMEM_ID_RAM_OOPS,		"RAMOOPS    " }, \
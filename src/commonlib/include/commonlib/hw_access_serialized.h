@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef __HW_ACCESS_SERIALIZED_H__
+#define __HW_ACCESS_SERIALIZED_H__
+
+#include <stdint.h>
+
+enum hw_access_type {
+	HW_ACCESS_PCI_CFG,
+	HW_ACCESS_MMIO,
+	HW_ACCESS_IO,
+	HW_ACCESS_MSR,
+	HW_ACCESS_TYPES,
+};
+
+#define HW_ACCESS_TYPE_NAMES	{ "pci", "mmio", "io", "msr" }
+
+struct hw_access_counter {
+	uint32_t	count;
+	uint32_t	reserved;
+	uint64_t	ticks;
+} __packed;
+
+#define HW_ACCESS_STATE_NAME_LEN	24
+
+struct hw_access_state_entry {
+	char		name[HW_ACCESS_STATE_NAME_LEN];
+	struct hw_access_counter counters[HW_ACCESS_TYPES];
+} __packed;
+
+/* Per boot state hardware access counters, stored in CBMEM_ID_HW_ACCESS. */
+struct hw_access_table {
+	uint16_t	max_entries;
+	uint16_t	tick_freq_mhz;
+	uint32_t	num_entries;
+	struct hw_access_state_entry entries[0]; /* Variable number of entries */
+} __packed;
+
+#endif
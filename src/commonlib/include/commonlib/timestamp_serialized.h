@@ -36,6 +36,10 @@ enum timestamp_id {
 	TS_END_ULZMA = 16,
 	TS_START_ULZ4F = 17,
 	TS_END_ULZ4F = 18,
+	TS_START_STAGE_CACHE_LOAD = 19,
+	TS_END_STAGE_CACHE_LOAD = 20,
+	TS_START_UZSTD = 21,
+	TS_END_UZSTD = 22,
 	TS_DEVICE_ENUMERATE = 30,
 	TS_DEVICE_CONFIGURE = 40,
 	TS_DEVICE_ENABLE = 50,
@@ -48,6 +52,9 @@ enum timestamp_id {
 	TS_WRITE_TABLES = 80,
 	TS_FINALIZE_CHIPS = 85,
 	TS_LOAD_PAYLOAD = 90,
+	TS_OS_RESUME = 95,
+	TS_START_MAINBOARD_RESUME = 96,
+	TS_END_MAINBOARD_RESUME = 97,
 	TS_ACPI_WAKE_JUMP = 98,
 	TS_SELFBOOT_JUMP = 99,
 	TS_START_POSTCAR = 100,
@@ -163,6 +170,10 @@ static const struct timestamp_id_to_name {
 	{ TS_END_ULZMA,		"finished LZMA decompress (ignore for x86)" },
 	{ TS_START_ULZ4F,	"starting LZ4 decompress (ignore for x86)" },
 	{ TS_END_ULZ4F,		"finished LZ4 decompress (ignore for x86)" },
+	{ TS_START_STAGE_CACHE_LOAD,	"starting to load stage from stage cache" },
+	{ TS_END_STAGE_CACHE_LOAD,	"finished loading stage from stage cache" },
+	{ TS_START_UZSTD,	"starting Zstandard decompress (ignore for x86)" },
+	{ TS_END_UZSTD,		"finished Zstandard decompress (ignore for x86)" },
 	{ TS_DEVICE_ENUMERATE,	"device enumeration" },
 	{ TS_DEVICE_CONFIGURE,	"device configuration" },
 	{ TS_DEVICE_ENABLE,	"device enable" },
@@ -175,6 +186,9 @@ static const struct timestamp_id_to_name {
 	{ TS_WRITE_TABLES,	"write tables" },
 	{ TS_FINALIZE_CHIPS,	"finalize chips" },
 	{ TS_LOAD_PAYLOAD,	"load payload" },
+	{ TS_OS_RESUME,		"OS resume" },
+	{ TS_START_MAINBOARD_RESUME,	"starting mainboard resume handler" },
+	{ TS_END_MAINBOARD_RESUME,	"finished mainboard resume handler" },
 	{ TS_ACPI_WAKE_JUMP,	"ACPI wake jump" },
 	{ TS_SELFBOOT_JUMP,	"selfboot jump" },
 
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: GPL-2.0-only */
 
 #include <console/cbmem_console.h>
+#include <console/console.h>
 #include <console/ne2k.h>
 #include <console/qemu_debugcon.h>
 #include <console/spkmodem.h>
@@ -28,6 +29,15 @@ void console_hw_init(void)
 void console_tx_byte(unsigned char byte)
 {
 	__cbmemc_tx_byte(byte);
+
+	if (CONSOLE_DEFERRED)
+		console_defer_byte(byte);
+	else
+		console_tx_byte_slow(byte);
+}
+
+void console_tx_byte_slow(unsigned char byte)
+{
 	__spkmodem_tx_byte(byte);
 	__qemu_debugcon_tx_byte(byte);
 
@@ -60,6 +70,7 @@ void console_write_line(uint8_t *buffer, size_t number_of_bytes)
 {
 	/* Finish displaying all of the console data if requested */
 	if (number_of_bytes == 0) {
+		console_drain();
 		console_tx_flush();
 		return;
 	}
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <commonlib/helpers.h>
+#include <console/streams.h>
+#include <string.h>
+
+/*
+ * Output for the consoles other than CBMEM, waiting to be written out. head and tail count
+ * all bytes ever added and drained, their difference is the amount of pending output.
+ */
+static u8 buffer[CONFIG_CONSOLE_DEFERRED_BUFFER_SIZE];
+static size_t head, tail;
+
+size_t console_pending(void)
+{
+	return head - tail;
+}
+
+void console_defer(const void *buf, size_t len)
+{
+	const u8 *data = buf;
+	size_t offset, chunk;
+
+	/* Make room by writing out the oldest output. */
+	if (len > sizeof(buffer) - console_pending())
+		console_drain_bytes(len - (sizeof(buffer) - console_pending()));
+
+	/* Output that doesn't fit in the buffer at all is written out right away. */
+	while (len > sizeof(buffer)) {
+		console_tx_byte_slow(*data++);
+		len--;
+	}
+
+	while (len) {
+		offset = head % sizeof(buffer);
+		chunk = MIN(len, sizeof(buffer) - offset);
+		memcpy(buffer + offset, data, chunk);
+		data += chunk;
+		len -= chunk;
+		head += chunk;
+	}
+}
+
+size_t console_drain_bytes(size_t max)
+{
+	size_t count = MIN(max, console_pending());
+	size_t i;
+
+	if (!count)
+		return 0;
+
+	for (i = 0; i < count; i++)
+		console_tx_byte_slow(buffer[tail++ % sizeof(buffer)]);
+
+	console_tx_flush();
+
+	return count;
+}
@@ -34,6 +34,10 @@ static void console_time_stop(void)
 	}
 }
 
+/* Deferred console output drained while waiting, which doesn't add to the boot time. */
+static size_t idle_bytes;
+static long idle_usecs;
+
 void console_time_report(void)
 {
 	if (!TRACK_CONSOLE_TIME)
@@ -41,6 +45,11 @@ void console_time_report(void)
 
 	printk(BIOS_DEBUG, "BS: " ENV_STRING " times (exec / console): total (unknown) / %ld ms\n",
 		DIV_ROUND_CLOSEST(console_usecs, USECS_PER_MSEC));
+
+	if (CONSOLE_DEFERRED)
+		printk(BIOS_DEBUG, "BS: " ENV_STRING " console drained %zu bytes in %ld ms "
+		       "while waiting, %zu bytes pending\n", idle_bytes,
+		       DIV_ROUND_CLOSEST(idle_usecs, USECS_PER_MSEC), console_pending());
 }
 
 long console_time_get_and_reset(void)
@@ -70,6 +79,24 @@ static void wrap_putchar_cbmemc(unsigned char byte, void *data)
 	__cbmemc_tx_byte(byte);
 }
 
+/* With deferred output, messages are formatted into a line buffer and passed on in bulk. */
+static char line[128];
+static size_t line_len;
+
+static void line_flush(void)
+{
+	__cbmemc_write(line, line_len);
+	console_defer(line, line_len);
+	line_len = 0;
+}
+
+static void wrap_putchar_line(unsigned char byte, void *data)
+{
+	line[line_len++] = byte;
+	if (line_len == sizeof(line))
+		line_flush();
+}
+
 int do_vprintk(int msg_level, const char *fmt, va_list args)
 {
 	int i, log_this;
@@ -88,6 +115,12 @@ int do_vprintk(int msg_level, const char *fmt, va_list args)
 
 	if (log_this == CONSOLE_LOG_FAST) {
 		i = vtxprintf(wrap_putchar_cbmemc, fmt, args, NULL);
+	} else if (CONSOLE_DEFERRED) {
+		i = vtxprintf(wrap_putchar_line, fmt, args, NULL);
+		line_flush();
+		/* Don't hold back errors, the system may not get much further. */
+		if (msg_level <= BIOS_ERR)
+			console_drain_bytes(console_pending());
 	} else {
 		i = vtxprintf(wrap_putchar, fmt, args, NULL);
 		console_tx_flush();
@@ -101,6 +134,56 @@ int do_vprintk(int msg_level, const char *fmt, va_list args)
 	return i;
 }
 
+#if CONSOLE_DEFERRED
+/* Output that bypasses printk(), like FSP debug output, can come from any CPU. */
+void console_defer_byte(unsigned char byte)
+{
+	DISABLE_TRACE;
+	spin_lock(&console_lock);
+	console_defer(&byte, 1);
+	spin_unlock(&console_lock);
+	ENABLE_TRACE;
+}
+
+void console_drain(void)
+{
+	DISABLE_TRACE;
+	spin_lock(&console_lock);
+
+	console_time_run();
+	console_drain_bytes(console_pending());
+	console_time_stop();
+
+	spin_unlock(&console_lock);
+	ENABLE_TRACE;
+}
+
+/* Bytes written out per call, to keep the caller responsive. */
+#define IDLE_DRAIN_BYTES	16
+
+void console_drain_idle(void)
+{
+	struct mono_time start, stop;
+
+	if (!console_pending())
+		return;
+
+	DISABLE_TRACE;
+	spin_lock(&console_lock);
+
+	if (TRACK_CONSOLE_TIME)
+		timer_monotonic_get(&start);
+	idle_bytes += console_drain_bytes(IDLE_DRAIN_BYTES);
+	if (TRACK_CONSOLE_TIME) {
+		timer_monotonic_get(&stop);
+		idle_usecs += mono_time_diff_microseconds(&start, &stop);
+	}
+
+	spin_unlock(&console_lock);
+	ENABLE_TRACE;
+}
+#endif
+
 int do_printk(int msg_level, const char *fmt, ...)
 {
 	va_list args;
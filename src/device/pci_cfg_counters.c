@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <bootstate.h>
+#include <commonlib/helpers.h>
+#include <console/console.h>
+#include <device/device.h>
+#include <device/pci_ops.h>
+#include <stdbool.h>
+
+#define PCI_CFG_COUNTERS_MAX	256
+#define PCI_CFG_COUNTERS_REPORT	16
+
+struct pci_cfg_counter {
+	const struct device *dev;
+	u32 reads;
+	u32 writes;
+};
+
+static struct pci_cfg_counter counters[PCI_CFG_COUNTERS_MAX];
+static u32 untracked_cycles;
+
+void pci_cfg_cycles_account(const struct device *dev, bool write)
+{
+	size_t i, slot;
+
+	/* Open addressing on the device pointer, devices are never freed in ramstage. */
+	slot = ((uintptr_t)dev / sizeof(*dev)) % ARRAY_SIZE(counters);
+
+	for (i = 0; i < ARRAY_SIZE(counters); i++) {
+		struct pci_cfg_counter *c = &counters[(slot + i) % ARRAY_SIZE(counters)];
+
+		if (c->dev != dev && c->dev != NULL)
+			continue;
+
+		c->dev = dev;
+		if (write)
+			c->writes++;
+		else
+			c->reads++;
+		return;
+	}
+
+	untracked_cycles++;
+}
+
+static u32 counter_cycles(const struct pci_cfg_counter *c)
+{
+	return c->reads + c->writes;
+}
+
+static void pci_cfg_cycles_report(void)
+{
+	const struct pci_cfg_counter *top[PCI_CFG_COUNTERS_REPORT] = { NULL };
+	const struct pci_cfg_counter *c;
+	u32 total = untracked_cycles;
+	size_t i, j, devices = 0;
+
+	/* Insertion sort of the devices with the most config cycles. */
+	for (c = counters; c < counters + ARRAY_SIZE(counters); c++) {
+		if (!c->dev)
+			continue;
+
+		devices++;
+		total += counter_cycles(c);
+
+		for (i = 0; i < ARRAY_SIZE(top); i++) {
+			if (top[i] && counter_cycles(top[i]) >= counter_cycles(c))
+				continue;
+			for (j = ARRAY_SIZE(top) - 1; j > i; j--)
+				top[j] = top[j - 1];
+			top[i] = c;
+			break;
+		}
+	}
+
+	printk(BIOS_DEBUG, "PCI: %u config cycles on %zu devices", total, devices);
+	if (untracked_cycles)
+		printk(BIOS_DEBUG, " (%u not tracked)", untracked_cycles);
+	printk(BIOS_DEBUG, "\n");
+
+	for (i = 0; i < ARRAY_SIZE(top) && top[i]; i++)
+		printk(BIOS_DEBUG, "PCI: %-24s %6u reads %6u writes\n",
+		       dev_path(top[i]->dev), top[i]->reads, top[i]->writes);
+}
+
+static void pci_cfg_cycles_report_bs(void *unused)
+{
+	pci_cfg_cycles_report();
+}
+
+BOOT_STATE_INIT_ENTRY(BS_DEV_INIT, BS_ON_EXIT, pci_cfg_cycles_report_bs, NULL);
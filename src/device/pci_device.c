@@ -744,8 +744,12 @@ void pci_dev_init(struct device *dev)
 	if (((dev->class >> 8) != PCI_CLASS_DISPLAY_VGA))
 		return;
 
-	if (!should_load_oprom(dev))
+	if (!should_load_oprom(dev)) {
+		/* Put back the initialized VBIOS image the OS saw before suspend. */
+		if (acpi_is_wakeup_s3())
+			pci_rom_cache_restore_shadow(dev);
 		return;
+	}
 	timestamp_add_now(TS_OPROM_INITIALIZE);
 
 	rom = pci_rom_probe(dev);
@@ -761,6 +765,7 @@ void pci_dev_init(struct device *dev)
 		return;
 
 	run_bios(dev, (unsigned long)ram);
+	pci_rom_cache_save_shadow(dev, ram);
 
 	gfx_set_init_done(1);
 	printk(BIOS_DEBUG, "VGA Option ROM was run\n");
@@ -23,17 +23,27 @@ struct rom_header *pci_rom_probe(const struct device *dev)
 	u8 mapped_rev = rev;
 	u32 vendev = (dev->vendor << 16) | dev->device;
 	u32 mapped_vendev = vendev;
+	bool cached;
 
 	/* If the ROM is in flash, then don't check the PCI device for it. */
 	if (CONFIG(CHECK_REV_IN_OPROM_NAME)) {
-		rom_header = cbfs_boot_map_optionrom_revision(dev->vendor, dev->device, rev);
 		map_oprom_vendev_rev(&mapped_vendev, &mapped_rev);
 	} else {
-		rom_header = cbfs_boot_map_optionrom(dev->vendor, dev->device);
 		mapped_vendev = map_oprom_vendev(vendev);
 	}
 
-	if (!rom_header) {
+	/* The cache already looked for both names in CBFS. */
+	cached = pci_rom_cache_lookup(dev, &rom_header) == 0;
+
+	if (!cached) {
+		if (CONFIG(CHECK_REV_IN_OPROM_NAME))
+			rom_header = cbfs_boot_map_optionrom_revision(dev->vendor,
+								      dev->device, rev);
+		else
+			rom_header = cbfs_boot_map_optionrom(dev->vendor, dev->device);
+	}
+
+	if (!rom_header && !cached) {
 		if (CONFIG(CHECK_REV_IN_OPROM_NAME) &&
 				(vendev != mapped_vendev || rev != mapped_rev)) {
 			rom_header = cbfs_boot_map_optionrom_revision(
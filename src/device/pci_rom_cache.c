@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <acpi/acpi.h>
+#include <bootstate.h>
+#include <cbfs.h>
+#include <cbmem.h>
+#include <commonlib/endian.h>
+#include <console/console.h>
+#include <device/device.h>
+#include <device/pci.h>
+#include <device/pci_ids.h>
+#include <device/pci_ops.h>
+#include <device/pci_rom.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Option ROMs of all enabled display devices are located with a single pass over CBFS once
+ * enumeration is done, decompressed if necessary and kept in CBMEM. pci_rom_probe() serves
+ * the images from there, so the CBFS scans and flash reads no longer happen one device at
+ * a time in the middle of BS_DEV_INIT. Every image has a second slot that holds the VBIOS
+ * shadow as it looks after the option ROM ran. Since CBMEM survives S3 suspend, the cache
+ * is reused as is on resume.
+ */
+
+#define PCI_ROM_CACHE_MAX	4
+#define PCI_ROM_NAME_LEN	20
+
+/* The image is in CBFS but couldn't be cached, pci_rom_probe() has to load it itself. */
+#define PCI_ROM_CACHE_LOAD_FAILED	(1 << 0)
+
+struct pci_rom_cache_entry {
+	u16 vendor;
+	u16 device;
+	u8 rev;
+	u8 flags;
+	u8 reserved[2];
+	u32 rom_offset;		/* Offset of the image from the start of the cache */
+	u32 rom_size;		/* 0 if the device has no option ROM in CBFS */
+	u32 shadow_offset;
+	u32 shadow_size;	/* 0 until the option ROM was run */
+};
+
+struct pci_rom_cache {
+	u32 num_entries;
+	u32 reserved;
+	struct pci_rom_cache_entry entries[PCI_ROM_CACHE_MAX];
+};
+
+static struct pci_rom_cache *cache;
+
+static bool is_display_dev(const struct device *dev)
+{
+	return dev->enabled && dev->path.type == DEVICE_PATH_PCI &&
+	       (dev->class >> 16) == PCI_BASE_CLASS_DISPLAY;
+}
+
+static void optionrom_names(const struct device *dev, u8 rev, char *name, char *mapped_name)
+{
+	u32 vendev = (dev->vendor << 16) | dev->device;
+	u32 mapped_vendev = vendev;
+	u8 mapped_rev = rev;
+
+	/* Same names and order as in pci_rom_probe(). */
+	if (CONFIG(CHECK_REV_IN_OPROM_NAME)) {
+		map_oprom_vendev_rev(&mapped_vendev, &mapped_rev);
+		snprintf(name, PCI_ROM_NAME_LEN, "pci%04x,%04x,%02x.rom",
+			 dev->vendor, dev->device, rev);
+		snprintf(mapped_name, PCI_ROM_NAME_LEN, "pci%04x,%04x,%02x.rom",
+			 mapped_vendev >> 16, mapped_vendev & 0xffff, mapped_rev);
+	} else {
+		mapped_vendev = map_oprom_vendev(vendev);
+		snprintf(name, PCI_ROM_NAME_LEN, "pci%04x,%04x.rom",
+			 dev->vendor, dev->device);
+		snprintf(mapped_name, PCI_ROM_NAME_LEN, "pci%04x,%04x.rom",
+			 mapped_vendev >> 16, mapped_vendev & 0xffff);
+	}
+}
+
+static struct pci_rom_cache_entry *cache_entry(const struct device *dev)
+{
+	struct pci_rom_cache_entry *e;
+	u8 rev;
+
+	if (!cache)
+		return NULL;
+
+	rev = pci_read_config8(dev, PCI_REVISION_ID);
+
+	for (e = cache->entries; e < cache->entries + cache->num_entries; e++) {
+		if (e->vendor == dev->vendor && e->device == dev->device && e->rev == rev)
+			return e;
+	}
+
+	return NULL;
+}
+
+static void pci_rom_cache_fill(void *unused)
+{
+	char names[PCI_ROM_CACHE_MAX * 2][PCI_ROM_NAME_LEN];
+	const char *name_ptrs[PCI_ROM_CACHE_MAX * 2];
+	struct cbfsf fh[PCI_ROM_CACHE_MAX * 2];
+	bool found[PCI_ROM_CACHE_MAX * 2];
+	struct pci_rom_cache_entry entries[PCI_ROM_CACHE_MAX];
+	struct cbfsf *file[PCI_ROM_CACHE_MAX] = { NULL };
+	u32 algo[PCI_ROM_CACHE_MAX];
+	size_t i, num = 0, total = 0, size;
+	struct device *dev;
+
+	if (acpi_is_wakeup_s3()) {
+		cache = cbmem_find(CBMEM_ID_PCI_ROM_CACHE);
+		return;
+	}
+
+	memset(entries, 0, sizeof(entries));
+
+	for (dev = all_devices; dev && num < PCI_ROM_CACHE_MAX; dev = dev->next) {
+		if (!is_display_dev(dev))
+			continue;
+
+		entries[num].vendor = dev->vendor;
+		entries[num].device = dev->device;
+		entries[num].rev = pci_read_config8(dev, PCI_REVISION_ID);
+
+		optionrom_names(dev, entries[num].rev, names[2 * num], names[2 * num + 1]);
+		name_ptrs[2 * num] = names[2 * num];
+		/* Don't look for the same file twice. */
+		if (strcmp(names[2 * num], names[2 * num + 1]))
+			name_ptrs[2 * num + 1] = names[2 * num + 1];
+		else
+			name_ptrs[2 * num + 1] = NULL;
+		num++;
+	}
+
+	if (!num)
+		return;
+
+	if (cbfs_boot_locate_multiple(fh, name_ptrs, found, 2 * num, CBFS_TYPE_OPTIONROM))
+		return;
+
+	for (i = 0; i < num; i++) {
+		if (found[2 * i])
+			file[i] = &fh[2 * i];
+		else if (found[2 * i + 1])
+			file[i] = &fh[2 * i + 1];
+		else
+			continue;
+
+		if (cbfsf_decompression_info(file[i], &algo[i], &size) < 0 || !size) {
+			entries[i].flags |= PCI_ROM_CACHE_LOAD_FAILED;
+			file[i] = NULL;
+			continue;
+		}
+
+		/* Reserve the same amount of space for the shadow of the image. */
+		size = ALIGN_UP(size, 16);
+		entries[i].rom_size = size;
+		total += 2 * size;
+	}
+
+	cache = cbmem_add(CBMEM_ID_PCI_ROM_CACHE, sizeof(*cache) + total);
+	if (!cache) {
+		printk(BIOS_ERR, "PCI ROM: Failed to allocate cache\n");
+		return;
+	}
+
+	memset(cache, 0, sizeof(*cache));
+	total = sizeof(*cache);
+
+	for (i = 0; i < num; i++) {
+		struct pci_rom_cache_entry *e = &cache->entries[cache->num_entries++];
+
+		*e = entries[i];
+		if (!file[i])
+			continue;
+
+		e->rom_offset = total;
+		e->shadow_offset = total + e->rom_size;
+		total += 2 * e->rom_size;
+
+		size = cbfs_load_and_decompress(&file[i]->data, 0,
+						region_device_sz(&file[i]->data),
+						(u8 *)cache + e->rom_offset, e->rom_size, algo[i]);
+		if (!size) {
+			printk(BIOS_ERR, "PCI ROM: Failed to load %s\n",
+			       found[2 * i] ? names[2 * i] : names[2 * i + 1]);
+			e->rom_size = 0;
+			e->flags |= PCI_ROM_CACHE_LOAD_FAILED;
+		}
+	}
+
+	printk(BIOS_DEBUG, "PCI ROM: Cached option ROMs of %u display devices\n",
+	       cache->num_entries);
+}
+
+BOOT_STATE_INIT_ENTRY(BS_DEV_ENUMERATE, BS_ON_EXIT, pci_rom_cache_fill, NULL);
+
+int pci_rom_cache_lookup(const struct device *dev, struct rom_header **rom)
+{
+	struct pci_rom_cache_entry *e = cache_entry(dev);
+
+	if (!e || (e->flags & PCI_ROM_CACHE_LOAD_FAILED))
+		return -1;
+
+	*rom = e->rom_size ? (struct rom_header *)((u8 *)cache + e->rom_offset) : NULL;
+	return 0;
+}
+
+void pci_rom_cache_save_shadow(const struct device *dev, const struct rom_header *shadow)
+{
+	struct pci_rom_cache_entry *e = cache_entry(dev);
+	size_t size = shadow->size * 512;
+
+	if (!e || !e->rom_size)
+		return;
+
+	if (read_le16(&shadow->signature) != PCI_ROM_HDR || size > e->rom_size) {
+		printk(BIOS_DEBUG, "PCI ROM: Not caching VBIOS shadow of %s\n", dev_path(dev));
+		e->shadow_size = 0;
+		return;
+	}
+
+	memcpy((u8 *)cache + e->shadow_offset, shadow, size);
+	e->shadow_size = size;
+}
+
+void pci_rom_cache_restore_shadow(const struct device *dev)
+{
+	struct pci_rom_cache_entry *e = cache_entry(dev);
+
+	if (!e || !e->shadow_size)
+		return;
+
+	printk(BIOS_DEBUG, "PCI ROM: Restoring VBIOS shadow of %s\n", dev_path(dev));
+	memcpy((void *)PCI_VGA_RAM_IMAGE_START, (u8 *)cache + e->shadow_offset, e->shadow_size);
+}
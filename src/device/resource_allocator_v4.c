@@ -34,6 +34,25 @@ static bool dev_has_children(const struct device *dev)
 	return bus && bus->children;
 }
 
+/*
+ * With RESOURCE_ALLOCATOR_V4_PACK, prefetchable resources that can be decoded above 4G are
+ * placed there. This keeps the space they would otherwise take away from the MMIO window
+ * below 4G. For bridge windows the limit already reflects the tightest constraint of all
+ * downstream resources, so only windows where every child is 64-bit capable qualify.
+ */
+static bool prefer_above_4g(const struct resource *res)
+{
+	const resource_t limit_4g = 0xffffffff;
+
+	if (!CONFIG(RESOURCE_ALLOCATOR_V4_PACK))
+		return false;
+
+	if (!(res->flags & IORESOURCE_MEM) || !(res->flags & IORESOURCE_PREFETCH))
+		return false;
+
+	return res->size && (res->limit > limit_4g);
+}
+
 #define res_printk(depth, str, ...)	printk(BIOS_DEBUG, "%*c"str, depth, ' ', __VA_ARGS__)
 
 /*
@@ -139,6 +158,9 @@ static void update_bridge_resource(const struct device *bridge, struct resource
 	 */
 	bridge_res->size = round(base, bridge_res->gran);
 
+	if (prefer_above_4g(bridge_res))
+		bridge_res->flags |= IORESOURCE_ABOVE_4G;
+
 	res_printk(print_depth, "%s %s: size: %llx align: %d gran: %d limit: %llx done\n",
 	       dev_path(bridge), resource2str(bridge_res), bridge_res->size,
 	       bridge_res->align, bridge_res->gran, bridge_res->limit);
@@ -181,6 +203,24 @@ static void compute_bridge_resources(const struct device *bridge, unsigned long
 	}
 }
 
+/*
+ * Resources of devices sitting directly on the domain are not covered by a bridge window and
+ * need to be marked individually. This is only done for non-bridge resources, bridge windows
+ * are taken care of in update_bridge_resource().
+ */
+static void mark_device_above_4g(const struct device *dev)
+{
+	struct resource *res;
+
+	for (res = dev->resource_list; res; res = res->next) {
+		if (res->flags & (IORESOURCE_FIXED | IORESOURCE_BRIDGE))
+			continue;
+
+		if (prefer_above_4g(res))
+			res->flags |= IORESOURCE_ABOVE_4G;
+	}
+}
+
 /*
  * During pass 1, resource allocator walks down the entire sub-tree of a domain. It gathers
  * resource requirements for every downstream bridge by looking at the resource requests of its
@@ -204,6 +244,8 @@ static void compute_domain_resources(const struct device *domain)
 
 	for (child = domain->link_list->children; child; child = child->sibling) {
 
+		mark_device_above_4g(child);
+
 		/* Skip if this is not a bridge or has no children under it. */
 		if (!dev_has_children(child))
 			continue;
@@ -363,7 +405,8 @@ static void print_resource_ranges(const struct device *dev, const struct memrang
  * resource window.
  */
 static void allocate_child_resources(struct bus *bus, struct memranges *ranges,
-				     unsigned long type_mask, unsigned long type_match)
+				     unsigned long type_mask, unsigned long type_match,
+				     bool from_top)
 {
 	struct resource *resource = NULL;
 	const struct device *dev;
@@ -374,7 +417,7 @@ static void allocate_child_resources(struct bus *bus, struct memranges *ranges,
 			continue;
 
 		if (memranges_steal(ranges, resource->limit, resource->size, resource->align,
-				    type_match, &resource->base) == false) {
+				    type_match, &resource->base, from_top) == false) {
 			printk(BIOS_ERR, "  ERROR: Resource didn't fit!!! ");
 			printk(BIOS_DEBUG, "  %s %02lx *  size: 0x%llx limit: %llx %s\n",
 			       dev_path(dev), resource->index,
@@ -527,7 +570,7 @@ static void allocate_bridge_resources(const struct device *bridge)
 		type_match = res->flags & type_mask;
 
 		setup_resource_ranges(bridge, res, type_match, &ranges);
-		allocate_child_resources(bus, &ranges, type_mask, type_match);
+		allocate_child_resources(bus, &ranges, type_mask, type_match, false);
 		cleanup_resource_ranges(bridge, &ranges, res);
 	}
 
@@ -555,6 +598,86 @@ static const struct resource *find_domain_resource(const struct device *domain,
 	return NULL;
 }
 
+/*
+ * Resources that were only moved above 4G by preference fall back to the window below 4G if
+ * there is no room above 4G (e.g. the domain does not decode any memory above 4G).
+ */
+static void demote_unassigned_above_4g(const struct bus *bus)
+{
+	const struct device *child;
+	struct resource *res;
+
+	for (child = bus->children; child; child = child->sibling) {
+		for (res = child->resource_list; res; res = res->next) {
+			if ((res->flags & (IORESOURCE_ABOVE_4G | IORESOURCE_ASSIGNED |
+					   IORESOURCE_FIXED)) != IORESOURCE_ABOVE_4G)
+				continue;
+
+			if (!(res->flags & IORESOURCE_MEM) || !res->size)
+				continue;
+
+			printk(BIOS_DEBUG, "  %s %02lx * no room above 4G, retrying below 4G\n",
+			       dev_path(child), res->index);
+			res->flags &= ~IORESOURCE_ABOVE_4G;
+		}
+	}
+}
+
+static void print_mem_packing_report(const struct device *domain, const struct resource *res)
+{
+	const resource_t limit_4g = 0xffffffff;
+	resource_t lowest = limit_4g + 1;
+	resource_t below_4g = 0;
+	const struct device *child;
+	const struct resource *child_res;
+
+	for (child = domain->link_list->children; child; child = child->sibling) {
+		for (child_res = child->resource_list; child_res; child_res = child_res->next) {
+			if (!(child_res->flags & IORESOURCE_MEM) || !child_res->size)
+				continue;
+
+			if ((child_res->flags & (IORESOURCE_ASSIGNED | IORESOURCE_FIXED)) !=
+			    IORESOURCE_ASSIGNED)
+				continue;
+
+			if (child_res->base > limit_4g)
+				continue;
+
+			below_4g += child_res->size;
+			lowest = MIN(lowest, child_res->base);
+		}
+	}
+
+	printk(BIOS_INFO, " %s: packed 0x%llx bytes below 4G starting at 0x%llx, "
+	       "0x%llx bytes free at the bottom of the window\n", dev_path(domain), below_4g,
+	       lowest, lowest > res->base ? lowest - res->base : 0);
+}
+
+/*
+ * Packing policy for the domain MEM window. Allocation above 4G goes first so that anything
+ * that does not fit there can still fall back to the window below 4G. Below 4G, resources are
+ * allocated top-down in descending order of alignment and size. Every resource is placed in
+ * the highest free hole it fits in, so smaller resources fill the alignment gaps left by the
+ * bigger ones and the unused space stays in one piece at the bottom of the window, next to
+ * DRAM. This is where the platform can shrink the MMIO hole.
+ */
+static void allocate_domain_mem_packed(const struct device *domain, struct memranges *ranges)
+{
+	const struct resource *res = find_domain_resource(domain, IORESOURCE_MEM);
+
+	allocate_child_resources(domain->link_list, ranges,
+				 IORESOURCE_TYPE_MASK | IORESOURCE_ABOVE_4G,
+				 IORESOURCE_MEM | IORESOURCE_ABOVE_4G, false);
+
+	demote_unassigned_above_4g(domain->link_list);
+
+	allocate_child_resources(domain->link_list, ranges,
+				 IORESOURCE_TYPE_MASK | IORESOURCE_ABOVE_4G,
+				 IORESOURCE_MEM, true);
+
+	print_mem_packing_report(domain, res);
+}
+
 /*
  * Pass 2 of resource allocator begins at the domain level. Every domain has two types of
  * resources - io and mem. For each of these resources, this function creates a list of memory
@@ -577,7 +700,7 @@ static void allocate_domain_resources(const struct device *domain)
 	if (res) {
 		setup_resource_ranges(domain, res, IORESOURCE_IO, &ranges);
 		allocate_child_resources(domain->link_list, &ranges, IORESOURCE_TYPE_MASK,
-					 IORESOURCE_IO);
+					 IORESOURCE_IO, false);
 		cleanup_resource_ranges(domain, &ranges, res);
 	}
 
@@ -599,12 +722,16 @@ static void allocate_domain_resources(const struct device *domain)
 	res = find_domain_resource(domain, IORESOURCE_MEM);
 	if (res) {
 		setup_resource_ranges(domain, res, IORESOURCE_MEM, &ranges);
-		allocate_child_resources(domain->link_list, &ranges,
-					 IORESOURCE_TYPE_MASK | IORESOURCE_ABOVE_4G,
-					 IORESOURCE_MEM);
-		allocate_child_resources(domain->link_list, &ranges,
-					 IORESOURCE_TYPE_MASK | IORESOURCE_ABOVE_4G,
-					 IORESOURCE_MEM | IORESOURCE_ABOVE_4G);
+		if (CONFIG(RESOURCE_ALLOCATOR_V4_PACK)) {
+			allocate_domain_mem_packed(domain, &ranges);
+		} else {
+			allocate_child_resources(domain->link_list, &ranges,
+						 IORESOURCE_TYPE_MASK | IORESOURCE_ABOVE_4G,
+						 IORESOURCE_MEM, false);
+			allocate_child_resources(domain->link_list, &ranges,
+						 IORESOURCE_TYPE_MASK | IORESOURCE_ABOVE_4G,
+						 IORESOURCE_MEM | IORESOURCE_ABOVE_4G, false);
+		}
 		cleanup_resource_ranges(domain, &ranges, res);
 	}
 
@@ -892,6 +892,8 @@ unsigned long fw_cfg_acpi_tables(unsigned long start);
 
 /* These are implemented by the target port or north/southbridge. */
 unsigned long write_acpi_tables(unsigned long addr);
+/* RSDP of the tables written by the last write_acpi_tables() call, NULL if there is none */
+acpi_rsdp_t *acpi_get_rsdp(void);
 unsigned long acpi_fill_madt(unsigned long current);
 unsigned long acpi_fill_mcfg(unsigned long current);
 unsigned long acpi_fill_ivrs_ioapic(acpi_ivrs_t *ivrs, unsigned long current);
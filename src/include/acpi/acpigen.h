@@ -3,6 +3,7 @@
 #ifndef __ACPI_ACPIGEN_H__
 #define __ACPI_ACPIGEN_H__
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <acpi/acpi.h>
@@ -282,6 +283,12 @@ void acpigen_write_len_f(void);
 void acpigen_pop_len(void);
 void acpigen_set_current(char *curr);
 char *acpigen_get_current(void);
+/*
+ * Enable the AML size optimizations described for ACPIGEN_OPTIMIZE, which also sets the
+ * default. The saved bytes are counted from the last acpigen_set_current().
+ */
+void acpigen_set_optimize(bool enable);
+size_t acpigen_get_saved(void);
 char *acpigen_write_package(int nr_el);
 void acpigen_write_zero(void);
 void acpigen_write_one(void);
@@ -5,6 +5,7 @@
 
 #include <commonlib/cbfs.h>
 #include <program_loading.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -18,6 +19,11 @@ void *cbfs_boot_map_optionrom(uint16_t vendor, uint16_t device);
 void *cbfs_boot_map_optionrom_revision(uint16_t vendor, uint16_t device, uint8_t rev);
 /* Locate file by name and optional type. Return 0 on success. < 0 on error. */
 int cbfs_boot_locate(struct cbfsf *fh, const char *name, uint32_t *type);
+/* Locate several files by name and optional type in a single pass over the boot device.
+ * found[i] tells if names[i] was located into fh[i], NULL names are skipped. Return 0 on
+ * success, < 0 on error. */
+int cbfs_boot_locate_multiple(struct cbfsf fh[], const char *const names[], bool found[],
+			      size_t count, uint32_t type);
 /* Map file into memory leaking the mapping. Only should be used when
  * leaking mappings are a no-op. Returns NULL on error, else returns
  * the mapping and sets the size of the file. */
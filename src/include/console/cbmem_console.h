@@ -2,10 +2,12 @@
 #ifndef _CONSOLE_CBMEM_CONSOLE_H_
 #define _CONSOLE_CBMEM_CONSOLE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 void cbmemc_init(void);
 void cbmemc_tx_byte(unsigned char data);
+void cbmemc_write(const void *buf, size_t len);
 
 #define __CBMEM_CONSOLE_ENABLE__	(CONFIG(CONSOLE_CBMEM) && \
 	(ENV_RAMSTAGE || ENV_SEPARATE_VERSTAGE || ENV_POSTCAR  || \
@@ -14,9 +16,11 @@ void cbmemc_tx_byte(unsigned char data);
 #if __CBMEM_CONSOLE_ENABLE__
 static inline void __cbmemc_init(void)	{ cbmemc_init(); }
 static inline void __cbmemc_tx_byte(u8 data)	{ cbmemc_tx_byte(data); }
+static inline void __cbmemc_write(const void *buf, size_t len) { cbmemc_write(buf, len); }
 #else
 static inline void __cbmemc_init(void)	{}
 static inline void __cbmemc_tx_byte(u8 data)	{}
+static inline void __cbmemc_write(const void *buf, size_t len) {}
 #endif
 
 void cbmem_dump_console(void);
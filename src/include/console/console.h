@@ -71,6 +71,16 @@ static inline long console_time_get_and_reset(void) { return 0; }
 static inline void console_time_report(void) {}
 #endif
 
+#if CONFIG(CONSOLE_DEFERRED_DRAIN) && ENV_RAMSTAGE
+/* Write out the deferred console output. */
+void console_drain(void);
+/* Write out a bit of the deferred console output, for use while waiting. */
+void console_drain_idle(void);
+#else
+static inline void console_drain(void) {}
+static inline void console_drain_idle(void) {}
+#endif
+
 int do_printk(int msg_level, const char *fmt, ...)
 	__attribute__((format(printf, 2, 3)));
 
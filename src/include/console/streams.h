@@ -10,6 +10,23 @@ void console_hw_init(void);
 void console_tx_byte(unsigned char byte);
 void console_tx_flush(void);
 
+/*
+ * With CONSOLE_DEFERRED_DRAIN, ramstage output to consoles other than CBMEM
+ * goes through a buffer that is drained later. The functions have to be
+ * called with console_lock held.
+ */
+#define CONSOLE_DEFERRED (CONFIG(CONSOLE_DEFERRED_DRAIN) && ENV_RAMSTAGE)
+
+/* Send a byte to all consoles except CBMEM. */
+void console_tx_byte_slow(unsigned char byte);
+/* Add output to the buffer, draining old output if it doesn't fit. */
+void console_defer(const void *buf, size_t len);
+/* console_defer() for a single byte, takes console_lock itself. */
+void console_defer_byte(unsigned char byte);
+/* Drain up to max bytes of the buffer, returns the number of bytes drained. */
+size_t console_drain_bytes(size_t max);
+size_t console_pending(void);
+
 /*
  * Write number_of_bytes data bytes from buffer to the serial device.
  * If number_of_bytes is zero, wait until all serial data is output.
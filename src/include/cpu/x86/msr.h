@@ -94,6 +94,7 @@
 #define IA32_CR_SF_QOS_MASK_2           0x1892
 
 #ifndef __ASSEMBLER__
+#include <hw_access.h>
 #include <types.h>
 
 typedef struct msr_struct {
@@ -113,12 +114,19 @@ void soc_msr_write(unsigned int index, msr_t msr);
 /* Handle MSR references in the other source code */
 static __always_inline msr_t rdmsr(unsigned int index)
 {
-	return soc_msr_read(index);
+	uint64_t start = hw_access_start();
+	msr_t result = soc_msr_read(index);
+
+	hw_access_end(HW_ACCESS_MSR, start);
+	return result;
 }
 
 static __always_inline void wrmsr(unsigned int index, msr_t msr)
 {
+	uint64_t start = hw_access_start();
+
 	soc_msr_write(index, msr);
+	hw_access_end(HW_ACCESS_MSR, start);
 }
 #else /* CONFIG_SOC_SETS_MSRS */
 
@@ -134,22 +142,26 @@ static __always_inline void wrmsr(unsigned int index, msr_t msr)
  */
 static __always_inline msr_t rdmsr(unsigned int index)
 {
+	uint64_t start = hw_access_start();
 	msr_t result;
 	__asm__ __volatile__ (
 		"rdmsr"
 		: "=a" (result.lo), "=d" (result.hi)
 		: "c" (index)
 		);
+	hw_access_end(HW_ACCESS_MSR, start);
 	return result;
 }
 
 static __always_inline void wrmsr(unsigned int index, msr_t msr)
 {
+	uint64_t start = hw_access_start();
 	__asm__ __volatile__ (
 		"wrmsr"
 		: /* No outputs */
 		: "c" (index), "a" (msr.lo), "d" (msr.hi)
 		);
+	hw_access_end(HW_ACCESS_MSR, start);
 }
 
 #endif /* CONFIG_SOC_SETS_MSRS */
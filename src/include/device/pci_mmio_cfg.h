@@ -3,6 +3,7 @@
 #ifndef _PCI_MMIO_CFG_H
 #define _PCI_MMIO_CFG_H
 
+#include <hw_access.h>
 #include <stdint.h>
 #include <device/mmio.h>
 #include <device/pci_type.h>
@@ -109,37 +110,58 @@ uint32_t *pci_mmio_config32_addr(pci_devfn_t dev, uint16_t reg)
 static __always_inline
 uint8_t pci_s_read_config8(pci_devfn_t dev, uint16_t reg)
 {
-	return pci_mmio_read_config8(dev, reg);
+	uint64_t start = hw_access_start();
+	uint8_t value = pci_mmio_read_config8(dev, reg);
+
+	hw_access_end(HW_ACCESS_PCI_CFG, start);
+	return value;
 }
 
 static __always_inline
 uint16_t pci_s_read_config16(pci_devfn_t dev, uint16_t reg)
 {
-	return pci_mmio_read_config16(dev, reg);
+	uint64_t start = hw_access_start();
+	uint16_t value = pci_mmio_read_config16(dev, reg);
+
+	hw_access_end(HW_ACCESS_PCI_CFG, start);
+	return value;
 }
 
 static __always_inline
 uint32_t pci_s_read_config32(pci_devfn_t dev, uint16_t reg)
 {
-	return pci_mmio_read_config32(dev, reg);
+	uint64_t start = hw_access_start();
+	uint32_t value = pci_mmio_read_config32(dev, reg);
+
+	hw_access_end(HW_ACCESS_PCI_CFG, start);
+	return value;
 }
 
 static __always_inline
 void pci_s_write_config8(pci_devfn_t dev, uint16_t reg, uint8_t value)
 {
+	uint64_t start = hw_access_start();
+
 	pci_mmio_write_config8(dev, reg, value);
+	hw_access_end(HW_ACCESS_PCI_CFG, start);
 }
 
 static __always_inline
 void pci_s_write_config16(pci_devfn_t dev, uint16_t reg, uint16_t value)
 {
+	uint64_t start = hw_access_start();
+
 	pci_mmio_write_config16(dev, reg, value);
+	hw_access_end(HW_ACCESS_PCI_CFG, start);
 }
 
 static __always_inline
 void pci_s_write_config32(pci_devfn_t dev, uint16_t reg, uint32_t value)
 {
+	uint64_t start = hw_access_start();
+
 	pci_mmio_write_config32(dev, reg, value);
+	hw_access_end(HW_ACCESS_PCI_CFG, start);
 }
 
 #endif
@@ -3,10 +3,12 @@
 #ifndef PCI_OPS_H
 #define PCI_OPS_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <device/device.h>
 #include <device/pci_type.h>
 #include <arch/pci_ops.h>
+#include <hw_access.h>
 
 void __noreturn pcidev_die(void);
 
@@ -42,39 +44,59 @@ static __always_inline pci_devfn_t pcidev_assert(const struct device *dev)
 #define pci_write_config32 pci_s_write_config32
 #else
 
+/*
+ * With HW_ACCESS_COUNTERS, config accesses through the struct device based accessors below
+ * are also accounted to their device. The devices with the most config cycles are reported
+ * once device initialization is done.
+ */
+void pci_cfg_cycles_account(const struct device *dev, bool write);
+
+static __always_inline
+void pci_cfg_cycle(const struct device *dev, bool write)
+{
+	if (ENV_HW_ACCESS_COUNTERS)
+		pci_cfg_cycles_account(dev, write);
+}
+
 static __always_inline
 u8 pci_read_config8(const struct device *dev, u16 reg)
 {
+	pci_cfg_cycle(dev, false);
 	return pci_s_read_config8(PCI_BDF(dev), reg);
 }
 
 static __always_inline
 u16 pci_read_config16(const struct device *dev, u16 reg)
 {
+	pci_cfg_cycle(dev, false);
 	return pci_s_read_config16(PCI_BDF(dev), reg);
 }
 
 static __always_inline
 u32 pci_read_config32(const struct device *dev, u16 reg)
 {
+	pci_cfg_cycle(dev, false);
 	return pci_s_read_config32(PCI_BDF(dev), reg);
 }
 
 static __always_inline
 void pci_write_config8(const struct device *dev, u16 reg, u8 val)
 {
+	pci_cfg_cycle(dev, true);
 	pci_s_write_config8(PCI_BDF(dev), reg, val);
 }
 
 static __always_inline
 void pci_write_config16(const struct device *dev, u16 reg, u16 val)
 {
+	pci_cfg_cycle(dev, true);
 	pci_s_write_config16(PCI_BDF(dev), reg, val);
 }
 
 static __always_inline
 void pci_write_config32(const struct device *dev, u16 reg, u32 val)
 {
+	pci_cfg_cycle(dev, true);
 	pci_s_write_config32(PCI_BDF(dev), reg, val);
 }
 
@@ -50,4 +50,19 @@ void map_oprom_vendev_rev(u32 *vendev, u8 *rev);
 u32 map_oprom_vendev(u32 vendev);
 
 int verified_boot_should_run_oprom(struct rom_header *rom_header);
+
+#if CONFIG(PCI_OPTION_ROM_CACHE)
+/* Returns 0 and the cached image, or NULL if there is none in CBFS, if |dev| is cached. */
+int pci_rom_cache_lookup(const struct device *dev, struct rom_header **rom);
+void pci_rom_cache_save_shadow(const struct device *dev, const struct rom_header *shadow);
+void pci_rom_cache_restore_shadow(const struct device *dev);
+#else
+static inline int pci_rom_cache_lookup(const struct device *dev, struct rom_header **rom)
+{
+	return -1;
+}
+static inline void pci_rom_cache_save_shadow(const struct device *dev,
+					     const struct rom_header *shadow) {}
+static inline void pci_rom_cache_restore_shadow(const struct device *dev) {}
+#endif
 #endif
@@ -75,6 +75,8 @@ struct device_tree_reserve_map_entry
 	struct list_node list_node;
 };
 
+struct device_tree_index;
+
 struct device_tree
 {
 	const void *header;
@@ -84,6 +86,9 @@ struct device_tree
 	struct list_node reserve_map;
 
 	struct device_tree_node *root;
+
+	/* Built on demand by the lookup functions. */
+	struct device_tree_index *index;
 };
 
 /*
@@ -100,6 +105,34 @@ int fdt_node_name(const void *blob, uint32_t offset, const char **name);
 void fdt_print_node(const void *blob, uint32_t offset);
 int fdt_skip_node(const void *blob, uint32_t offset);
 
+/*
+ * In-place editing of a flattened device tree, for small changes that don't warrant
+ * unflattening it. fdt_open_into() copies a blob into a buffer with room to grow, the
+ * functions below change it there and fdt_pack() returns the final size. Node offsets are
+ * only valid until the next change of the tree. Functions returning an int return 0 on
+ * success and -1 if the buffer is too small, offsets are 0 if the node doesn't exist.
+ */
+int fdt_open_into(const void *blob, void *buf, uint32_t bufsize);
+uint32_t fdt_pack(void *blob);
+int fdt_add_reserve_map_entry(void *blob, uint64_t start, uint64_t size);
+uint32_t fdt_first_subnode(const void *blob, uint32_t node);
+uint32_t fdt_next_subnode(const void *blob, uint32_t node);
+/* Look up or create a node through its absolute path, reading the cell sizes on the way. */
+uint32_t fdt_find_node_by_path(void *blob, const char *path, u32 *addrcp, u32 *sizecp,
+			       int create);
+int fdt_delete_node(void *blob, uint32_t node);
+/* Returns the offset of the property or 0 if the node doesn't have it. */
+uint32_t fdt_find_prop(const void *blob, uint32_t node, const char *name,
+		       struct fdt_property *prop);
+/* Add different kinds of properties to a node, or update existing ones. */
+int fdt_add_bin_prop(void *blob, uint32_t node, const char *name, const void *data,
+		     size_t size);
+int fdt_add_string_prop(void *blob, uint32_t node, const char *name, const char *str);
+int fdt_add_u32_prop(void *blob, uint32_t node, const char *name, u32 val);
+int fdt_add_u64_prop(void *blob, uint32_t node, const char *name, u64 val);
+int fdt_add_reg_prop(void *blob, uint32_t node, u64 *addrs, u64 *sizes, int count,
+		     u32 addr_cells, u32 size_cells);
+
 /* Read a flattened device tree into a hierarchical structure which refers to
    the contents of the flattened tree in place. Modifying the flat tree
    invalidates the unflattened one. */
@@ -121,7 +154,8 @@ void dt_read_cell_props(const struct device_tree_node *node, u32 *addrcp,
    represented as an array of strings. */
 struct device_tree_node *dt_find_node(struct device_tree_node *parent, const char **path,
 			     u32 *addrcp, u32 *sizecp, int create);
-struct device_tree_node *dt_find_node_by_phandle(struct device_tree_node *root,
+/* Look up a node in the tree through its phandle. */
+struct device_tree_node *dt_find_node_by_phandle(struct device_tree *tree,
 						 uint32_t phandle);
 /* Look up or create a node in the tree, through its path
    represented as a string of '/' separated node names. */
@@ -142,6 +176,9 @@ struct device_tree_node *dt_find_prop_value(struct device_tree_node *parent, con
 				   void *data, size_t size);
 /* Write src into *dest as a 'length'-byte big-endian integer. */
 void dt_write_int(u8 *dest, u64 src, size_t length);
+/* Code that removes or moves nodes has to call this afterwards, to invalidate
+   the lookup indexes of the trees. */
+void dt_nodes_changed(void);
 /* Delete a property */
 void dt_delete_prop(struct device_tree_node *node, const char *name);
 /* Add different kinds of properties to a node, or update existing ones. */
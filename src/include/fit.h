@@ -42,6 +42,8 @@ struct fit_overlay_chain {
  * Updates the cmdline in the devicetree.
  */
 void fit_update_chosen(struct device_tree *tree, const char *cmd_line);
+/* Same as above for a flat devicetree opened with fdt_open_into(). */
+int fit_update_chosen_flat(void *blob, const char *cmd_line);
 
 /*
  * Add a compat string to the list of supported board ids.
@@ -55,6 +57,7 @@ void fit_add_compat_string(const char *str);
  * Updates the memory section in the devicetree.
  */
 void fit_update_memory(struct device_tree *tree);
+int fit_update_memory_flat(void *blob);
 
 /*
  * Do architecture specific payload placements and fixups.
@@ -82,5 +85,6 @@ struct fit_config_node *fit_load(void *fit);
 
 void fit_add_ramdisk(struct device_tree *tree, void *ramdisk_addr,
 		     size_t ramdisk_size);
+int fit_add_ramdisk_flat(void *blob, void *ramdisk_addr, size_t ramdisk_size);
 
 #endif /* __LIB_FIT_H__ */
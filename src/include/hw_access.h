@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef __HW_ACCESS_H__
+#define __HW_ACCESS_H__
+
+#include <stdint.h>
+#include <commonlib/hw_access_serialized.h>
+
+/*
+ * Optional per boot state accounting of PCI config, MMIO, port I/O and MSR accesses done in
+ * ramstage. The architecture accessors bracket every access with hw_access_start() and
+ * hw_access_end(). Both compile to nothing unless HW_ACCESS_COUNTERS is selected.
+ */
+#define ENV_HW_ACCESS_COUNTERS	(CONFIG(HW_ACCESS_COUNTERS) && ENV_RAMSTAGE)
+
+#if ENV_HW_ACCESS_COUNTERS
+uint64_t hw_access_timestamp(void);
+void hw_access_account(enum hw_access_type type, uint64_t start);
+/* Report and store the counters of the boot state that just finished, then reset them. */
+void hw_access_boot_state_done(const char *name);
+#else
+static inline uint64_t hw_access_timestamp(void) { return 0; }
+static inline void hw_access_account(enum hw_access_type type, uint64_t start) {}
+static inline void hw_access_boot_state_done(const char *name) {}
+#endif
+
+static __always_inline uint64_t hw_access_start(void)
+{
+	if (!ENV_HW_ACCESS_COUNTERS)
+		return 0;
+
+	return hw_access_timestamp();
+}
+
+static __always_inline void hw_access_end(enum hw_access_type type, uint64_t start)
+{
+	if (ENV_HW_ACCESS_COUNTERS)
+		hw_access_account(type, start);
+}
+
+#endif /* __HW_ACCESS_H__ */
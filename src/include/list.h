@@ -4,6 +4,10 @@
 #ifndef __LIST_H__
 #define __LIST_H__
 
+#include <commonlib/helpers.h>
+#include <stddef.h>
+#include <stdint.h>
+
 struct list_node {
 	struct list_node *next;
 	struct list_node *prev;
@@ -18,7 +22,7 @@ void list_insert_before(struct list_node *node, struct list_node *before);
 
 #define list_for_each(ptr, head, member)                                \
 	for ((ptr) = container_of((head).next, typeof(*(ptr)), member); \
-		&((ptr)->member);                                       \
+		(uintptr_t)(ptr) + offsetof(typeof(*(ptr)), member);      \
 		(ptr) = container_of((ptr)->member.next,                \
 			typeof(*(ptr)), member))
 
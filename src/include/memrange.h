@@ -165,11 +165,13 @@ struct range_entry *memranges_next_entry(struct memranges *ranges,
  * size  = Requested size for the stolen memory.
  * align = Required alignment(log 2) for the starting address of the stolen memory.
  * tag   = Use a range that matches the given tag.
+ * from_top = Steal the highest suitable address range instead of the lowest one.
  *
  * If the constraints can be satisfied, this function creates a hole in the memrange,
  * writes the base address of that hole to stolen_base and returns true. Otherwise it returns
  * false. */
 bool memranges_steal(struct memranges *ranges, resource_t limit, resource_t size,
-			unsigned char align, unsigned long tag, resource_t *stolen_base);
+			unsigned char align, unsigned long tag, resource_t *stolen_base,
+			bool from_top);
 
 #endif /* MEMRANGE_H_ */
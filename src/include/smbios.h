@@ -7,8 +7,12 @@
 #include <memory_info.h>
 
 unsigned long smbios_write_tables(unsigned long start);
+/* Move tables written by smbios_write_tables() and return their new end. */
+unsigned long smbios_move_tables(unsigned long start, unsigned long end, unsigned long to);
 int smbios_add_string(u8 *start, const char *str);
 int smbios_string_table_len(u8 *start);
+/* Has to be called after a string table was changed other than by smbios_add_string(). */
+void smbios_string_table_reset(void);
 
 /* Used by mainboard to add an on-board device */
 enum misc_slot_type;
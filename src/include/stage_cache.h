@@ -41,11 +41,16 @@ static inline void stage_cache_get_raw(int stage_id, void **base, size_t *size)
 /* Fill in parameters for the external stage cache, if utilized. */
 void stage_cache_external_region(void **base, size_t *size);
 
+/* Hash of a cached stage, checked on load with CONFIG_STAGE_CACHE_VERIFY. */
+uint32_t stage_cache_hash(const void *data, size_t size);
+
 /* Metadata associated with each stage. */
 struct stage_cache {
 	uint64_t load_addr;
 	uint64_t entry_addr;
 	uint64_t arg;
+	uint32_t hash;
+	uint32_t reserved;
 };
 
 #endif /* _STAGE_CACHE_H_ */
@@ -57,6 +57,72 @@ int cbfs_boot_locate(struct cbfsf *fh, const char *name, uint32_t *type)
 	return ret;
 }
 
+/* Returns the number of names that are still not found after scanning |cbfs|. */
+static size_t cbfs_locate_multiple(const struct region_device *cbfs, struct cbfsf fh[],
+				   const char *const names[], bool found[], size_t count,
+				   uint32_t type)
+{
+	const size_t fsz = sizeof(struct cbfs_file);
+	struct cbfsf file, *prev = NULL;
+	size_t i, remaining = 0;
+	uint32_t ftype;
+	char *fname;
+
+	for (i = 0; i < count; i++)
+		if (names[i] && !found[i])
+			remaining++;
+
+	while (remaining && cbfs_for_each_file(cbfs, prev, &file) == 0) {
+		prev = &file;
+
+		fname = rdev_mmap(&file.metadata, fsz, region_device_sz(&file.metadata) - fsz);
+		if (fname == NULL)
+			break;
+
+		for (i = 0; i < count; i++) {
+			if (!names[i] || found[i] || strcmp(fname, names[i]))
+				continue;
+			if (type && (cbfsf_file_type(&file, &ftype) || ftype != type))
+				continue;
+
+			fh[i] = file;
+			found[i] = true;
+			remaining--;
+		}
+
+		rdev_munmap(&file.metadata, fname);
+	}
+
+	return remaining;
+}
+
+int cbfs_boot_locate_multiple(struct cbfsf fh[], const char *const names[], bool found[],
+			      size_t count, uint32_t type)
+{
+	struct region_device rdev;
+	size_t i;
+
+	memset(found, 0, count * sizeof(*found));
+
+	if (cbfs_boot_region_device(&rdev))
+		return -1;
+
+	if (cbfs_locate_multiple(&rdev, fh, names, found, count, type) &&
+	    CONFIG(VBOOT_ENABLE_CBFS_FALLBACK)) {
+		/* Same fallback to the RO region as in cbfs_boot_locate(). */
+		if (fmap_locate_area_as_rdev("COREBOOT", &rdev))
+			ERROR("RO region not found\n");
+		else
+			cbfs_locate_multiple(&rdev, fh, names, found, count, type);
+	}
+
+	for (i = 0; i < count; i++)
+		if (found[i] && tspi_measure_cbfs_hook(&fh[i], names[i]))
+			found[i] = false;
+
+	return 0;
+}
+
 void *cbfs_boot_map_with_leak(const char *name, uint32_t type, size_t *size)
 {
 	struct cbfsf fh;
@@ -137,6 +203,19 @@ static inline bool cbfs_lzma_enabled(void)
 	return true;
 }
 
+static inline bool cbfs_zstd_enabled(void)
+{
+	/* Only ramstage and payloads may be compressed with Zstandard. */
+	if (ENV_BOOTBLOCK || ENV_SEPARATE_VERSTAGE)
+		return false;
+	if (ENV_ROMSTAGE && CONFIG(POSTCAR_STAGE))
+		return false;
+	if ((ENV_ROMSTAGE || ENV_POSTCAR)
+	    && !CONFIG(COMPRESS_RAMSTAGE_ZSTD))
+		return false;
+	return true;
+}
+
 size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
 	size_t in_size, void *buffer, size_t buffer_size, uint32_t compression)
 {
@@ -185,6 +264,21 @@ size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
 
 		return out_size;
 
+	case CBFS_COMPRESS_ZSTD:
+		if (!cbfs_zstd_enabled())
+			return 0;
+		map = rdev_mmap(rdev, offset, in_size);
+		if (map == NULL)
+			return 0;
+
+		timestamp_add_now(TS_START_UZSTD);
+		out_size = uzstdn(map, in_size, buffer, buffer_size);
+		timestamp_add_now(TS_END_UZSTD);
+
+		rdev_munmap(rdev, map);
+
+		return out_size;
+
 	default:
 		return 0;
 	}
@@ -3,6 +3,8 @@
 #include <console/cbmem_console.h>
 #include <console/uart.h>
 #include <cbmem.h>
+#include <commonlib/helpers.h>
+#include <string.h>
 #include <symbols.h>
 
 /*
@@ -103,6 +105,32 @@ void cbmemc_tx_byte(unsigned char data)
 	current_console->cursor = flags | cursor;
 }
 
+void cbmemc_write(const void *buf, size_t len)
+{
+	const u8 *data = buf;
+	size_t chunk;
+
+	if (!current_console || !current_console->size)
+		return;
+
+	u32 flags = current_console->cursor & ~CURSOR_MASK;
+	u32 cursor = current_console->cursor & CURSOR_MASK;
+
+	while (len) {
+		chunk = MIN(len, current_console->size - cursor);
+		memcpy(current_console->body + cursor, data, chunk);
+		data += chunk;
+		len -= chunk;
+		cursor += chunk;
+		if (cursor >= current_console->size) {
+			cursor = 0;
+			flags |= OVERFLOW;
+		}
+	}
+
+	current_console->cursor = flags | cursor;
+}
+
 /*
  * Copy the current console buffer (either from the cache as RAM area or from
  * the static buffer, pointed at by src_cons_p) into the newly initialized CBMEM
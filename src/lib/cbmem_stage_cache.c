@@ -4,6 +4,7 @@
 #include <stage_cache.h>
 #include <string.h>
 #include <console/console.h>
+#include <timestamp.h>
 
 /* Stage cache uses cbmem. */
 void stage_cache_add(int stage_id, const struct prog *stage)
@@ -29,6 +30,9 @@ void stage_cache_add(int stage_id, const struct prog *stage)
 	}
 
 	memcpy(c, prog_start(stage), prog_size(stage));
+
+	if (CONFIG(STAGE_CACHE_VERIFY))
+		meta->hash = stage_cache_hash(c, prog_size(stage));
 }
 
 void stage_cache_add_raw(int stage_id, const void *base, const size_t size)
@@ -68,12 +72,15 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 	size_t size;
 	void *load_addr;
 
+	timestamp_add_now(TS_START_STAGE_CACHE_LOAD);
+
 	prog_set_entry(stage, NULL, NULL);
 
 	meta = cbmem_find(CBMEM_ID_STAGEx_META + stage_id);
 	if (meta == NULL) {
 		printk(BIOS_ERR, "Error: Can't find %x metadata in cbmem\n",
 				CBMEM_ID_STAGEx_META + stage_id);
+		timestamp_add_now(TS_END_STAGE_CACHE_LOAD);
 		return;
 	}
 
@@ -82,6 +89,7 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 	if (e == NULL) {
 		printk(BIOS_ERR, "Error: Can't find stage_cache %x in cbmem\n",
 				CBMEM_ID_STAGEx_CACHE + stage_id);
+		timestamp_add_now(TS_END_STAGE_CACHE_LOAD);
 		return;
 	}
 
@@ -91,7 +99,16 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 
 	memcpy(load_addr, c, size);
 
+	if (CONFIG(STAGE_CACHE_VERIFY) && stage_cache_hash(load_addr, size) != meta->hash) {
+		printk(BIOS_ERR, "Error: stage_cache %x is corrupted\n",
+				CBMEM_ID_STAGEx_CACHE + stage_id);
+		timestamp_add_now(TS_END_STAGE_CACHE_LOAD);
+		return;
+	}
+
 	prog_set_area(stage, load_addr, size);
 	prog_set_entry(stage, (void *)(uintptr_t)meta->entry_addr,
 			(void *)(uintptr_t)meta->arg);
+
+	timestamp_add_now(TS_END_STAGE_CACHE_LOAD);
 }
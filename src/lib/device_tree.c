@@ -7,6 +7,7 @@
 #include <ctype.h>
 #include <device_tree.h>
 #include <endian.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 #include <stddef.h>
@@ -164,12 +165,382 @@ int fdt_skip_node(const void *blob, uint32_t start_offset)
 
 
 
+/*
+ * Functions to edit a flattened tree in place.
+ *
+ * The blob is kept in the order header, memory reservation map, structure block and strings
+ * block. Free space is at the end, up to totalsize.
+ */
+
+static uint32_t fdt_strings_end(const struct fdt_header *header)
+{
+	return be32toh(header->strings_offset) + be32toh(header->strings_size);
+}
+
+/* Move everything from |offset| to the end of the strings block by |delta| bytes. */
+static int fdt_make_room(void *blob, uint32_t offset, int32_t delta)
+{
+	struct fdt_header *header = blob;
+	uint32_t end = fdt_strings_end(header);
+
+	if (delta > 0 && delta > be32toh(header->totalsize) - end)
+		return -1;
+
+	memmove((uint8_t *)blob + offset + delta, (uint8_t *)blob + offset, end - offset);
+	header->strings_offset = htobe32(be32toh(header->strings_offset) + delta);
+
+	return 0;
+}
+
+/* Resize |old_size| bytes at |offset| in the structure block to |new_size| bytes. */
+static int fdt_resize_struct(void *blob, uint32_t offset, uint32_t old_size, uint32_t new_size)
+{
+	struct fdt_header *header = blob;
+
+	if (fdt_make_room(blob, offset + old_size, (int32_t)(new_size - old_size)))
+		return -1;
+
+	header->structure_size = htobe32(be32toh(header->structure_size) + new_size - old_size);
+
+	return 0;
+}
+
+int fdt_open_into(const void *blob, void *buf, uint32_t bufsize)
+{
+	const struct fdt_header *header = blob;
+	struct fdt_header *new_header = buf;
+	const uint8_t *src = blob;
+	uint8_t *dest = buf;
+	uint32_t reserve_offset = be32toh(header->reserve_map_offset);
+	uint32_t struct_offset = be32toh(header->structure_offset);
+	uint32_t struct_size = be32toh(header->structure_size);
+	uint32_t strings_offset = be32toh(header->strings_offset);
+	uint32_t strings_size = be32toh(header->strings_size);
+	uint32_t reserve_size = 0;
+	uint32_t offset;
+
+	/* The structure block size is only known from version 17 on. */
+	if (be32toh(header->magic) != FDT_HEADER_MAGIC ||
+	    be32toh(header->version) < FDT_SUPPORTED_VERSION ||
+	    be32toh(header->last_comp_version) > FDT_SUPPORTED_VERSION ||
+	    reserve_offset < sizeof(*header))
+		return -1;
+
+	do
+		reserve_size += sizeof(uint64_t) * 2;
+	while (be64dec(src + reserve_offset + reserve_size - sizeof(uint64_t)));
+
+	offset = sizeof(*header) + reserve_size;
+	if (offset + struct_size + strings_size > bufsize)
+		return -1;
+
+	memcpy(dest, src, sizeof(*header));
+	memcpy(dest + sizeof(*header), src + reserve_offset, reserve_size);
+	memcpy(dest + offset, src + struct_offset, struct_size);
+	memcpy(dest + offset + struct_size, src + strings_offset, strings_size);
+
+	new_header->reserve_map_offset = htobe32(sizeof(*header));
+	new_header->structure_offset = htobe32(offset);
+	new_header->strings_offset = htobe32(offset + struct_size);
+	new_header->totalsize = htobe32(bufsize);
+
+	return 0;
+}
+
+uint32_t fdt_pack(void *blob)
+{
+	struct fdt_header *header = blob;
+
+	header->totalsize = htobe32(fdt_strings_end(header));
+
+	return be32toh(header->totalsize);
+}
+
+int fdt_add_reserve_map_entry(void *blob, uint64_t start, uint64_t size)
+{
+	struct fdt_header *header = blob;
+	uint32_t struct_offset = be32toh(header->structure_offset);
+	/* The new entry replaces the terminator right before the structure block. */
+	uint8_t *entry = (uint8_t *)blob + struct_offset - sizeof(uint64_t) * 2;
+
+	if (fdt_make_room(blob, struct_offset - sizeof(uint64_t) * 2, sizeof(uint64_t) * 2))
+		return -1;
+
+	be64enc(entry, start);
+	be64enc(entry + sizeof(uint64_t), size);
+	header->structure_offset = htobe32(struct_offset + sizeof(uint64_t) * 2);
+
+	return 0;
+}
+
+/* Offset of the first subnode of |node| or of its end token. */
+static uint32_t fdt_node_children(const void *blob, uint32_t node)
+{
+	uint32_t offset = node + fdt_node_name(blob, node, NULL);
+	int size;
+
+	while ((size = fdt_next_property(blob, offset, NULL)))
+		offset += size;
+
+	return offset;
+}
+
+uint32_t fdt_first_subnode(const void *blob, uint32_t node)
+{
+	uint32_t offset = fdt_node_children(blob, node);
+
+	return fdt_node_name(blob, offset, NULL) ? offset : 0;
+}
+
+uint32_t fdt_next_subnode(const void *blob, uint32_t node)
+{
+	uint32_t offset = node + fdt_skip_node(blob, node);
+
+	return fdt_node_name(blob, offset, NULL) ? offset : 0;
+}
+
+uint32_t fdt_find_prop(const void *blob, uint32_t node, const char *name,
+		       struct fdt_property *prop)
+{
+	uint32_t offset = node + fdt_node_name(blob, node, NULL);
+	struct fdt_property fprop;
+	int size;
+
+	while ((size = fdt_next_property(blob, offset, &fprop))) {
+		if (!strcmp(fprop.name, name)) {
+			if (prop)
+				*prop = fprop;
+			return offset;
+		}
+		offset += size;
+	}
+
+	return 0;
+}
+
+static void fdt_read_cell_props(const void *blob, uint32_t node, u32 *addrcp, u32 *sizecp)
+{
+	struct fdt_property prop;
+
+	if (addrcp && fdt_find_prop(blob, node, "#address-cells", &prop))
+		*addrcp = be32dec(prop.data);
+	if (sizecp && fdt_find_prop(blob, node, "#size-cells", &prop))
+		*sizecp = be32dec(prop.data);
+}
+
+static uint32_t fdt_add_subnode(void *blob, uint32_t parent, const char *name, size_t len)
+{
+	uint32_t offset = fdt_node_children(blob, parent);
+	uint32_t name_size = ALIGN_UP(len + 1, sizeof(uint32_t));
+	uint8_t *dest = (uint8_t *)blob + offset;
+
+	if (fdt_resize_struct(blob, offset, 0, name_size + 2 * sizeof(uint32_t)))
+		return 0;
+
+	be32enc(dest, FDT_TOKEN_BEGIN_NODE);
+	memset(dest + sizeof(uint32_t), 0, name_size);
+	memcpy(dest + sizeof(uint32_t), name, len);
+	be32enc(dest + sizeof(uint32_t) + name_size, FDT_TOKEN_END_NODE);
+
+	return offset;
+}
+
+uint32_t fdt_find_node_by_path(void *blob, const char *path, u32 *addrcp, u32 *sizecp,
+			       int create)
+{
+	const struct fdt_header *header = blob;
+	uint32_t node = be32toh(header->structure_offset);
+	uint32_t child;
+	const char *name;
+	size_t len;
+
+	if (path[0] != '/')
+		return 0;
+
+	fdt_read_cell_props(blob, node, addrcp, sizecp);
+
+	for (path++; *path; path += len) {
+		const char *slash = strchr(path, '/');
+
+		len = slash ? slash - path : strlen(path);
+
+		for (child = fdt_first_subnode(blob, node); child;
+		     child = fdt_next_subnode(blob, child)) {
+			fdt_node_name(blob, child, &name);
+			if (!strncmp(name, path, len) && name[len] == '\0')
+				break;
+		}
+
+		if (!child) {
+			if (!create)
+				return 0;
+			child = fdt_add_subnode(blob, node, path, len);
+			if (!child)
+				return 0;
+		}
+
+		node = child;
+		fdt_read_cell_props(blob, node, addrcp, sizecp);
+
+		if (path[len] == '/')
+			len++;
+	}
+
+	return node;
+}
+
+int fdt_delete_node(void *blob, uint32_t node)
+{
+	return fdt_resize_struct(blob, node, fdt_skip_node(blob, node), 0);
+}
+
+/* Offset of |name| in the strings block, which is added if it is not there yet. */
+static int64_t fdt_add_string(void *blob, const char *name)
+{
+	struct fdt_header *header = blob;
+	const char *strings = (const char *)blob + be32toh(header->strings_offset);
+	uint32_t strings_size = be32toh(header->strings_size);
+	size_t len = strlen(name) + 1;
+	uint32_t offset;
+
+	/* Names may also be shared with the end of a longer one. */
+	for (offset = 0; offset + len <= strings_size; offset++) {
+		if (!memcmp(strings + offset, name, len))
+			return offset;
+	}
+
+	if (len > be32toh(header->totalsize) - fdt_strings_end(header))
+		return -1;
+
+	memcpy((char *)strings + strings_size, name, len);
+	header->strings_size = htobe32(strings_size + len);
+
+	return strings_size;
+}
+
+/* Returns a pointer to the zeroed data of the property, NULL if there is no room. */
+static void *fdt_reserve_prop(void *blob, uint32_t node, const char *name, size_t size)
+{
+	uint32_t new_size = 3 * sizeof(uint32_t) + ALIGN_UP(size, sizeof(uint32_t));
+	uint32_t old_size = 0;
+	struct fdt_property prop;
+	int64_t name_offset = 0;
+	uint32_t offset;
+	uint8_t *dest;
+
+	offset = fdt_find_prop(blob, node, name, &prop);
+	if (offset) {
+		old_size = 3 * sizeof(uint32_t) + ALIGN_UP(prop.size, sizeof(uint32_t));
+		name_offset = be32dec((uint8_t *)blob + offset + 2 * sizeof(uint32_t));
+	} else {
+		name_offset = fdt_add_string(blob, name);
+		offset = fdt_node_children(blob, node);
+	}
+
+	if (name_offset < 0 || fdt_resize_struct(blob, offset, old_size, new_size))
+		return NULL;
+
+	dest = (uint8_t *)blob + offset;
+	be32enc(dest, FDT_TOKEN_PROPERTY);
+	be32enc(dest + sizeof(uint32_t), size);
+	be32enc(dest + 2 * sizeof(uint32_t), name_offset);
+	dest += 3 * sizeof(uint32_t);
+	memset(dest, 0, ALIGN_UP(size, sizeof(uint32_t)));
+
+	return dest;
+}
+
+int fdt_add_bin_prop(void *blob, uint32_t node, const char *name, const void *data,
+		     size_t size)
+{
+	void *dest = fdt_reserve_prop(blob, node, name, size);
+
+	if (!dest)
+		return -1;
+
+	if (size)
+		memcpy(dest, data, size);
+
+	return 0;
+}
+
+int fdt_add_string_prop(void *blob, uint32_t node, const char *name, const char *str)
+{
+	return fdt_add_bin_prop(blob, node, name, str, strlen(str) + 1);
+}
+
+int fdt_add_u32_prop(void *blob, uint32_t node, const char *name, u32 val)
+{
+	u32 data = htobe32(val);
+
+	return fdt_add_bin_prop(blob, node, name, &data, sizeof(data));
+}
+
+int fdt_add_u64_prop(void *blob, uint32_t node, const char *name, u64 val)
+{
+	u64 data = htobe64(val);
+
+	return fdt_add_bin_prop(blob, node, name, &data, sizeof(data));
+}
+
+int fdt_add_reg_prop(void *blob, uint32_t node, u64 *addrs, u64 *sizes, int count,
+		     u32 addr_cells, u32 size_cells)
+{
+	size_t length = (addr_cells + size_cells) * sizeof(u32) * count;
+	u8 *data = fdt_reserve_prop(blob, node, "reg", length);
+	int i;
+
+	if (!data)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		dt_write_int(data, addrs[i], addr_cells * sizeof(u32));
+		data += addr_cells * sizeof(u32);
+		dt_write_int(data, sizes[i], size_cells * sizeof(u32));
+		data += size_cells * sizeof(u32);
+	}
+
+	return 0;
+}
+
+
+
 /*
  * Functions to turn a flattened tree into an unflattened one.
  */
 
+/*
+ * All nodes and properties of a flattened tree are allocated in one go, coreboot's heap never
+ * gets memory back and the individual allocations only add up.
+ */
+struct fdt_unflatten_arena {
+	struct device_tree_node *nodes;
+	struct device_tree_property *props;
+};
+
+static void fdt_count_nodes(const void *blob, uint32_t offset, size_t *nodes, size_t *props)
+{
+	const char *name;
+	int size;
+
+	*nodes = *props = 0;
+
+	while (1) {
+		if ((size = fdt_node_name(blob, offset, &name))) {
+			(*nodes)++;
+		} else if ((size = fdt_next_property(blob, offset, NULL))) {
+			(*props)++;
+		} else if (be32dec((const uint8_t *)blob + offset) == FDT_TOKEN_END_NODE) {
+			size = sizeof(uint32_t);
+		} else {
+			return;
+		}
+		offset += size;
+	}
+}
+
 static int fdt_unflatten_node(const void *blob, uint32_t start_offset,
-			      struct device_tree *tree,
+			      struct device_tree *tree, struct fdt_unflatten_arena *arena,
 			      struct device_tree_node **new_node)
 {
 	struct list_node *last;
@@ -182,14 +553,14 @@ static int fdt_unflatten_node(const void *blob, uint32_t start_offset,
 		return 0;
 	offset += size;
 
-	struct device_tree_node *node = xzalloc(sizeof(*node));
+	struct device_tree_node *node = arena->nodes++;
 	*new_node = node;
 	node->name = name;
 
 	struct fdt_property fprop;
 	last = &node->properties;
 	while ((size = fdt_next_property(blob, offset, &fprop))) {
-		struct device_tree_property *prop = xzalloc(sizeof(*prop));
+		struct device_tree_property *prop = arena->props++;
 		prop->prop = fprop;
 
 		if (dt_prop_is_phandle(prop)) {
@@ -206,7 +577,7 @@ static int fdt_unflatten_node(const void *blob, uint32_t start_offset,
 
 	struct device_tree_node *child;
 	last = &node->children;
-	while ((size = fdt_unflatten_node(blob, offset, tree, &child))) {
+	while ((size = fdt_unflatten_node(blob, offset, tree, arena, &child))) {
 		list_insert_after(&child->list_node, last);
 		last = &child->list_node;
 
@@ -282,19 +653,89 @@ struct device_tree *fdt_unflatten(const void *blob)
 		offset += size;
 	}
 
-	fdt_unflatten_node(blob, struct_offset, tree, &tree->root);
+	struct fdt_unflatten_arena arena;
+	size_t nodes, props;
+	fdt_count_nodes(blob, struct_offset, &nodes, &props);
+	arena.nodes = xzalloc(nodes * sizeof(*arena.nodes) + props * sizeof(*arena.props));
+	arena.props = (struct device_tree_property *)(arena.nodes + nodes);
+
+	fdt_unflatten_node(blob, struct_offset, tree, &arena, &tree->root);
 
 	return tree;
 }
 
 
 
+/* FNV-1a hash of a string, used for hash tables of names and paths. */
+static uint32_t dt_hash(const char *str, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)str;
+	uint32_t hash = 0x811c9dc5;
+
+	while (len--)
+		hash = (hash ^ *p++) * 0x01000193;
+
+	return hash;
+}
+
+/*
+ * Property names are stored once in the strings block. They are looked up in a hash table
+ * that is only filled up to 3/4, names beyond that are not deduplicated anymore. The table
+ * is static to keep it off the stack.
+ */
+
+#define DT_STRING_SLOTS		512
+#define DT_STRING_MAX		(DT_STRING_SLOTS / 4 * 3)
+
+static struct dt_string_pool {
+	uint32_t size;
+	unsigned int count;
+	bool overflow;
+	struct {
+		const char *str;
+		uint32_t hash;
+		uint32_t offset;
+	} slots[DT_STRING_SLOTS];
+} pool;
+
+static void dt_string_pool_init(void)
+{
+	memset(&pool, 0, sizeof(pool));
+}
+
+/* Returns the offset of the string in the strings block. */
+static uint32_t dt_string_pool_add(const char *str)
+{
+	size_t len = strlen(str);
+	uint32_t hash = dt_hash(str, len);
+	uint32_t offset, i;
+
+	for (i = hash % DT_STRING_SLOTS; pool.slots[i].str; i = (i + 1) % DT_STRING_SLOTS) {
+		if (pool.slots[i].hash == hash && !strcmp(pool.slots[i].str, str))
+			return pool.slots[i].offset;
+	}
+
+	offset = pool.size;
+	pool.size += len + 1;
+
+	if (pool.count < DT_STRING_MAX) {
+		pool.slots[i].str = str;
+		pool.slots[i].hash = hash;
+		pool.slots[i].offset = offset;
+		pool.count++;
+	} else {
+		pool.overflow = true;
+	}
+
+	return offset;
+}
+
 /*
  * Functions to find the size of the device tree if it was flattened.
  */
 
 static void dt_flat_prop_size(struct device_tree_property *prop,
-			      uint32_t *struct_size, uint32_t *strings_size)
+			      uint32_t *struct_size)
 {
 	/* Starting token. */
 	*struct_size += sizeof(uint32_t);
@@ -306,11 +747,11 @@ static void dt_flat_prop_size(struct device_tree_property *prop,
 	*struct_size += ALIGN_UP(prop->prop.size, sizeof(uint32_t));
 
 	/* Property name. */
-	*strings_size += strlen(prop->prop.name) + 1;
+	dt_string_pool_add(prop->prop.name);
 }
 
 static void dt_flat_node_size(struct device_tree_node *node,
-			      uint32_t *struct_size, uint32_t *strings_size)
+			      uint32_t *struct_size)
 {
 	/* Starting token. */
 	*struct_size += sizeof(uint32_t);
@@ -319,11 +760,11 @@ static void dt_flat_node_size(struct device_tree_node *node,
 
 	struct device_tree_property *prop;
 	list_for_each(prop, node->properties, list_node)
-		dt_flat_prop_size(prop, struct_size, strings_size);
+		dt_flat_prop_size(prop, struct_size);
 
 	struct device_tree_node *child;
 	list_for_each(child, node->children, list_node)
-		dt_flat_node_size(child, struct_size, strings_size);
+		dt_flat_node_size(child, struct_size);
 
 	/* End token. */
 	*struct_size += sizeof(uint32_t);
@@ -338,14 +779,14 @@ uint32_t dt_flat_size(const struct device_tree *tree)
 	size += sizeof(uint64_t) * 2;
 
 	uint32_t struct_size = 0;
-	uint32_t strings_size = 0;
-	dt_flat_node_size(tree->root, &struct_size, &strings_size);
+	dt_string_pool_init();
+	dt_flat_node_size(tree->root, &struct_size);
 
 	size += struct_size;
 	/* End token. */
 	size += sizeof(uint32_t);
 
-	size += strings_size;
+	size += pool.size;
 
 	return size;
 }
@@ -365,11 +806,9 @@ static void dt_flatten_map_entry(struct device_tree_reserve_map_entry *entry,
 }
 
 static void dt_flatten_prop(struct device_tree_property *prop,
-			    void **struct_start, void *strings_base,
-			    void **strings_start)
+			    void **struct_start)
 {
 	uint8_t *dstruct = (uint8_t *)*struct_start;
-	uint8_t *dstrings = (uint8_t *)*strings_start;
 
 	be32enc(dstruct, FDT_TOKEN_PROPERTY);
 	dstruct += sizeof(uint32_t);
@@ -377,48 +816,71 @@ static void dt_flatten_prop(struct device_tree_property *prop,
 	be32enc(dstruct, prop->prop.size);
 	dstruct += sizeof(uint32_t);
 
-	uint32_t name_offset = (uintptr_t)dstrings - (uintptr_t)strings_base;
-	be32enc(dstruct, name_offset);
+	be32enc(dstruct, dt_string_pool_add(prop->prop.name));
 	dstruct += sizeof(uint32_t);
 
-	strcpy((char *)dstrings, prop->prop.name);
-	dstrings += strlen(prop->prop.name) + 1;
-
 	memcpy(dstruct, prop->prop.data, prop->prop.size);
+	memset(dstruct + prop->prop.size, 0,
+	       ALIGN_UP(prop->prop.size, sizeof(uint32_t)) - prop->prop.size);
 	dstruct += ALIGN_UP(prop->prop.size, sizeof(uint32_t));
 
 	*struct_start = dstruct;
-	*strings_start = dstrings;
 }
 
 static void dt_flatten_node(const struct device_tree_node *node,
-			    void **struct_start, void *strings_base,
-			    void **strings_start)
+			    void **struct_start)
 {
 	uint8_t *dstruct = (uint8_t *)*struct_start;
-	uint8_t *dstrings = (uint8_t *)*strings_start;
 
 	be32enc(dstruct, FDT_TOKEN_BEGIN_NODE);
 	dstruct += sizeof(uint32_t);
 
-	strcpy((char *)dstruct, node->name);
-	dstruct += ALIGN_UP(strlen(node->name) + 1, sizeof(uint32_t));
+	size_t name_size = strlen(node->name) + 1;
+	memcpy(dstruct, node->name, name_size);
+	memset(dstruct + name_size, 0, ALIGN_UP(name_size, sizeof(uint32_t)) - name_size);
+	dstruct += ALIGN_UP(name_size, sizeof(uint32_t));
 
 	struct device_tree_property *prop;
 	list_for_each(prop, node->properties, list_node)
-		dt_flatten_prop(prop, (void **)&dstruct, strings_base,
-				(void **)&dstrings);
+		dt_flatten_prop(prop, (void **)&dstruct);
 
 	struct device_tree_node *child;
 	list_for_each(child, node->children, list_node)
-		dt_flatten_node(child, (void **)&dstruct, strings_base,
-				(void **)&dstrings);
+		dt_flatten_node(child, (void **)&dstruct);
 
 	be32enc(dstruct, FDT_TOKEN_END_NODE);
 	dstruct += sizeof(uint32_t);
 
 	*struct_start = dstruct;
-	*strings_start = dstrings;
+}
+
+static void dt_string_pool_write_slots(uint8_t *strings)
+{
+	unsigned int i;
+
+	for (i = 0; i < DT_STRING_SLOTS; i++) {
+		if (pool.slots[i].str)
+			strcpy((char *)strings + pool.slots[i].offset, pool.slots[i].str);
+	}
+}
+
+/*
+ * Only needed if the pool overflowed: the names are added again in the same order, so they
+ * end up at the offsets that were written to the structure block.
+ */
+static void dt_string_pool_write(const struct device_tree_node *node, uint8_t *strings)
+{
+	struct device_tree_property *prop;
+	list_for_each(prop, node->properties, list_node) {
+		uint32_t offset = pool.size;
+
+		if (dt_string_pool_add(prop->prop.name) == offset)
+			strcpy((char *)strings + offset, prop->prop.name);
+	}
+
+	struct device_tree_node *child;
+	list_for_each(child, node->children, list_node)
+		dt_string_pool_write(child, strings);
 }
 
 void dt_flatten(const struct device_tree *tree, void *start_dest)
@@ -435,25 +897,25 @@ void dt_flatten(const struct device_tree *tree, void *start_dest)
 	((uint64_t *)dest)[0] = ((uint64_t *)dest)[1] = 0;
 	dest += sizeof(uint64_t) * 2;
 
-	uint32_t struct_size = 0;
-	uint32_t strings_size = 0;
-	dt_flat_node_size(tree->root, &struct_size, &strings_size);
-
+	/* The strings block follows the structure block, it is written once its size is known. */
 	uint8_t *struct_start = dest;
 	header->structure_offset = htobe32(dest - (uint8_t *)start_dest);
-	header->structure_size = htobe32(struct_size);
-	dest += struct_size;
+	dt_string_pool_init();
+	dt_flatten_node(tree->root, (void **)&dest);
 
 	*((uint32_t *)dest) = htobe32(FDT_TOKEN_END);
 	dest += sizeof(uint32_t);
+	header->structure_size = htobe32(dest - struct_start);
 
-	uint8_t *strings_start = dest;
 	header->strings_offset = htobe32(dest - (uint8_t *)start_dest);
-	header->strings_size = htobe32(strings_size);
-	dest += strings_size;
-
-	dt_flatten_node(tree->root, (void **)&struct_start, strings_start,
-			(void **)&strings_start);
+	header->strings_size = htobe32(pool.size);
+	if (pool.overflow) {
+		dt_string_pool_init();
+		dt_string_pool_write(tree->root, dest);
+	} else {
+		dt_string_pool_write_slots(dest);
+	}
+	dest += pool.size;
 
 	header->totalsize = htobe32(dest - (uint8_t *)start_dest);
 }
@@ -496,6 +958,199 @@ void dt_print_node(const struct device_tree_node *node)
  * Functions for reading and manipulating an unflattened device tree.
  */
 
+/*
+ * Index of the nodes of a tree by path and by phandle, to keep the lookups done repeatedly
+ * while applying overlays from walking the tree every time. It is only built for a tree
+ * that is searched at least twice. Nodes added later are found by walking the tree, which
+ * also marks the index for rebuilding. Removing nodes invalidates the indexes of all trees
+ * through dt_nodes_changed(). The tables are reused when an index is rebuilt.
+ */
+
+struct device_tree_index_entry {
+	struct device_tree_node *node;
+	uint32_t hash;
+	uint32_t path;		/* Offset of the path in path_buf */
+};
+
+struct device_tree_index {
+	uint32_t generation;
+	uint32_t lookups;	/* Lookups since the last change */
+	bool valid;
+	size_t slots;		/* Slots in each table, a power of two */
+	struct device_tree_index_entry *paths;
+	struct device_tree_node **phandles;
+	char *path_buf;
+	size_t path_buf_size;
+};
+
+static uint32_t dt_generation;
+
+void dt_nodes_changed(void)
+{
+	dt_generation++;
+}
+
+/* Count the nodes of a subtree and the space their paths take. */
+static size_t dt_index_count(const struct device_tree_node *node, size_t prefix_len,
+			     size_t *path_size)
+{
+	const struct device_tree_node *child;
+	size_t len = prefix_len + 1 + strlen(node->name);
+	size_t count = 1;
+
+	*path_size += len + 1;
+
+	list_for_each(child, node->children, list_node)
+		count += dt_index_count(child, len, path_size);
+
+	return count;
+}
+
+static void dt_index_insert(struct device_tree_index *index, struct device_tree_node *node,
+			    uint32_t path, size_t len)
+{
+	uint32_t hash = dt_hash(index->path_buf + path, len);
+	size_t mask = index->slots - 1;
+	size_t i;
+
+	/* Lookups return the first match in the order of the tree, like the walks do. */
+	for (i = hash & mask; index->paths[i].node; i = (i + 1) & mask) {
+		if (index->paths[i].hash == hash &&
+		    !strcmp(index->path_buf + index->paths[i].path, index->path_buf + path))
+			break;
+	}
+	if (!index->paths[i].node) {
+		index->paths[i].node = node;
+		index->paths[i].hash = hash;
+		index->paths[i].path = path;
+	}
+
+	if (!node->phandle)
+		return;
+
+	/* phandles are mostly consecutive, so they spread well without hashing. */
+	for (i = node->phandle & mask; index->phandles[i]; i = (i + 1) & mask) {
+		if (index->phandles[i]->phandle == node->phandle)
+			return;
+	}
+	index->phandles[i] = node;
+}
+
+static void dt_index_add(struct device_tree_index *index, struct device_tree_node *node,
+			 uint32_t prefix, size_t prefix_len, size_t *used)
+{
+	struct device_tree_node *child;
+	uint32_t path = *used;
+	char *p = index->path_buf + path;
+	size_t len;
+
+	memcpy(p, index->path_buf + prefix, prefix_len);
+	p[prefix_len] = '/';
+	strcpy(p + prefix_len + 1, node->name);
+	len = prefix_len + 1 + strlen(node->name);
+	*used += len + 1;
+
+	dt_index_insert(index, node, path, len);
+
+	list_for_each(child, node->children, list_node)
+		dt_index_add(index, child, path, len, used);
+}
+
+static bool dt_index_build(struct device_tree_index *index, struct device_tree_node *root)
+{
+	struct device_tree_node *child;
+	size_t nodes, slots = 16, path_size = 0, used;
+
+	/* The root node is "/" rather than "/" followed by its empty name. */
+	nodes = dt_index_count(root, 0, &path_size);
+	while (slots < 2 * nodes)
+		slots *= 2;
+
+	if (slots > index->slots) {
+		free(index->phandles);
+		free(index->paths);
+		index->paths = malloc(slots * sizeof(*index->paths));
+		index->phandles = malloc(slots * sizeof(*index->phandles));
+		index->slots = slots;
+		if (!index->paths || !index->phandles) {
+			index->slots = 0;
+			return false;
+		}
+	}
+	if (path_size > index->path_buf_size) {
+		free(index->path_buf);
+		index->path_buf = malloc(path_size);
+		index->path_buf_size = path_size;
+		if (!index->path_buf) {
+			index->path_buf_size = 0;
+			return false;
+		}
+	}
+
+	memset(index->paths, 0, index->slots * sizeof(*index->paths));
+	memset(index->phandles, 0, index->slots * sizeof(*index->phandles));
+
+	strcpy(index->path_buf, "/");
+	used = 2;
+	dt_index_insert(index, root, 0, 1);
+	list_for_each(child, root->children, list_node)
+		dt_index_add(index, child, 0, 0, &used);
+
+	return true;
+}
+
+/* Returns the index of the tree, or NULL if the tree should be walked instead. */
+static struct device_tree_index *dt_get_index(struct device_tree *tree)
+{
+	struct device_tree_index *index = tree->index;
+
+	if (!index) {
+		index = tree->index = xzalloc(sizeof(*index));
+		index->generation = dt_generation;
+	}
+
+	if (index->generation != dt_generation) {
+		index->generation = dt_generation;
+		index->lookups = 0;
+		index->valid = false;
+	}
+
+	if (!index->valid && ++index->lookups >= 2)
+		index->valid = dt_index_build(index, tree->root);
+
+	return index->valid ? index : NULL;
+}
+
+/* Called when walking the tree found a node that the index missed. */
+static void dt_index_stale(struct device_tree *tree, struct device_tree_node *found)
+{
+	if (found && tree->index && tree->index->valid) {
+		tree->index->valid = false;
+		tree->index->lookups = 1;
+	}
+}
+
+/* Look up a node by its absolute path, NULL if the tree has to be walked instead. */
+static struct device_tree_node *dt_index_find_path(struct device_tree_index *index,
+						   const char *path)
+{
+	const char *name = strrchr(path, '/') + 1;
+	uint32_t hash = dt_hash(path, strlen(path));
+	size_t mask = index->slots - 1;
+	struct device_tree_node *node;
+	size_t i;
+
+	for (i = hash & mask; index->paths[i].node; i = (i + 1) & mask) {
+		node = index->paths[i].node;
+		if (index->paths[i].hash == hash &&
+		    !strcmp(index->path_buf + index->paths[i].path, path))
+			/* Catch nodes that were renamed since. */
+			return strcmp(node->name, name) ? NULL : node;
+	}
+
+	return NULL;
+}
+
 /*
  * Read #address-cells and #size-cells properties from a node.
  *
@@ -557,6 +1212,7 @@ struct device_tree_node *dt_find_node(struct device_tree_node *parent,
 		found = malloc(sizeof(*found));
 		if (!found)
 			return NULL;
+		memset(found, 0, sizeof(*found));
 		found->name = strdup(*path);
 		if (!found->name)
 			return NULL;
@@ -595,6 +1251,7 @@ struct device_tree_node *dt_find_node_by_path(struct device_tree *tree,
 	const char *path_array[15];
 	int i;
 	struct device_tree_node *node = NULL;
+	struct device_tree_index *index = NULL;
 
 	if (path[0] == '/') { /* regular path */
 		if (path[1] == '\0') {	/* special case: "/" is root node */
@@ -602,6 +1259,15 @@ struct device_tree_node *dt_find_node_by_path(struct device_tree *tree,
 			return tree->root;
 		}
 
+		/* The cell sizes along the path are only known by walking it. */
+		if (!addrcp && !sizecp)
+			index = dt_get_index(tree);
+		if (index) {
+			node = dt_index_find_path(index, path);
+			if (node)
+				return node;
+		}
+
 		sub_path = duped_str = strdup(&path[1]);
 		if (!sub_path)
 			return NULL;
@@ -651,6 +1317,8 @@ struct device_tree_node *dt_find_node_by_path(struct device_tree *tree,
 		path_array[i] = NULL;
 		node = dt_find_node(parent, path_array,
 				    addrcp, sizecp, create);
+		if (index)
+			dt_index_stale(tree, node);
 	}
 
 	free(duped_str);
@@ -681,8 +1349,8 @@ struct device_tree_node *dt_find_node_by_alias(struct device_tree *tree,
 	return dt_find_node_by_path(tree, alias_path, NULL, NULL, 0);
 }
 
-struct device_tree_node *dt_find_node_by_phandle(struct device_tree_node *root,
-						 uint32_t phandle)
+static struct device_tree_node *dt_walk_node_by_phandle(struct device_tree_node *root,
+							 uint32_t phandle)
 {
 	if (!root)
 		return NULL;
@@ -693,7 +1361,7 @@ struct device_tree_node *dt_find_node_by_phandle(struct device_tree_node *root,
 	struct device_tree_node *node;
 	struct device_tree_node *result;
 	list_for_each(node, root->children, list_node) {
-		result = dt_find_node_by_phandle(node, phandle);
+		result = dt_walk_node_by_phandle(node, phandle);
 		if (result)
 			return result;
 	}
@@ -701,6 +1369,36 @@ struct device_tree_node *dt_find_node_by_phandle(struct device_tree_node *root,
 	return NULL;
 }
 
+/*
+ * Find a node by its phandle.
+ *
+ * @param tree		The device tree to search.
+ * @param phandle	The phandle of the node.
+ * @return		The found node, or NULL.
+ */
+struct device_tree_node *dt_find_node_by_phandle(struct device_tree *tree,
+						 uint32_t phandle)
+{
+	struct device_tree_index *index;
+	struct device_tree_node *node;
+	size_t i, mask;
+
+	/* Nodes without a phandle aren't indexed. */
+	index = phandle ? dt_get_index(tree) : NULL;
+	if (!index)
+		return dt_walk_node_by_phandle(tree->root, phandle);
+
+	mask = index->slots - 1;
+	for (i = phandle & mask; index->phandles[i]; i = (i + 1) & mask) {
+		if (index->phandles[i]->phandle == phandle)
+			return index->phandles[i];
+	}
+
+	node = dt_walk_node_by_phandle(tree->root, phandle);
+	dt_index_stale(tree, node);
+	return node;
+}
+
 /*
  * Check if given node is compatible.
  *
@@ -1465,8 +2163,7 @@ static int dt_import_fragment(struct device_tree *tree,
 	if (phandle) {
 		if (phandle->prop.size != sizeof(uint32_t))
 			return -1;
-		target = dt_find_node_by_phandle(tree->root,
-						 be32dec(phandle->prop.data));
+		target = dt_find_node_by_phandle(tree, be32dec(phandle->prop.data));
 		/* Symbols already updated as part of dt_fixup_external(). */
 	} else if (path) {
 		target = dt_find_node_by_path(tree, path->prop.data,
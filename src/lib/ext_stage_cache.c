@@ -5,6 +5,7 @@
 #include <imd.h>
 #include <stage_cache.h>
 #include <string.h>
+#include <timestamp.h>
 
 static struct imd imd_stage_cache;
 
@@ -71,6 +72,9 @@ void stage_cache_add(int stage_id, const struct prog *stage)
 	c = imd_entry_at(imd, e);
 
 	memcpy(c, prog_start(stage), prog_size(stage));
+
+	if (CONFIG(STAGE_CACHE_VERIFY))
+		meta->hash = stage_cache_hash(c, prog_size(stage));
 }
 
 void stage_cache_add_raw(int stage_id, const void *base, const size_t size)
@@ -122,11 +126,14 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 	void *c;
 	size_t size;
 
+	timestamp_add_now(TS_START_STAGE_CACHE_LOAD);
+
 	imd = &imd_stage_cache;
 	e = imd_entry_find(imd, CBMEM_ID_STAGEx_META + stage_id);
 	if (e == NULL) {
 		printk(BIOS_DEBUG, "Error: Can't find %x metadata in imd\n",
 				CBMEM_ID_STAGEx_META + stage_id);
+		timestamp_add_now(TS_END_STAGE_CACHE_LOAD);
 		return;
 	}
 
@@ -137,6 +144,7 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 	if (e == NULL) {
 		printk(BIOS_DEBUG, "Error: Can't find stage_cache %x in imd\n",
 				CBMEM_ID_STAGEx_CACHE + stage_id);
+		timestamp_add_now(TS_END_STAGE_CACHE_LOAD);
 		return;
 	}
 
@@ -145,9 +153,19 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 
 	memcpy((void *)(uintptr_t)meta->load_addr, c, size);
 
+	if (CONFIG(STAGE_CACHE_VERIFY) &&
+	    stage_cache_hash((void *)(uintptr_t)meta->load_addr, size) != meta->hash) {
+		printk(BIOS_ERR, "Error: stage_cache %x is corrupted\n",
+				CBMEM_ID_STAGEx_CACHE + stage_id);
+		timestamp_add_now(TS_END_STAGE_CACHE_LOAD);
+		return;
+	}
+
 	prog_set_area(stage, (void *)(uintptr_t)meta->load_addr, size);
 	prog_set_entry(stage, (void *)(uintptr_t)meta->entry_addr,
 			(void *)(uintptr_t)meta->arg);
+
+	timestamp_add_now(TS_END_STAGE_CACHE_LOAD);
 }
 
 static void stage_cache_setup(int is_recovery)
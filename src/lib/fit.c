@@ -221,6 +221,16 @@ void fit_update_chosen(struct device_tree *tree, const char *cmd_line)
 	dt_add_string_prop(node, "bootargs", cmd_line);
 }
 
+int fit_update_chosen_flat(void *blob, const char *cmd_line)
+{
+	uint32_t node = fdt_find_node_by_path(blob, "/chosen", NULL, NULL, 1);
+
+	if (!node)
+		return -1;
+
+	return fdt_add_string_prop(blob, node, "bootargs", cmd_line);
+}
+
 void fit_add_ramdisk(struct device_tree *tree, void *ramdisk_addr,
 		     size_t ramdisk_size)
 {
@@ -235,6 +245,18 @@ void fit_add_ramdisk(struct device_tree *tree, void *ramdisk_addr,
 	dt_add_u64_prop(node, "linux,initrd-end", end);
 }
 
+int fit_add_ramdisk_flat(void *blob, void *ramdisk_addr, size_t ramdisk_size)
+{
+	uint32_t node = fdt_find_node_by_path(blob, "/chosen", NULL, NULL, 1);
+	u64 start = (uintptr_t)ramdisk_addr;
+	u64 end = start + ramdisk_size;
+
+	if (!node || fdt_add_u64_prop(blob, node, "linux,initrd-start", start))
+		return -1;
+
+	return fdt_add_u64_prop(blob, node, "linux,initrd-end", end);
+}
+
 static void update_reserve_map(uint64_t start, uint64_t end,
 			       struct device_tree *tree)
 {
@@ -333,12 +355,54 @@ void fit_add_compat_string(const char *str)
 	list_insert_after(&compat_node->list_node, &compat_strings);
 }
 
+/* Collect the memory to describe to the OS. */
+static void fit_memory_map(struct mem_map *map)
+{
+	memranges_init_empty(&map->mem, NULL, 0);
+	memranges_init_empty(&map->reserved, NULL, 0);
+
+	bootmem_walk_os_mem(walk_memory_table, map);
+}
+
+/* Build the 'reg' property of the memory node. */
+static void *fit_memory_reg(struct mem_map *map, u32 addr_cells, u32 size_cells,
+			    size_t *length)
+{
+	const struct range_entry *r;
+
+	/*
+	 * Count the amount of 'reg' entries we need (account for size limits).
+	 */
+	size_t count = 0;
+	memranges_each_entry(r, &map->mem) {
+		uint64_t size = range_entry_size(r);
+		uint64_t max_size = max_range(size_cells);
+		count += DIV_ROUND_UP(size, max_size);
+	}
+
+	/* Allocate the right amount of space and fill up the entries. */
+	*length = count * (addr_cells + size_cells) * sizeof(u32);
+
+	void *data = xzalloc(*length);
+
+	struct entry_params add_params = { addr_cells, size_cells, data };
+	memranges_each_entry(r, &map->mem) {
+		update_mem_property(range_entry_base(r), range_entry_end(r),
+				    &add_params);
+	}
+	assert(add_params.data - data == *length);
+
+	return data;
+}
+
 void fit_update_memory(struct device_tree *tree)
 {
 	const struct range_entry *r;
 	struct device_tree_node *node;
 	u32 addr_cells = 1, size_cells = 1;
 	struct mem_map map;
+	size_t length;
+	void *data;
 
 	printk(BIOS_INFO, "FIT: Updating devicetree memory entries\n");
 
@@ -352,6 +416,7 @@ void fit_update_memory(struct device_tree *tree)
 		if (devtype && !strcmp(devtype, "memory"))
 			list_remove(&node->list_node);
 	}
+	dt_nodes_changed();
 
 	node = xzalloc(sizeof(*node));
 
@@ -359,10 +424,7 @@ void fit_update_memory(struct device_tree *tree)
 	list_insert_after(&node->list_node, &tree->root->children);
 	dt_add_string_prop(node, "device_type", (char *)"memory");
 
-	memranges_init_empty(&map.mem, NULL, 0);
-	memranges_init_empty(&map.reserved, NULL, 0);
-
-	bootmem_walk_os_mem(walk_memory_table, &map);
+	fit_memory_map(&map);
 
 	/* CBMEM regions are both carved out and explicitly reserved. */
 	memranges_each_entry(r, &map.reserved) {
@@ -370,33 +432,66 @@ void fit_update_memory(struct device_tree *tree)
 				   tree);
 	}
 
-	/*
-	 * Count the amount of 'reg' entries we need (account for size limits).
-	 */
-	size_t count = 0;
-	memranges_each_entry(r, &map.mem) {
-		uint64_t size = range_entry_size(r);
-		uint64_t max_size = max_range(size_cells);
-		count += DIV_ROUND_UP(size, max_size);
+	/* Assemble the final property and add it to the device tree. */
+	data = fit_memory_reg(&map, addr_cells, size_cells, &length);
+	dt_add_bin_prop(node, "reg", data, length);
+
+	memranges_teardown(&map.mem);
+	memranges_teardown(&map.reserved);
+}
+
+static bool fdt_is_memory_node(const void *blob, uint32_t node)
+{
+	struct fdt_property prop;
+
+	return fdt_find_prop(blob, node, "device_type", &prop) &&
+	       prop.size == sizeof("memory") && !memcmp(prop.data, "memory", prop.size);
+}
+
+int fit_update_memory_flat(void *blob)
+{
+	const struct range_entry *r;
+	u32 addr_cells = 1, size_cells = 1;
+	struct mem_map map;
+	uint32_t node;
+	size_t length;
+	void *data;
+	int ret = 0;
+
+	printk(BIOS_INFO, "FIT: Updating devicetree memory entries\n");
+
+	node = fdt_find_node_by_path(blob, "/", &addr_cells, &size_cells, 0);
+
+	/* Deleting a node leaves its next sibling at the same offset. */
+	node = fdt_first_subnode(blob, node);
+	while (node) {
+		if (!fdt_is_memory_node(blob, node))
+			node = fdt_next_subnode(blob, node);
+		else if (fdt_delete_node(blob, node) || !fdt_node_name(blob, node, NULL))
+			break;
 	}
 
-	/* Allocate the right amount of space and fill up the entries. */
-	size_t length = count * (addr_cells + size_cells) * sizeof(u32);
+	node = fdt_find_node_by_path(blob, "/memory", NULL, NULL, 1);
+	if (!node || fdt_add_string_prop(blob, node, "device_type", "memory"))
+		return -1;
 
-	void *data = xzalloc(length);
+	fit_memory_map(&map);
 
-	struct entry_params add_params = { addr_cells, size_cells, data };
-	memranges_each_entry(r, &map.mem) {
-		update_mem_property(range_entry_base(r), range_entry_end(r),
-				    &add_params);
+	memranges_each_entry(r, &map.reserved) {
+		if (fdt_add_reserve_map_entry(blob, range_entry_base(r), range_entry_size(r)))
+			ret = -1;
 	}
-	assert(add_params.data - data == length);
 
-	/* Assemble the final property and add it to the device tree. */
-	dt_add_bin_prop(node, "reg", data, length);
+	data = fit_memory_reg(&map, addr_cells, size_cells, &length);
+	node = fdt_find_node_by_path(blob, "/memory", NULL, NULL, 0);
+	if (!node || fdt_add_bin_prop(blob, node, "reg", data, length))
+		ret = -1;
 
+	free(data);
 	memranges_teardown(&map.mem);
 	memranges_teardown(&map.reserved);
+
+	return ret;
 }
 
 /*
@@ -15,6 +15,7 @@
 #include <lib.h>
 #include <fit_payload.h>
 #include <boardid.h>
+#include <endian.h>
 
 /* Pack the device_tree and place it at given position. */
 static void pack_fdt(struct region *fdt, struct device_tree *dt)
@@ -86,7 +87,19 @@ static bool extract(struct region *region, struct fit_image_node *node)
 	return false;
 }
 
-static struct device_tree *unpack_fdt(struct fit_image_node *image_node)
+/* Room for the changes of coreboot, the editing falls back to unflattening if it isn't enough. */
+#define FDT_EDIT_ROOM	(4 * KiB)
+
+/* Place the edited flat device_tree at given position. */
+static void copy_fdt(struct region *fdt, const void *blob)
+{
+	printk(BIOS_INFO, "FIT: Copying FDT to %p\n", (void *)fdt->offset);
+
+	memcpy((void *)fdt->offset, blob, fdt->size);
+	prog_segment_loaded(fdt->offset, fdt->size, 0);
+}
+
+static void *fdt_data(struct fit_image_node *image_node)
 {
 	void *data = image_node->data;
 
@@ -101,38 +114,33 @@ static struct device_tree *unpack_fdt(struct fit_image_node *image_node)
 			return NULL;
 	}
 
+	return data;
+}
+
+static struct device_tree *unpack_fdt(struct fit_image_node *image_node)
+{
+	void *data = fdt_data(image_node);
+
+	if (!data)
+		return NULL;
+
 	return fdt_unflatten(data);
 }
 
-/**
- * Add coreboot tables, CBMEM information and optional board specific strapping
- * IDs to the device tree loaded via FIT.
+/*
+ * Get the ranges of the coreboot tables and CBMEM to describe in the device tree.
+ * Returns the number of ranges, 0 if they are not available.
  */
-static void add_cb_fdt_data(struct device_tree *tree)
+static int cb_fdt_ranges(u64 *reg_addrs, u64 *reg_sizes)
 {
-	u32 addr_cells = 1, size_cells = 1;
-	u64 reg_addrs[2], reg_sizes[2];
 	void *baseptr = NULL;
 	size_t size = 0;
 
-	static const char *firmware_path[] = {"firmware", NULL};
-	struct device_tree_node *firmware_node = dt_find_node(tree->root,
-		firmware_path, &addr_cells, &size_cells, 1);
-
-	/* Need to add 'ranges' to the intermediate node to make 'reg' work. */
-	dt_add_bin_prop(firmware_node, "ranges", NULL, 0);
-
-	static const char *coreboot_path[] = {"coreboot", NULL};
-	struct device_tree_node *coreboot_node = dt_find_node(firmware_node,
-		coreboot_path, &addr_cells, &size_cells, 1);
-
-	dt_add_string_prop(coreboot_node, "compatible", "coreboot");
-
 	/* Fetch CB tables from cbmem */
 	void *cbtable = cbmem_find(CBMEM_ID_CBTABLE);
 	if (!cbtable) {
 		printk(BIOS_WARNING, "FIT: No coreboot table found!\n");
-		return;
+		return 0;
 	}
 
 	/* First 'reg' address range is the coreboot table. */
@@ -145,12 +153,40 @@ static void add_cb_fdt_data(struct device_tree *tree)
 	cbmem_get_region(&baseptr, &size);
 	if (!baseptr || size == 0) {
 		printk(BIOS_WARNING, "FIT: CBMEM pointer/size not found!\n");
-		return;
+		return 0;
 	}
 
 	reg_addrs[1] = (uintptr_t)baseptr;
 	reg_sizes[1] = size;
 
+	return 2;
+}
+
+/**
+ * Add coreboot tables, CBMEM information and optional board specific strapping
+ * IDs to the device tree loaded via FIT.
+ */
+static void add_cb_fdt_data(struct device_tree *tree)
+{
+	u32 addr_cells = 1, size_cells = 1;
+	u64 reg_addrs[2], reg_sizes[2];
+
+	static const char *firmware_path[] = {"firmware", NULL};
+	struct device_tree_node *firmware_node = dt_find_node(tree->root,
+		firmware_path, &addr_cells, &size_cells, 1);
+
+	/* Need to add 'ranges' to the intermediate node to make 'reg' work. */
+	dt_add_bin_prop(firmware_node, "ranges", NULL, 0);
+
+	static const char *coreboot_path[] = {"coreboot", NULL};
+	struct device_tree_node *coreboot_node = dt_find_node(firmware_node,
+		coreboot_path, &addr_cells, &size_cells, 1);
+
+	dt_add_string_prop(coreboot_node, "compatible", "coreboot");
+
+	if (!cb_fdt_ranges(reg_addrs, reg_sizes))
+		return;
+
 	dt_add_reg_prop(coreboot_node, reg_addrs, reg_sizes, 2, addr_cells,
 			size_cells);
 
@@ -165,6 +201,83 @@ static void add_cb_fdt_data(struct device_tree *tree)
 		dt_add_u32_prop(coreboot_node, "ram-code", ram_code());
 }
 
+/* Same as add_cb_fdt_data() for a flat device tree, returns -1 if it ran out of room. */
+static int add_cb_fdt_data_flat(void *blob)
+{
+	u32 addr_cells = 1, size_cells = 1;
+	u64 reg_addrs[2], reg_sizes[2];
+	uint32_t node;
+
+	node = fdt_find_node_by_path(blob, "/firmware", NULL, NULL, 1);
+	if (!node || fdt_add_bin_prop(blob, node, "ranges", NULL, 0))
+		return -1;
+
+	node = fdt_find_node_by_path(blob, "/firmware/coreboot", &addr_cells, &size_cells, 1);
+	if (!node || fdt_add_string_prop(blob, node, "compatible", "coreboot"))
+		return -1;
+
+	if (!cb_fdt_ranges(reg_addrs, reg_sizes))
+		return 0;
+
+	if (fdt_add_reg_prop(blob, node, reg_addrs, reg_sizes, 2, addr_cells, size_cells))
+		return -1;
+
+	if (board_id() != UNDEFINED_STRAPPING_ID &&
+	    fdt_add_u32_prop(blob, node, "board-id", board_id()))
+		return -1;
+
+	if (sku_id() != UNDEFINED_STRAPPING_ID &&
+	    fdt_add_u32_prop(blob, node, "sku-id", sku_id()))
+		return -1;
+
+	if (ram_code() != UNDEFINED_STRAPPING_ID &&
+	    fdt_add_u32_prop(blob, node, "ram-code", ram_code()))
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Without overlays and registered fixups, coreboot only changes a few properties. These are
+ * edited right in the flat device tree, which saves unflattening and flattening it again.
+ * Returns the edited copy of the FDT, or NULL to fall back to the device tree functions.
+ */
+static void *edit_fdt(const void *data, bool ramdisk)
+{
+	const struct fdt_header *header = data;
+	uint32_t size = be32toh(header->totalsize) + FDT_EDIT_ROOM;
+	void *blob;
+
+#if defined(CONFIG_LINUX_COMMAND_LINE)
+	size += strlen(CONFIG_LINUX_COMMAND_LINE) + 1;
+#endif
+
+	blob = malloc(size);
+	if (!blob)
+		return NULL;
+
+	if (fdt_open_into(data, blob, size)) {
+		free(blob);
+		return NULL;
+	}
+
+	/* The ramdisk location is filled in once it is known, the size doesn't change. */
+	if (add_cb_fdt_data_flat(blob) ||
+#if defined(CONFIG_LINUX_COMMAND_LINE)
+	    fit_update_chosen_flat(blob, (char *)CONFIG_LINUX_COMMAND_LINE) ||
+#endif
+	    fit_update_memory_flat(blob) ||
+	    (ramdisk && fit_add_ramdisk_flat(blob, NULL, 0))) {
+		printk(BIOS_INFO, "FIT: Not enough room to edit FDT in place\n");
+		free(blob);
+		return NULL;
+	}
+
+	fdt_pack(blob);
+
+	return blob;
+}
+
 /*
  * Parse the uImage FIT, choose a configuration and extract images.
  */
@@ -189,36 +302,46 @@ void fit_payload(struct prog *payload)
 		return;
 	}
 
-	dt = unpack_fdt(config->fdt);
-	if (!dt) {
-		printk(BIOS_ERR, "ERROR: Failed to unflatten the FDT.\n");
-		rdev_munmap(prog_rdev(payload), data);
-		return;
-	}
+	void *fdt_blob = NULL;
+	void *fdt_src = fdt_data(config->fdt);
+	if (fdt_src && !config->overlays.next && !device_tree_fixups.next)
+		fdt_blob = edit_fdt(fdt_src, config->ramdisk);
+
+	if (fdt_blob) {
+		fdt.size = be32toh(((struct fdt_header *)fdt_blob)->totalsize);
+	} else {
+		dt = fdt_src ? fdt_unflatten(fdt_src) : NULL;
+		if (!dt) {
+			printk(BIOS_ERR, "ERROR: Failed to unflatten the FDT.\n");
+			rdev_munmap(prog_rdev(payload), data);
+			return;
+		}
 
-	struct fit_overlay_chain *chain;
-	list_for_each(chain, config->overlays, list_node) {
-		struct device_tree *overlay = unpack_fdt(chain->overlay);
-		if (!overlay || dt_apply_overlay(dt, overlay)) {
-			printk(BIOS_ERR, "ERROR: Failed to apply overlay %s!\n",
-			       chain->overlay->name);
+		struct fit_overlay_chain *chain;
+		list_for_each(chain, config->overlays, list_node) {
+			struct device_tree *overlay = unpack_fdt(chain->overlay);
+			if (!overlay || dt_apply_overlay(dt, overlay)) {
+				printk(BIOS_ERR, "ERROR: Failed to apply overlay %s!\n",
+				       chain->overlay->name);
+			}
 		}
-	}
 
-	dt_apply_fixups(dt);
+		dt_apply_fixups(dt);
 
-	/* Insert coreboot specific information */
-	add_cb_fdt_data(dt);
+		/* Insert coreboot specific information */
+		add_cb_fdt_data(dt);
 
-	/* Update device_tree */
+		/* Update device_tree */
 #if defined(CONFIG_LINUX_COMMAND_LINE)
-	fit_update_chosen(dt, (char *)CONFIG_LINUX_COMMAND_LINE);
+		fit_update_chosen(dt, (char *)CONFIG_LINUX_COMMAND_LINE);
 #endif
-	fit_update_memory(dt);
+		fit_update_memory(dt);
+
+		fdt.size = dt_flat_size(dt);
+	}
 
 	/* Collect infos for fit_payload_arch */
 	kernel.size = config->kernel->size;
-	fdt.size = dt_flat_size(dt);
 	initrd.size = config->ramdisk ? config->ramdisk->size : 0;
 
 	/* Invoke arch specific payload placement and fixups */
@@ -229,12 +352,20 @@ void fit_payload(struct prog *payload)
 		return;
 	}
 
-	/* Update ramdisk location in FDT */
-	if (config->ramdisk)
-		fit_add_ramdisk(dt, (void *)initrd.offset, initrd.size);
+	if (fdt_blob) {
+		/* Update ramdisk location in FDT */
+		if (config->ramdisk)
+			fit_add_ramdisk_flat(fdt_blob, (void *)initrd.offset, initrd.size);
+
+		copy_fdt(&fdt, fdt_blob);
+	} else {
+		/* Update ramdisk location in FDT */
+		if (config->ramdisk)
+			fit_add_ramdisk(dt, (void *)initrd.offset, initrd.size);
 
-	/* Repack FDT for handoff to kernel */
-	pack_fdt(&fdt, dt);
+		/* Repack FDT for handoff to kernel */
+		pack_fdt(&fdt, dt);
+	}
 
 	if (config->ramdisk &&
 	    extract(&initrd, config->ramdisk)) {
@@ -17,6 +17,7 @@
 #include <device/device.h>
 #include <device/pci.h>
 #include <delay.h>
+#include <hw_access.h>
 #include <stdlib.h>
 #include <boot/tables.h>
 #include <program_loading.h>
@@ -166,6 +167,8 @@ static boot_state_t bs_os_resume_check(void *arg)
 
 static boot_state_t bs_os_resume(void *wake_vector)
 {
+	timestamp_add_now(TS_OS_RESUME);
+
 	if (CONFIG(HAVE_ACPI_RESUME)) {
 		arch_bootstate_coreboot_exit();
 		acpi_resume(wake_vector);
@@ -198,6 +201,7 @@ static boot_state_t bs_payload_load(void *arg)
 
 static boot_state_t bs_payload_boot(void *arg)
 {
+	console_time_report();
 	arch_bootstate_coreboot_exit();
 	payload_run();
 
@@ -349,12 +353,16 @@ static void bs_walk_state_machine(void)
 			printk(BIOS_DEBUG,
 				"----------------------------------------\n");
 
+		console_drain();
+
 		/* Update the current phase with new state id and sequence. */
 		current_phase.state_id = next_id;
 		current_phase.seq = BS_ON_ENTRY;
 
 		bs_sample_time(state);
 
+		hw_access_boot_state_done(state->name);
+
 		state->complete = 1;
 	}
 }
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <bootstate.h>
+#include <cbmem.h>
+#include <console/console.h>
+#include <hw_access.h>
+#include <stdbool.h>
+#include <string.h>
+#include <timestamp.h>
+
+static const char *const type_names[] = HW_ACCESS_TYPE_NAMES;
+
+/*
+ * Counters of the boot state that is currently running. Accesses from APs running in
+ * parallel are accounted without locking, so counts may be slightly off during MP init.
+ */
+static struct hw_access_counter current[HW_ACCESS_TYPES];
+static struct hw_access_table *table;
+
+/* Some platforms read the timestamp through MMIO, don't account for that recursively. */
+static bool in_timestamp;
+
+static uint64_t hw_access_timestamp_get(void)
+{
+	uint64_t now;
+
+	in_timestamp = true;
+	now = timestamp_get();
+	in_timestamp = false;
+
+	return now;
+}
+
+uint64_t hw_access_timestamp(void)
+{
+	if (in_timestamp)
+		return 0;
+
+	return hw_access_timestamp_get();
+}
+
+void hw_access_account(enum hw_access_type type, uint64_t start)
+{
+	if (in_timestamp)
+		return;
+
+	current[type].count++;
+	current[type].ticks += hw_access_timestamp_get() - start;
+}
+
+static struct hw_access_table *hw_access_table(void)
+{
+	const size_t max_entries = BS_PAYLOAD_BOOT + 1;
+
+	if (table)
+		return table;
+
+	table = cbmem_add(CBMEM_ID_HW_ACCESS, sizeof(*table) +
+			  max_entries * sizeof(table->entries[0]));
+	if (!table)
+		return NULL;
+
+	memset(table, 0, sizeof(*table));
+	table->max_entries = max_entries;
+	table->tick_freq_mhz = timestamp_tick_freq_mhz();
+
+	return table;
+}
+
+void hw_access_boot_state_done(const char *name)
+{
+	struct hw_access_table *t = hw_access_table();
+	struct hw_access_counter snapshot[HW_ACCESS_TYPES];
+	struct hw_access_state_entry *e;
+	int freq_mhz = timestamp_tick_freq_mhz();
+	size_t i;
+
+	memcpy(snapshot, current, sizeof(snapshot));
+
+	if (t && t->num_entries < t->max_entries) {
+		e = &t->entries[t->num_entries++];
+		strncpy(e->name, name, sizeof(e->name) - 1);
+		memcpy(e->counters, snapshot, sizeof(e->counters));
+	}
+
+	printk(BIOS_DEBUG, "HW: %s accesses:", name);
+	for (i = 0; i < HW_ACCESS_TYPES; i++) {
+		printk(BIOS_DEBUG, " %s %u", type_names[i], snapshot[i].count);
+		if (freq_mhz > 0)
+			printk(BIOS_DEBUG, " (%llu us)", snapshot[i].ticks / freq_mhz);
+	}
+	printk(BIOS_DEBUG, "\n");
+
+	/* Drop the accesses of the report itself, e.g. a UART console. */
+	memset(current, 0, sizeof(current));
+}
@@ -377,12 +377,15 @@ struct range_entry *memranges_next_entry(struct memranges *ranges,
 }
 
 /* Find a range entry that satisfies the given constraints to fit a hole that matches the
- * required alignment, is big enough, does not exceed the limit and has a matching tag. */
+ * required alignment, is big enough, does not exceed the limit and has a matching tag. If
+ * from_top is set, the highest suitable hole is returned instead of the lowest one. The base
+ * address of the hole is written to hole_base. */
 static const struct range_entry *memranges_find_entry(struct memranges *ranges,
 						      resource_t limit, resource_t size,
-						      unsigned char align, unsigned long tag)
+						      unsigned char align, unsigned long tag,
+						      bool from_top, resource_t *hole_base)
 {
-	const struct range_entry *r;
+	const struct range_entry *r, *found = NULL;
 	resource_t base, end;
 
 	if (size == 0)
@@ -393,6 +396,27 @@ static const struct range_entry *memranges_find_entry(struct memranges *ranges,
 		if (r->tag != tag)
 			continue;
 
+		if (from_top) {
+			/*
+			 * All following range entries start above this one, so none of them
+			 * can satisfy the request if this one already starts above the limit.
+			 */
+			if (r->begin > limit)
+				break;
+
+			end = MIN(r->end, limit);
+			if (end - r->begin + 1 < size)
+				continue;
+
+			base = ALIGN_DOWN(end - size + 1, POWER_OF_2(align));
+			if (base < r->begin)
+				continue;
+
+			found = r;
+			*hole_base = base;
+			continue;
+		}
+
 		base = ALIGN_UP(r->begin, POWER_OF_2(align));
 		end = base + size - 1;
 
@@ -407,23 +431,24 @@ static const struct range_entry *memranges_find_entry(struct memranges *ranges,
 		if (end > limit)
 			break;
 
+		*hole_base = base;
 		return r;
 	}
 
-	return NULL;
+	return found;
 }
 
 bool memranges_steal(struct memranges *ranges, resource_t limit, resource_t size,
-			unsigned char align, unsigned long tag, resource_t *stolen_base)
+			unsigned char align, unsigned long tag, resource_t *stolen_base,
+			bool from_top)
 {
 	resource_t base;
-	const struct range_entry *r = memranges_find_entry(ranges, limit, size, align, tag);
+	const struct range_entry *r = memranges_find_entry(ranges, limit, size, align, tag,
+							   from_top, &base);
 
 	if (r == NULL)
 		return false;
 
-	base = ALIGN_UP(r->begin, POWER_OF_2(align));
-
 	memranges_create_hole(ranges, base, size);
 	*stolen_base = base;
 
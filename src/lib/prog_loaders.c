@@ -205,6 +205,8 @@ void payload_run(void)
 	 */
 	checkstack(_estack, 0);
 
+	console_drain();
+
 	prog_run(payload);
 }
 
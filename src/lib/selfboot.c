@@ -80,6 +80,15 @@ static int load_one_segment(uint8_t *dest,
 				return 0;
 			break;
 		}
+		case CBFS_COMPRESS_ZSTD: {
+			printk(BIOS_DEBUG, "using Zstandard\n");
+			timestamp_add_now(TS_START_UZSTD);
+			len = uzstdn(src, len, dest, memsz);
+			timestamp_add_now(TS_END_UZSTD);
+			if (!len) /* Decompression Error. */
+				return 0;
+			break;
+		}
 		case CBFS_COMPRESS_NONE: {
 			printk(BIOS_DEBUG, "it's not compressed!\n");
 			memcpy(dest, src, len);
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <stage_cache.h>
+#include <string.h>
+
+#define FNV_OFFSET	0x811c9dc5
+#define FNV_PRIME	0x01000193
+
+/*
+ * FNV-1a over 32-bit words instead of bytes. It only has to catch a corrupted copy of a
+ * stage, and hashing a whole ramstage has to stay well below the cost of loading it.
+ */
+uint32_t stage_cache_hash(const void *data, size_t size)
+{
+	const uint8_t *p = data;
+	uint32_t hash = FNV_OFFSET;
+	uint32_t word;
+
+	for (; size >= sizeof(word); size -= sizeof(word), p += sizeof(word)) {
+		memcpy(&word, p, sizeof(word));
+		hash = (hash ^ word) * FNV_PRIME;
+	}
+
+	while (size--)
+		hash = (hash ^ *p++) * FNV_PRIME;
+
+	return hash;
+}
@@ -104,14 +104,16 @@ static inline void free_thread(struct thread *t)
 }
 
 /* The idle thread is ran whenever there isn't anything else that is runnable.
- * It's sole responsibility is to ensure progress is made by running the timer
- * callbacks. */
+ * Its main responsibility is to ensure progress is made by running the timer
+ * callbacks. In between, it writes out deferred console output. */
 static void idle_thread(void *unused)
 {
 	/* This thread never voluntarily yields. */
 	thread_prevent_coop();
-	while (1)
+	while (1) {
 		timers_run();
+		console_drain_idle();
+	}
 }
 
 static void schedule(struct thread *t)
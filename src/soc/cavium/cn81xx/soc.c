@@ -85,6 +85,7 @@ static void dt_platform_fixup_phy(struct device_tree_node *node, char *path,
 		       node->name);
 		/* No match, remove node */
 		list_remove(&node->list_node);
+		dt_nodes_changed();
 	}
 }
 
@@ -145,6 +146,7 @@ static void dt_platform_fixup_mac(struct device_tree_node *node)
 
 	printk(BIOS_INFO, "%s: Removing node %s\n", __func__, node->name);
 	list_remove(&node->list_node);
+	dt_nodes_changed();
 }
 
 static void dt_iterate_mac(struct device_tree_node *parent)
@@ -206,6 +208,7 @@ static int dt_platform_fixup(struct device_tree_fixup *fixup,
 		}
 		printk(BIOS_INFO, "%s: Removing node %s\n", __func__, path);
 		list_remove(&dt_node->list_node);
+		dt_nodes_changed();
 	}
 
 	/* Remove unused PEM entries */
@@ -224,6 +227,7 @@ static int dt_platform_fixup(struct device_tree_fixup *fixup,
 		phandle = dt_node->phandle;
 		printk(BIOS_INFO, "%s: Removing node %s\n", __func__, path);
 		list_remove(&dt_node->list_node);
+		dt_nodes_changed();
 
 		/* Remove phandle to non existing nodes */
 		snprintf(path, sizeof(path), "/soc@0/smmu0@%llx", SMMU_PF_BAR0);
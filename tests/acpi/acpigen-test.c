@@ -0,0 +1,628 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <acpi/acpigen.h>
+#include <acpi/acpi_pld.h>
+#include <device/device.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <tests/test.h>
+
+/*
+ * Host test bench for acpigen. Representative SSDT contents are generated with the acpigen
+ * helpers and checked for structural validity with a small AML walker: package lengths have
+ * to match the nesting, package element counts have to match their contents and every name
+ * segment has to be valid. The size of every generated table is compared against a budget,
+ * so changes that bloat the AML the OS has to parse on every boot fail here.
+ */
+
+#define ACPIGEN_TEST_BUFFER_SZ		(512 * KiB)
+
+static char *buffer;
+
+/* Not needed by the tests, but referenced by acpigen. */
+void search_global_resources(unsigned long type_mask, unsigned long type,
+			     resource_search_t search, void *gp)
+{
+}
+
+struct aml_stats {
+	size_t terms;
+	size_t methods;
+	size_t max_depth;
+	const uint8_t *error;
+};
+
+static bool valid_nameseg(const uint8_t *p)
+{
+	int i;
+
+	if (!(p[0] == '_' || (p[0] >= 'A' && p[0] <= 'Z')))
+		return false;
+
+	for (i = 1; i < 4; i++)
+		if (!(p[i] == '_' || (p[i] >= 'A' && p[i] <= 'Z') || (p[i] >= '0' && p[i] <= '9')))
+			return false;
+
+	return true;
+}
+
+static bool is_name_start(uint8_t c)
+{
+	return c == '\\' || c == '^' || c == '_' || (c >= 'A' && c <= 'Z') ||
+	       c == DUAL_NAME_PREFIX || c == MULTI_NAME_PREFIX;
+}
+
+/* PkgLength counts from its own first byte. Returns the first byte after it. */
+static const uint8_t *parse_pkglength(const uint8_t *p, const uint8_t *end,
+				      const uint8_t **pkg_end)
+{
+	size_t follow, len, i;
+
+	if (p >= end)
+		return NULL;
+
+	follow = p[0] >> 6;
+	if (p + follow + 1 > end)
+		return NULL;
+
+	if (!follow) {
+		len = p[0] & 0x3f;
+	} else {
+		if (p[0] & 0x30)
+			return NULL;
+		len = p[0] & 0xf;
+		for (i = 1; i <= follow; i++)
+			len |= (size_t)p[i] << (4 + 8 * (i - 1));
+	}
+
+	if (len < follow + 1 || p + len > end)
+		return NULL;
+
+	*pkg_end = p + len;
+	return p + follow + 1;
+}
+
+static const uint8_t *parse_namestring(const uint8_t *p, const uint8_t *end)
+{
+	size_t segs = 1;
+
+	if (p < end && *p == '\\')
+		p++;
+	else
+		while (p < end && *p == '^')
+			p++;
+
+	if (p >= end)
+		return NULL;
+
+	if (*p == ZERO_OP)
+		return p + 1;
+
+	if (*p == DUAL_NAME_PREFIX) {
+		segs = 2;
+		p++;
+	} else if (*p == MULTI_NAME_PREFIX) {
+		if (p + 2 > end || !p[1])
+			return NULL;
+		segs = p[1];
+		p += 2;
+	}
+
+	while (segs--) {
+		if (p + 4 > end || !valid_nameseg(p))
+			return NULL;
+		p += 4;
+	}
+
+	return p;
+}
+
+static const uint8_t *parse_term(struct aml_stats *stats, const uint8_t *p,
+				 const uint8_t *end, size_t depth);
+
+static const uint8_t *parse_term_list(struct aml_stats *stats, const uint8_t *p,
+				      const uint8_t *end, size_t depth)
+{
+	while (p && p < end)
+		p = parse_term(stats, p, end, depth);
+
+	return p == end ? p : NULL;
+}
+
+static const uint8_t *parse_terms(struct aml_stats *stats, const uint8_t *p,
+				  const uint8_t *end, size_t depth, int count)
+{
+	while (p && count--)
+		p = parse_term(stats, p, end, depth);
+
+	return p;
+}
+
+static const uint8_t *parse_integer_value(const uint8_t *p, const uint8_t *end, uint64_t *val)
+{
+	size_t size, i;
+
+	switch (*p) {
+	case ZERO_OP:
+		*val = 0;
+		return p + 1;
+	case ONE_OP:
+		*val = 1;
+		return p + 1;
+	case BYTE_PREFIX:
+		size = 1;
+		break;
+	case WORD_PREFIX:
+		size = 2;
+		break;
+	case DWORD_PREFIX:
+		size = 4;
+		break;
+	case QWORD_PREFIX:
+		size = 8;
+		break;
+	default:
+		return NULL;
+	}
+
+	if (p + 1 + size > end)
+		return NULL;
+
+	*val = 0;
+	for (i = 0; i < size; i++)
+		*val |= (uint64_t)p[1 + i] << (8 * i);
+
+	return p + 1 + size;
+}
+
+/* Package elements are data objects or names, so a name must not consume arguments. */
+static const uint8_t *parse_package(struct aml_stats *stats, const uint8_t *p,
+				    const uint8_t *end, size_t depth)
+{
+	const uint8_t *pkg_end;
+	size_t num, count = 0;
+
+	p = parse_pkglength(p, end, &pkg_end);
+	if (!p || p >= pkg_end)
+		return NULL;
+
+	num = *p++;
+	while (p && p < pkg_end) {
+		if (is_name_start(*p))
+			p = parse_namestring(p, pkg_end);
+		else
+			p = parse_term(stats, p, pkg_end, depth);
+		count++;
+	}
+
+	if (p != pkg_end || count != num)
+		return NULL;
+
+	return p;
+}
+
+static const uint8_t *parse_buffer(struct aml_stats *stats, const uint8_t *p,
+				   const uint8_t *end, size_t depth)
+{
+	const uint8_t *pkg_end;
+	uint64_t size;
+
+	p = parse_pkglength(p, end, &pkg_end);
+	if (!p)
+		return NULL;
+
+	p = parse_integer_value(p, pkg_end, &size);
+	if (!p || size < (size_t)(pkg_end - p))
+		return NULL;
+
+	return pkg_end;
+}
+
+static const uint8_t *parse_ext_term(struct aml_stats *stats, const uint8_t *p,
+				     const uint8_t *end, size_t depth)
+{
+	const uint8_t *pkg_end;
+
+	if (p >= end)
+		return NULL;
+
+	switch (*p++) {
+	case DEVICE_OP:
+		p = parse_pkglength(p, end, &pkg_end);
+		if (p)
+			p = parse_namestring(p, pkg_end);
+		return p ? parse_term_list(stats, p, pkg_end, depth) : NULL;
+	case PROCESSOR_OP:
+		p = parse_pkglength(p, end, &pkg_end);
+		if (p)
+			p = parse_namestring(p, pkg_end);
+		/* ProcID, PblkAddr and PblkLen */
+		if (!p || p + 6 > pkg_end)
+			return NULL;
+		return parse_term_list(stats, p + 6, pkg_end, depth);
+	case MUTEX_OP:
+		p = parse_namestring(p, end);
+		return p && p < end ? p + 1 : NULL;
+	case SLEEP_OP:
+	case STALL_OP:
+		return parse_term(stats, p, end, depth);
+	default:
+		return NULL;
+	}
+}
+
+static const uint8_t *parse_term(struct aml_stats *stats, const uint8_t *p,
+				 const uint8_t *end, size_t depth)
+{
+	const uint8_t *start = p, *pkg_end;
+	uint64_t val;
+
+	if (p >= end)
+		return NULL;
+
+	stats->terms++;
+	stats->max_depth = MAX(stats->max_depth, depth);
+
+	switch (*p) {
+	case ZERO_OP:
+	case ONE_OP:
+	case BYTE_PREFIX:
+	case WORD_PREFIX:
+	case DWORD_PREFIX:
+	case QWORD_PREFIX:
+		p = parse_integer_value(p, end, &val);
+		break;
+	case ONES_OP:
+	case LOCAL0_OP ... LOCAL7_OP:
+	case ARG0_OP ... ARG6_OP:
+		p++;
+		break;
+	case STRING_PREFIX:
+		for (p++; p < end && *p && *p < 0x80; p++)
+			;
+		p = p < end && !*p ? p + 1 : NULL;
+		break;
+	case NAME_OP:
+		p = parse_namestring(p + 1, end);
+		if (p)
+			p = parse_term(stats, p, end, depth);
+		break;
+	case SCOPE_OP:
+		p = parse_pkglength(p + 1, end, &pkg_end);
+		if (p)
+			p = parse_namestring(p, pkg_end);
+		if (p)
+			p = parse_term_list(stats, p, pkg_end, depth + 1);
+		break;
+	case METHOD_OP:
+		stats->methods++;
+		p = parse_pkglength(p + 1, end, &pkg_end);
+		if (p)
+			p = parse_namestring(p, pkg_end);
+		/* Method flags */
+		if (p && p < pkg_end)
+			p = parse_term_list(stats, p + 1, pkg_end, depth + 1);
+		else
+			p = NULL;
+		break;
+	case PACKAGE_OP:
+		p = parse_package(stats, p + 1, end, depth + 1);
+		break;
+	case BUFFER_OP:
+		p = parse_buffer(stats, p + 1, end, depth + 1);
+		break;
+	case IF_OP:
+		p = parse_pkglength(p + 1, end, &pkg_end);
+		if (p)
+			p = parse_term(stats, p, pkg_end, depth + 1);
+		if (p)
+			p = parse_term_list(stats, p, pkg_end, depth + 1);
+		break;
+	case ELSE_OP:
+		p = parse_pkglength(p + 1, end, &pkg_end);
+		if (p)
+			p = parse_term_list(stats, p, pkg_end, depth + 1);
+		break;
+	case RETURN_OP:
+	case LNOT_OP:
+		p = parse_term(stats, p + 1, end, depth);
+		break;
+	case STORE_OP:
+	case LEQUAL_OP:
+	case LGREATER_OP:
+	case LLESS_OP:
+	case LAND_OP:
+	case LOR_OP:
+		p = parse_terms(stats, p + 1, end, depth, 2);
+		break;
+	case ADD_OP:
+	case SUBTRACT_OP:
+	case AND_OP:
+	case OR_OP:
+	case XOR_OP:
+	case SHIFT_LEFT_OP:
+	case SHIFT_RIGHT_OP:
+		/* Two operands and a target, which may be a null name */
+		p = parse_terms(stats, p + 1, end, depth, 2);
+		if (p && p < end && *p == ZERO_OP)
+			p++;
+		else
+			p = parse_term(stats, p, end, depth);
+		break;
+	case EXT_OP_PREFIX:
+		p = parse_ext_term(stats, p + 1, end, depth + 1);
+		break;
+	default:
+		/* Name references. Method invocations with arguments are not generated here. */
+		if (is_name_start(*p))
+			p = parse_namestring(p, end);
+		else
+			p = NULL;
+		break;
+	}
+
+	if (!p && !stats->error)
+		stats->error = start;
+
+	return p;
+}
+
+static void check_aml(const char *name, const char *start, const char *end,
+		      struct aml_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	if (!parse_term_list(stats, (const uint8_t *)start, (const uint8_t *)end, 0))
+		fail_msg("%s: invalid AML at offset %#zx (opcode %#x)", name,
+			 stats->error ? (size_t)(stats->error - (const uint8_t *)start) : 0,
+			 stats->error ? *stats->error : 0);
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+/*
+ * Generate AML with |gen| into the test buffer, validate it and compare its size to the
+ * budget. The generation time is only printed, it depends on the host. Returns the size of
+ * the generated AML.
+ */
+static size_t run_bench(const char *name, void (*gen)(size_t), size_t count, bool optimize,
+			size_t budget)
+{
+	struct aml_stats stats;
+	double start, elapsed;
+	size_t size;
+
+	acpigen_set_optimize(optimize);
+	acpigen_set_current(buffer);
+	start = now_us();
+	gen(count);
+	elapsed = now_us() - start;
+	size = acpigen_get_current() - buffer;
+
+	check_aml(name, buffer, acpigen_get_current(), &stats);
+
+	print_message("%-12s x%-3zu %-9s %7zu bytes, %6zu terms, %4zu methods, depth %zu, "
+		      "%.1f us\n", name, count, optimize ? "optimized" : "", size, stats.terms,
+		      stats.methods, stats.max_depth, elapsed);
+
+	if (size > budget)
+		fail_msg("%s: %zu bytes of AML exceed the budget of %zu bytes", name, size,
+			 budget);
+
+	return size;
+}
+
+/* Run a bench without and with optimizations, which have to account for the difference. */
+static void run_benches(const char *name, void (*gen)(size_t), size_t count, size_t budget,
+			size_t optimized_budget)
+{
+	size_t size, optimized;
+
+	size = run_bench(name, gen, count, false, budget);
+	assert_int_equal(acpigen_get_saved(), 0);
+
+	optimized = run_bench(name, gen, count, true, optimized_budget);
+	assert_int_equal(acpigen_get_saved(), size - optimized);
+	acpigen_set_optimize(false);
+}
+
+static void gen_cpus(size_t count)
+{
+	acpi_cstate_t cstates[] = {
+		{ .ctype = 1, .latency = 1, .power = 1000,
+		  .resource = { .space_id = ACPI_ADDRESS_SPACE_FIXED, .bit_width = 1,
+				.bit_offset = 2, .addrl = 0x00 } },
+		{ .ctype = 2, .latency = 59, .power = 900,
+		  .resource = { .space_id = ACPI_ADDRESS_SPACE_FIXED, .bit_width = 1,
+				.bit_offset = 2, .addrl = 0x10 } },
+		{ .ctype = 3, .latency = 80, .power = 800,
+		  .resource = { .space_id = ACPI_ADDRESS_SPACE_FIXED, .bit_width = 1,
+				.bit_offset = 2, .addrl = 0x20 } },
+	};
+	struct acpi_sw_pstate pstates[8];
+	size_t cpu, i;
+
+	for (i = 0; i < ARRAY_SIZE(pstates); i++) {
+		pstates[i].core_freq = 3600 - i * 200;
+		pstates[i].power = 35000 - i * 3000;
+		pstates[i].transition_latency = 10;
+		pstates[i].bus_master_latency = 10;
+		pstates[i].control_value = (36 - i * 2) << 8;
+		pstates[i].status_value = 0;
+	}
+
+	for (cpu = 0; cpu < count; cpu++) {
+		acpigen_write_processor(cpu, 0, 0);
+		acpigen_write_pss_object(pstates, ARRAY_SIZE(pstates));
+		acpigen_write_PPC_NVS();
+		acpigen_write_CST_package(cstates, ARRAY_SIZE(cstates));
+		acpigen_write_PSD_package(cpu / 2, 2, HW_ALL);
+		acpigen_pop_len();
+	}
+}
+
+static void gen_usb_ports(size_t count)
+{
+	struct acpi_pld pld;
+	char name[5];
+	size_t port;
+
+	acpigen_write_scope("\\_SB.PCI0.XHCI.RHUB");
+	for (port = 0; port < count; port++) {
+		snprintf(name, sizeof(name), "HS%02zu", port + 1);
+		acpigen_write_device(name);
+		acpigen_write_name_integer("_ADR", port + 1);
+		acpigen_write_upc(port % 4 ? UPC_TYPE_A : UPC_TYPE_INTERNAL);
+		acpi_pld_fill_usb(&pld, port % 4 ? UPC_TYPE_A : UPC_TYPE_INTERNAL,
+				  &(struct acpi_pld_group)ACPI_PLD_GROUP(port / 2, port % 2));
+		acpigen_write_pld(&pld);
+		acpigen_pop_len();
+	}
+	acpigen_pop_len();
+}
+
+static void gen_pcie_ports(size_t count)
+{
+	char name[5];
+	size_t port;
+
+	acpigen_write_scope("\\_SB.PCI0");
+	for (port = 0; port < count; port++) {
+		snprintf(name, sizeof(name), "RP%02zu", port + 1);
+		acpigen_write_device(name);
+		acpigen_write_name_dword("_ADR", ((0x1c + port / 8) << 16) | (port % 8));
+		acpigen_write_STA(ACPI_STATUS_DEVICE_ALL_ON);
+
+		acpigen_write_method_serialized("_PS0", 0);
+		acpigen_write_if_lequal_op_int(ARG0_OP, 1);
+		acpigen_write_store_ops(ONE_OP, LOCAL0_OP);
+		acpigen_pop_len(); /* If */
+		acpigen_write_else();
+		acpigen_write_store_ops(ZERO_OP, LOCAL0_OP);
+		acpigen_pop_len(); /* Else */
+		acpigen_write_return_op(LOCAL0_OP);
+		acpigen_pop_len(); /* Method */
+
+		acpigen_pop_len(); /* Device */
+	}
+	acpigen_pop_len();
+}
+
+/* Budgets are the current output sizes. Lower them when the generated AML shrinks. */
+static void test_acpigen_cpus(void **state)
+{
+	run_benches("cpus", gen_cpus, 8, 3904, 984);
+	run_benches("cpus", gen_cpus, 64, 31232, 6472);
+}
+
+static void test_acpigen_usb_ports(void **state)
+{
+	run_benches("usb ports", gen_usb_ports, 16, 1110, 969);
+}
+
+static void test_acpigen_pcie_ports(void **state)
+{
+	run_benches("pcie ports", gen_pcie_ports, 24, 1430, 1189);
+}
+
+static void test_acpigen_shared(void **state)
+{
+	/* Method (_PSS, 0, NotSerialized) { Return (\_SB.CP00._PSS) } */
+	const char ref[] = { METHOD_OP, 22, '_', 'P', 'S', 'S', 0, RETURN_OP, '\\',
+			     MULTI_NAME_PREFIX, 3, '_', 'S', 'B', '_', 'C', 'P', '0', '0',
+			     '_', 'P', 'S', 'S' };
+	char *p;
+
+	run_bench("shared", gen_cpus, 2, true, ACPIGEN_TEST_BUFFER_SZ);
+	acpigen_set_optimize(false);
+
+	/* The second processor refers to the objects of the first one. */
+	for (p = buffer; p + sizeof(ref) <= acpigen_get_current(); p++)
+		if (!memcmp(p, ref, sizeof(ref)))
+			return;
+
+	fail_msg("No reference to \\_SB.CP00._PSS");
+}
+
+static void test_acpigen_nesting(void **state)
+{
+	struct aml_stats stats;
+	int i;
+
+	/* The length stack has room for nine open objects. */
+	acpigen_set_current(buffer);
+	for (i = 0; i < 9; i++)
+		acpigen_write_scope("\\_SB");
+	for (i = 0; i < 9; i++)
+		acpigen_pop_len();
+
+	check_aml("nesting", buffer, acpigen_get_current(), &stats);
+	/* The outermost scope is at depth 0. */
+	assert_int_equal(stats.max_depth, 8);
+}
+
+static void test_acpigen_integers(void **state)
+{
+	const uint64_t values[] = { 0, 1, 0xff, 0x100, 0xffff, 0x10000, 0xffffffff,
+				    0x100000000ULL };
+	const size_t sizes[] = { 1, 1, 2, 3, 3, 5, 5, 9 };
+	char *start;
+	size_t i;
+
+	/* Every integer has to use the shortest encoding. */
+	acpigen_set_current(buffer);
+	for (i = 0; i < ARRAY_SIZE(values); i++) {
+		start = acpigen_get_current();
+		acpigen_write_integer(values[i]);
+		assert_int_equal(acpigen_get_current() - start, sizes[i]);
+	}
+}
+
+static void test_acpigen_name_zero_one(void **state)
+{
+	/* Name (ZERO, Zero) and Name (ONE_, One) */
+	const char expected[] = { NAME_OP, 'Z', 'E', 'R', 'O', ZERO_OP,
+				  NAME_OP, 'O', 'N', 'E', '_', ONE_OP };
+
+	acpigen_set_current(buffer);
+	acpigen_write_name_zero("ZERO");
+	acpigen_write_name_one("ONE_");
+	assert_int_equal(acpigen_get_current() - buffer, sizeof(expected));
+	assert_memory_equal(buffer, expected, sizeof(expected));
+}
+
+static int setup_acpigen(void **state)
+{
+	buffer = malloc(ACPIGEN_TEST_BUFFER_SZ);
+	return buffer ? 0 : -1;
+}
+
+static int teardown_acpigen(void **state)
+{
+	free(buffer);
+	return 0;
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_acpigen_integers),
+		cmocka_unit_test(test_acpigen_name_zero_one),
+		cmocka_unit_test(test_acpigen_nesting),
+		cmocka_unit_test(test_acpigen_cpus),
+		cmocka_unit_test(test_acpigen_usb_ports),
+		cmocka_unit_test(test_acpigen_pcie_ports),
+		cmocka_unit_test(test_acpigen_shared),
+	};
+
+	return cmocka_run_group_tests(tests, setup_acpigen, teardown_acpigen);
+}
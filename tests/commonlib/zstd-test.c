@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <commonlib/bsd/compression.h>
+#include <stdint.h>
+#include <string.h>
+#include <tests/test.h>
+
+/* Test vectors were made with the zstd command line tool: text_zst is the
+   output of fill_text(4096) at level 19, zero_zst is 3000 zero bytes and
+   raw_zst is "coreboot". */
+static const uint8_t text_zst[] = {
+	0x28, 0xb5, 0x2f, 0xfd, 0x64, 0x00, 0x0f, 0x6d, 0x09, 0x00, 0xa2, 0x8e,
+	0x22, 0x14, 0xa0, 0xa9, 0x0d, 0x88, 0x12, 0x81, 0xa5, 0xf5, 0xb4, 0x50,
+	0xf9, 0x96, 0x12, 0xf4, 0xb4, 0x72, 0x7d, 0xff, 0xb7, 0x06, 0x08, 0x12,
+	0xb6, 0x08, 0xf3, 0x0a, 0xb2, 0x8d, 0xe7, 0xa5, 0xef, 0x43, 0x76, 0x76,
+	0x67, 0x0f, 0xeb, 0x6e, 0xe3, 0xde, 0xcb, 0x45, 0xd5, 0x2a, 0x9e, 0xed,
+	0x8e, 0x83, 0xed, 0x67, 0x2d, 0x55, 0xf2, 0xd3, 0xca, 0x8c, 0x12, 0x4f,
+	0xd5, 0xb0, 0xb6, 0xed, 0xae, 0xce, 0x9e, 0xed, 0x47, 0x04, 0x60, 0x05,
+	0xaa, 0x65, 0x8c, 0x3c, 0xa9, 0xae, 0x15, 0xc9, 0x8a, 0x44, 0x4f, 0xfb,
+	0xf3, 0x43, 0x19, 0x1f, 0x74, 0x47, 0x97, 0xcb, 0xcd, 0xc7, 0x99, 0x2a,
+	0xd5, 0xad, 0xa3, 0x0a, 0x32, 0xd2, 0xb9, 0x51, 0x60, 0x39, 0x37, 0x64,
+	0xfa, 0x3c, 0x6b, 0x5a, 0x91, 0x10, 0xe9, 0x28, 0xe6, 0x06, 0x1d, 0x3d,
+	0xee, 0x4a, 0x0c, 0x81, 0x50, 0xf3, 0x83, 0x74, 0xb1, 0x52, 0xaa, 0x2c,
+	0x1e, 0x7e, 0xd2, 0xfc, 0x0b, 0x3a, 0xc7, 0x80, 0xa6, 0xa8, 0x41, 0xec,
+	0xeb, 0x7f, 0x6c, 0x06, 0x60, 0x2f, 0x29, 0xa4, 0x31, 0x02, 0x11, 0x02,
+	0x86, 0x00, 0x4d, 0x90, 0x20, 0x04, 0x0c, 0x42, 0xc0, 0x20, 0x08, 0xc2,
+	0x10, 0x24, 0x04, 0x59, 0x22, 0x20, 0x44, 0x14, 0xea, 0xad, 0x0e, 0x45,
+	0xc7, 0x1e, 0x37, 0x7e, 0x2e, 0xa7, 0x02, 0xad, 0x25, 0xfc, 0xd9, 0xa2,
+	0x14, 0x2c, 0xf3, 0x1d, 0x48, 0x3e, 0xe9, 0x3b, 0x15, 0xed, 0x0c, 0x5b,
+	0x79, 0xe1, 0xb2, 0x99, 0xc9, 0x92, 0x29, 0xba, 0xb8, 0x5d, 0x13, 0x97,
+	0x74, 0x05, 0x03, 0x95, 0x3a, 0xba, 0xbd, 0xc7, 0x92, 0xcd, 0x2e, 0x8d,
+	0xaf, 0x3d, 0xeb, 0xf0, 0xaf, 0x99, 0x61, 0x3c, 0x4e, 0x5e, 0x88, 0x09,
+	0x84, 0xc1, 0x61, 0xd3, 0x24, 0xcd, 0x26, 0x37, 0xbe, 0x24, 0x22, 0xaa,
+	0x3d, 0x58, 0x59, 0x43, 0x03, 0x87, 0x84, 0x20, 0x07, 0xbf, 0xdc, 0xfd,
+	0xee, 0x99, 0x19, 0x4e, 0xc7, 0x4b, 0x0f, 0x96, 0xee, 0x30, 0xd4, 0xb3,
+	0x84, 0x06, 0x0d, 0x69, 0x29, 0x4a, 0x68, 0x94, 0x22, 0xcf, 0x91, 0x4a,
+	0x91, 0x1f, 0x87, 0x49, 0x22, 0x21, 0x8f, 0x0a, 0x74, 0x9b, 0x1a, 0x16,
+	0x9d, 0x79, 0x64,
+};
+
+static const uint8_t zero_zst[] = {
+	0x28, 0xb5, 0x2f, 0xfd, 0x64, 0xb8, 0x0a, 0x4d, 0x00, 0x00, 0x10, 0x00,
+	0x00, 0x01, 0x00, 0xb3, 0xf3, 0x01, 0x16, 0xbd, 0xdb, 0xcb, 0x4f,
+};
+
+static const uint8_t raw_zst[] = {
+	0x28, 0xb5, 0x2f, 0xfd, 0x24, 0x08, 0x41, 0x00, 0x00, 0x63, 0x6f, 0x72,
+	0x65, 0x62, 0x6f, 0x6f, 0x74, 0x92, 0xe0, 0x1c, 0x0b,
+};
+
+static const char text[] = "coreboot loads the payload from CBFS and decompresses it into memory. ";
+
+static void fill_text(uint8_t *buf, size_t size)
+{
+	uint32_t x = 1;
+
+	for (size_t i = 0; i < size; i++) {
+		x = x * 1103515245 + 12345;
+		if (i % 37 == 0)
+			buf[i] = "etaoinsh"[(x >> 16) & 7];
+		else
+			buf[i] = text[(i + i / 251) % (sizeof(text) - 1)];
+	}
+}
+
+static uint8_t expected[4096];
+static uint8_t out[8192];
+
+static void test_uzstdn_text(void **state)
+{
+	fill_text(expected, sizeof(expected));
+
+	memset(out, 0xaa, sizeof(out));
+	assert_int_equal(uzstdn(text_zst, sizeof(text_zst), out, sizeof(out)), sizeof(expected));
+	assert_memory_equal(out, expected, sizeof(expected));
+
+	/* An exactly sized buffer is enough. */
+	memset(out, 0xaa, sizeof(out));
+	assert_int_equal(uzstdn(text_zst, sizeof(text_zst), out, sizeof(expected)),
+			 sizeof(expected));
+	assert_memory_equal(out, expected, sizeof(expected));
+}
+
+static void test_uzstdn_zero(void **state)
+{
+	memset(expected, 0, 3000);
+	memset(out, 0xaa, sizeof(out));
+	assert_int_equal(uzstdn(zero_zst, sizeof(zero_zst), out, sizeof(out)), 3000);
+	assert_memory_equal(out, expected, 3000);
+}
+
+static void test_uzstdn_frames(void **state)
+{
+	static const uint8_t skippable[] = { 0x5a, 0x2a, 0x4d, 0x18, 0x02, 0x00, 0x00, 0x00,
+					     0x12, 0x34 };
+	uint8_t in[sizeof(raw_zst) * 2 + sizeof(skippable)];
+
+	/* Frames are decompressed one after another, skippable frames are ignored. */
+	memcpy(in, raw_zst, sizeof(raw_zst));
+	memcpy(in + sizeof(raw_zst), skippable, sizeof(skippable));
+	memcpy(in + sizeof(raw_zst) + sizeof(skippable), raw_zst, sizeof(raw_zst));
+	assert_int_equal(uzstdn(in, sizeof(in), out, sizeof(out)), 16);
+	assert_memory_equal(out, "corebootcoreboot", 16);
+}
+
+static void test_uzstdn_errors(void **state)
+{
+	uint8_t in[sizeof(text_zst)];
+
+	/* Output buffer too small */
+	assert_int_equal(uzstdn(text_zst, sizeof(text_zst), out, sizeof(expected) - 1), 0);
+	assert_int_equal(uzstdn(raw_zst, sizeof(raw_zst), out, 7), 0);
+
+	/* Truncated input */
+	assert_int_equal(uzstdn(text_zst, sizeof(text_zst) - 8, out, sizeof(out)), 0);
+	assert_int_equal(uzstdn(raw_zst, 3, out, sizeof(out)), 0);
+
+	/* Bad magic */
+	memcpy(in, text_zst, sizeof(text_zst));
+	in[0] ^= 1;
+	assert_int_equal(uzstdn(in, sizeof(in), out, sizeof(out)), 0);
+
+	/* Frames that need a dictionary are not supported. */
+	memcpy(in, raw_zst, sizeof(raw_zst));
+	in[4] |= 0x01;
+	assert_int_equal(uzstdn(in, sizeof(raw_zst), out, sizeof(out)), 0);
+
+	/* Corrupted entropy coded data must not decode to the wrong size. */
+	memcpy(in, text_zst, sizeof(text_zst));
+	in[sizeof(text_zst) - 10] ^= 0x10;
+	size_t size = uzstdn(in, sizeof(in), out, sizeof(out));
+	assert_true(size == 0 || size == sizeof(expected));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_uzstdn_text),
+		cmocka_unit_test(test_uzstdn_zero),
+		cmocka_unit_test(test_uzstdn_frames),
+		cmocka_unit_test(test_uzstdn_errors),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,535 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <commonlib/helpers.h>
+#include <console/console.h>
+#include <device/device.h>
+#include <device/pci_def.h>
+#include <device/resource.h>
+#include <string.h>
+#include <tests/test.h>
+#include <time.h>
+
+/*
+ * Host-side harness for the v4 resource allocator. It builds synthetic device trees (domain,
+ * bridges and endpoints with their BAR requirements), runs allocate_resources() on them and
+ * verifies the resulting placement. The large tree test additionally reports allocator
+ * runtime and how much address space is lost to alignment padding inside bridge windows.
+ */
+
+/* Globals normally provided by the sconfig generated static.c */
+DEVTREE_CONST struct device dev_root;
+DEVTREE_CONST struct device *DEVTREE_CONST all_devices = &dev_root;
+struct resource *free_resources;
+struct bus *free_links;
+
+void die(const char *fmt, ...)
+{
+	fail_msg("die() called: %s", fmt);
+	__builtin_unreachable();
+}
+
+#define MAX_DEVICES		2048
+#define MAX_RESOURCES		(MAX_DEVICES * 4)
+
+#define DOMAIN_IO_BASE		0x1000
+#define DOMAIN_IO_LIMIT		0xffff
+#define DOMAIN_MEM_BASE		0xc0000000ULL
+#define DOMAIN_MEM_LIMIT	0x3fffffffffULL
+#define FIXED_MMIO_BASE		0xfe000000ULL
+#define FIXED_MMIO_SIZE		0x02000000ULL
+#define LIMIT_4G		0xffffffffULL
+
+struct test_tree {
+	struct device root;
+	struct bus root_bus;
+	struct device *domain;
+	struct device devices[MAX_DEVICES];
+	struct bus buses[MAX_DEVICES];
+	struct resource resources[MAX_RESOURCES];
+	size_t num_devices;
+	size_t num_buses;
+	size_t num_resources;
+};
+
+static struct test_tree tree;
+
+static struct resource *add_resource(struct device *dev, unsigned long index,
+				     unsigned long flags, resource_t base, resource_t size,
+				     resource_t limit, unsigned char align)
+{
+	struct resource *res, *tail;
+
+	assert_true(tree.num_resources < ARRAY_SIZE(tree.resources));
+	res = &tree.resources[tree.num_resources++];
+
+	res->index = index;
+	res->flags = flags;
+	res->base = base;
+	res->size = size;
+	res->limit = limit;
+	res->align = align;
+	res->gran = align;
+
+	if (!dev->resource_list) {
+		dev->resource_list = res;
+		return res;
+	}
+
+	for (tail = dev->resource_list; tail->next; tail = tail->next)
+		;
+	tail->next = res;
+
+	return res;
+}
+
+static struct bus *add_bus(struct device *dev)
+{
+	struct bus *bus;
+
+	assert_true(tree.num_buses < ARRAY_SIZE(tree.buses));
+	bus = &tree.buses[tree.num_buses++];
+	bus->dev = dev;
+	bus->secondary = tree.num_buses;
+	bus->subordinate = tree.num_buses;
+	dev->link_list = bus;
+
+	return bus;
+}
+
+static struct device *add_device(struct device *parent, enum device_path_type type)
+{
+	struct device *dev, *tail;
+	struct bus *bus = parent->link_list;
+
+	assert_non_null(bus);
+	assert_true(tree.num_devices < ARRAY_SIZE(tree.devices));
+	dev = &tree.devices[tree.num_devices++];
+
+	dev->bus = bus;
+	dev->enabled = 1;
+	dev->path.type = type;
+
+	if (type == DEVICE_PATH_PCI)
+		dev->path.pci.devfn = PCI_DEVFN(tree.num_devices % 32, 0);
+
+	if (!bus->children) {
+		bus->children = dev;
+		return dev;
+	}
+
+	for (tail = (struct device *)bus->children; tail->sibling;
+	     tail = (struct device *)tail->sibling)
+		;
+	tail->sibling = dev;
+
+	return dev;
+}
+
+/* Domain with one I/O and one MEM window, the latter crossing the 4G boundary. */
+static void setup_tree(void)
+{
+	memset(&tree, 0, sizeof(tree));
+
+	tree.root.path.type = DEVICE_PATH_ROOT;
+	tree.root.enabled = 1;
+	tree.root.link_list = &tree.root_bus;
+	tree.root_bus.dev = &tree.root;
+
+	tree.domain = add_device(&tree.root, DEVICE_PATH_DOMAIN);
+	add_bus(tree.domain);
+
+	add_resource(tree.domain, 0, IORESOURCE_IO | IORESOURCE_ASSIGNED, DOMAIN_IO_BASE,
+		     0, DOMAIN_IO_LIMIT, 0);
+	add_resource(tree.domain, 1, IORESOURCE_MEM | IORESOURCE_ASSIGNED, DOMAIN_MEM_BASE,
+		     0, DOMAIN_MEM_LIMIT, 0);
+
+	/* Chipset MMIO (e.g. IOAPIC, LAPIC, flash) right below 4G. */
+	add_resource(tree.domain, 2, IORESOURCE_MEM | IORESOURCE_FIXED | IORESOURCE_ASSIGNED,
+		     FIXED_MMIO_BASE, FIXED_MMIO_SIZE, FIXED_MMIO_BASE + FIXED_MMIO_SIZE - 1,
+		     0);
+}
+
+static struct device *add_bridge(struct device *parent)
+{
+	struct device *bridge = add_device(parent, DEVICE_PATH_PCI);
+	const unsigned long flags = IORESOURCE_BRIDGE | IORESOURCE_PCI_BRIDGE;
+
+	add_bus(bridge);
+	add_resource(bridge, PCI_IO_BASE, IORESOURCE_IO | flags, 0, 0, 0xffff, 12);
+	add_resource(bridge, PCI_MEMORY_BASE, IORESOURCE_MEM | flags, 0, 0, LIMIT_4G, 20);
+	add_resource(bridge, PCI_PREF_MEMORY_BASE,
+		     IORESOURCE_MEM | IORESOURCE_PREFETCH | IORESOURCE_PCI64 | flags, 0, 0,
+		     UINT64_MAX, 20);
+
+	return bridge;
+}
+
+static struct resource *add_bar(struct device *dev, unsigned long index, unsigned long flags,
+				unsigned char size_log2)
+{
+	resource_t limit = LIMIT_4G;
+
+	if (flags & IORESOURCE_IO)
+		limit = 0xffff;
+	else if (flags & IORESOURCE_PCI64)
+		limit = UINT64_MAX;
+
+	return add_resource(dev, index, flags, 0, POWER_OF_2(size_log2), limit, size_log2);
+}
+
+static bool ranges_overlap(const struct resource *a, const struct resource *b)
+{
+	return a->base < b->base + b->size && b->base < a->base + a->size;
+}
+
+/* Returns the window the given child resource was allocated from. */
+static const struct resource *parent_window(const struct device *dev,
+					    const struct resource *res)
+{
+	const struct device *parent = dev->bus->dev;
+	const struct resource *win;
+	unsigned long type_mask = IORESOURCE_TYPE_MASK;
+
+	/* Bridges have separate prefetchable windows, domains do not. */
+	if (parent->path.type != DEVICE_PATH_DOMAIN)
+		type_mask |= IORESOURCE_PREFETCH;
+
+	for (win = parent->resource_list; win; win = win->next) {
+		if (win->flags & IORESOURCE_FIXED)
+			continue;
+		if (parent->path.type != DEVICE_PATH_DOMAIN &&
+		    !(win->flags & IORESOURCE_BRIDGE))
+			continue;
+		if ((win->flags & type_mask) == (res->flags & type_mask))
+			return win;
+	}
+
+	return NULL;
+}
+
+static bool window_contains(const struct resource *win, const struct resource *res)
+{
+	resource_t win_end = win->size ? win->base + win->size - 1 : win->limit;
+
+	return res->base >= win->base && res->base + res->size - 1 <= win_end;
+}
+
+/*
+ * Verify every allocated resource below `bus`: it is assigned, honors its alignment, lies
+ * inside the parent window, does not collide with a sibling resource of the same window and
+ * stays clear of the domain's fixed resources. Returns the number of resources that could not
+ * be placed.
+ */
+static size_t check_bus_placement(const struct bus *bus)
+{
+	const struct device *dev, *other;
+	const struct resource *res, *other_res, *fixed;
+	size_t failures = 0;
+
+	for (dev = bus->children; dev; dev = dev->sibling) {
+		for (res = dev->resource_list; res; res = res->next) {
+			if (!res->size || (res->flags & IORESOURCE_FIXED))
+				continue;
+
+			if (!(res->flags & IORESOURCE_ASSIGNED)) {
+				failures++;
+				continue;
+			}
+
+			assert_int_equal(res->base % POWER_OF_2(res->align), 0);
+			assert_true(window_contains(parent_window(dev, res), res));
+
+			if (res->flags & IORESOURCE_ABOVE_4G)
+				assert_true(res->base > LIMIT_4G);
+
+			for (fixed = tree.domain->resource_list; fixed; fixed = fixed->next) {
+				if ((fixed->flags & IORESOURCE_FIXED) &&
+				    (fixed->flags & IORESOURCE_TYPE_MASK) ==
+				    (res->flags & IORESOURCE_TYPE_MASK))
+					assert_false(ranges_overlap(fixed, res));
+			}
+
+			for (other = bus->children; other; other = other->sibling) {
+				for (other_res = other->resource_list; other_res;
+				     other_res = other_res->next) {
+					if (other_res == res || !other_res->size ||
+					    !(other_res->flags & IORESOURCE_ASSIGNED) ||
+					    (other_res->flags & IORESOURCE_FIXED))
+						continue;
+					if (parent_window(other, other_res) !=
+					    parent_window(dev, res))
+						continue;
+					assert_false(ranges_overlap(res, other_res));
+				}
+			}
+		}
+
+		if (dev->link_list)
+			failures += check_bus_placement(dev->link_list);
+	}
+
+	return failures;
+}
+
+/* Bytes of bridge window space not used by downstream resources (alignment padding). */
+static resource_t bridge_padding(const struct bus *bus)
+{
+	const struct device *dev, *child;
+	const struct resource *win, *res;
+	resource_t padding = 0;
+	resource_t used;
+
+	for (dev = bus->children; dev; dev = dev->sibling) {
+		if (!dev->link_list)
+			continue;
+
+		for (win = dev->resource_list; win; win = win->next) {
+			if (!(win->flags & IORESOURCE_BRIDGE) || !win->size)
+				continue;
+
+			used = 0;
+			for (child = dev->link_list->children; child; child = child->sibling)
+				for (res = child->resource_list; res; res = res->next)
+					if (parent_window(child, res) == win)
+						used += res->size;
+
+			padding += win->size - used;
+		}
+
+		padding += bridge_padding(dev->link_list);
+	}
+
+	return padding;
+}
+
+static void test_allocate_endpoints_on_domain(void **state)
+{
+	struct device *nic, *sata;
+
+	setup_tree();
+
+	nic = add_device(tree.domain, DEVICE_PATH_PCI);
+	add_bar(nic, PCI_BASE_ADDRESS_0, IORESOURCE_MEM, 17);
+	add_bar(nic, PCI_BASE_ADDRESS_2, IORESOURCE_IO, 5);
+
+	sata = add_device(tree.domain, DEVICE_PATH_PCI);
+	add_bar(sata, PCI_BASE_ADDRESS_0, IORESOURCE_IO, 3);
+	add_bar(sata, PCI_BASE_ADDRESS_5, IORESOURCE_MEM, 11);
+
+	allocate_resources(&tree.root);
+
+	assert_int_equal(check_bus_placement(tree.domain->link_list), 0);
+}
+
+static void test_allocate_64bit_prefetch_above_4g(void **state)
+{
+	struct device *root_port, *gpu, *nic;
+	const struct resource *vram, *mmio;
+	int i;
+
+	setup_tree();
+
+	/* GPU with 16GiB + 256MiB of 64-bit prefetchable BARs behind a root port. */
+	root_port = add_bridge(tree.domain);
+	gpu = add_device(root_port, DEVICE_PATH_PCI);
+	mmio = add_bar(gpu, PCI_BASE_ADDRESS_0, IORESOURCE_MEM, 24);
+	vram = add_bar(gpu, PCI_BASE_ADDRESS_1, IORESOURCE_MEM | IORESOURCE_PREFETCH |
+		       IORESOURCE_PCI64 | IORESOURCE_ABOVE_4G, 34);
+	add_bar(gpu, PCI_BASE_ADDRESS_3, IORESOURCE_MEM | IORESOURCE_PREFETCH |
+		IORESOURCE_PCI64 | IORESOURCE_ABOVE_4G, 28);
+	add_bar(gpu, PCI_BASE_ADDRESS_5, IORESOURCE_IO, 7);
+
+	/* Multi-function NIC with 64-bit prefetchable BARs on its own root port. */
+	root_port = add_bridge(tree.domain);
+	for (i = 0; i < 4; i++) {
+		nic = add_device(root_port, DEVICE_PATH_PCI);
+		add_bar(nic, PCI_BASE_ADDRESS_0, IORESOURCE_MEM | IORESOURCE_PREFETCH |
+			IORESOURCE_PCI64 | IORESOURCE_ABOVE_4G, 23);
+		add_bar(nic, PCI_BASE_ADDRESS_3, IORESOURCE_MEM | IORESOURCE_PREFETCH |
+			IORESOURCE_PCI64 | IORESOURCE_ABOVE_4G, 14);
+	}
+
+	allocate_resources(&tree.root);
+
+	assert_int_equal(check_bus_placement(tree.domain->link_list), 0);
+	assert_true(vram->base > LIMIT_4G);
+	assert_true(mmio->base + mmio->size - 1 <= LIMIT_4G);
+}
+
+static void test_allocate_fails_when_window_exhausted(void **state)
+{
+	struct device *dev;
+	int i;
+
+	setup_tree();
+
+	/*
+	 * Six 512MiB non-prefetchable BARs cannot fit into the 32-bit window between
+	 * DOMAIN_MEM_BASE and the fixed MMIO below 4G. The allocator must leave the ones that
+	 * do not fit unassigned instead of overlapping.
+	 */
+	for (i = 0; i < 6; i++) {
+		dev = add_device(tree.domain, DEVICE_PATH_PCI);
+		add_bar(dev, PCI_BASE_ADDRESS_0, IORESOURCE_MEM, 29);
+	}
+
+	allocate_resources(&tree.root);
+
+	assert_int_equal(check_bus_placement(tree.domain->link_list), 5);
+}
+
+static void test_allocate_large_tree(void **state)
+{
+	struct device *root_port, *sw, *dev;
+	struct timespec start, end;
+	size_t failures;
+	int port, slot, fn;
+	uint64_t usecs;
+
+	setup_tree();
+
+	/*
+	 * 16 root ports, each with a switch fanning out to 8 downstream ports with a
+	 * multi-function device each. That is 1000+ devices with a mix of 32-bit and 64-bit
+	 * prefetchable BARs of varying size.
+	 */
+	for (port = 0; port < 16; port++) {
+		root_port = add_bridge(tree.domain);
+		sw = add_bridge(root_port);
+		for (slot = 0; slot < 8; slot++) {
+			struct device *dsp = add_bridge(sw);
+			for (fn = 0; fn < 7; fn++) {
+				dev = add_device(dsp, DEVICE_PATH_PCI);
+				add_bar(dev, PCI_BASE_ADDRESS_0, IORESOURCE_MEM,
+					12 + (port + fn) % 6);
+				add_bar(dev, PCI_BASE_ADDRESS_1, IORESOURCE_MEM |
+					IORESOURCE_PREFETCH | IORESOURCE_PCI64 |
+					IORESOURCE_ABOVE_4G, 16 + (slot + fn) % 10);
+			}
+		}
+	}
+
+	assert_true(tree.num_devices > 1000);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	allocate_resources(&tree.root);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	failures = check_bus_placement(tree.domain->link_list);
+	usecs = (end.tv_sec - start.tv_sec) * 1000000ULL +
+		(end.tv_nsec - start.tv_nsec) / 1000;
+
+	print_message("%zu devices, %zu resources: allocated in %llu us, %zu failed, "
+		      "bridge window padding 0x%llx bytes\n", tree.num_devices,
+		      tree.num_resources, (unsigned long long)usecs, failures,
+		      (unsigned long long)bridge_padding(tree.domain->link_list));
+
+	assert_int_equal(failures, 0);
+}
+
+/* Highest end address of the assigned MEM resources below 4G directly on the domain. */
+static resource_t highest_end_below_4g(void)
+{
+	const struct device *dev;
+	const struct resource *res;
+	resource_t end = 0;
+
+	for (dev = tree.domain->link_list->children; dev; dev = dev->sibling) {
+		for (res = dev->resource_list; res; res = res->next) {
+			if (!(res->flags & IORESOURCE_MEM) || !res->size ||
+			    (res->flags & IORESOURCE_FIXED) || res->base > LIMIT_4G)
+				continue;
+			end = MAX(end, res->base + res->size);
+		}
+	}
+
+	return end;
+}
+
+static void test_pack_policy(void **state)
+{
+	struct device *root_port, *gpu, *nic;
+	struct resource *vram, *pref32, *pref_window;
+	int i;
+
+	if (!CONFIG(RESOURCE_ALLOCATOR_V4_PACK))
+		skip();
+
+	setup_tree();
+
+	/* 64-bit prefetchable BARs that the driver did not ask to place above 4G. */
+	root_port = add_bridge(tree.domain);
+	gpu = add_device(root_port, DEVICE_PATH_PCI);
+	add_bar(gpu, PCI_BASE_ADDRESS_0, IORESOURCE_MEM, 24);
+	vram = add_bar(gpu, PCI_BASE_ADDRESS_1, IORESOURCE_MEM | IORESOURCE_PREFETCH |
+		       IORESOURCE_PCI64, 28);
+	pref_window = probe_resource(root_port, PCI_PREF_MEMORY_BASE);
+
+	/* A 32-bit prefetchable BAR keeps its bridge window below 4G. */
+	root_port = add_bridge(tree.domain);
+	nic = add_device(root_port, DEVICE_PATH_PCI);
+	pref32 = add_bar(nic, PCI_BASE_ADDRESS_0, IORESOURCE_MEM | IORESOURCE_PREFETCH, 20);
+
+	/* Small BARs on the domain of different sizes. */
+	for (i = 0; i < 6; i++) {
+		nic = add_device(tree.domain, DEVICE_PATH_PCI);
+		add_bar(nic, PCI_BASE_ADDRESS_0, IORESOURCE_MEM, 12 + 2 * i);
+	}
+
+	allocate_resources(&tree.root);
+
+	assert_int_equal(check_bus_placement(tree.domain->link_list), 0);
+	assert_true(vram->base > LIMIT_4G);
+	assert_true(pref_window->flags & IORESOURCE_ABOVE_4G);
+	assert_true(pref_window->base > LIMIT_4G);
+	assert_true(pref32->base + pref32->size - 1 <= LIMIT_4G);
+
+	/* Top-down: the resources below 4G end right below the fixed chipset MMIO. */
+	assert_int_equal(highest_end_below_4g(), FIXED_MMIO_BASE);
+}
+
+static void test_pack_policy_falls_back_below_4g(void **state)
+{
+	struct device *dev;
+	struct resource *bars[4];
+	struct resource *domain_mem;
+	int i;
+
+	if (!CONFIG(RESOURCE_ALLOCATOR_V4_PACK))
+		skip();
+
+	setup_tree();
+
+	/* The domain does not decode anything above 4G. */
+	domain_mem = probe_resource(tree.domain, 1);
+	domain_mem->limit = LIMIT_4G;
+
+	for (i = 0; i < ARRAY_SIZE(bars); i++) {
+		dev = add_device(tree.domain, DEVICE_PATH_PCI);
+		bars[i] = add_bar(dev, PCI_BASE_ADDRESS_0, IORESOURCE_MEM |
+				  IORESOURCE_PREFETCH | IORESOURCE_PCI64, 22);
+	}
+
+	allocate_resources(&tree.root);
+
+	assert_int_equal(check_bus_placement(tree.domain->link_list), 0);
+	for (i = 0; i < ARRAY_SIZE(bars); i++) {
+		assert_false(bars[i]->flags & IORESOURCE_ABOVE_4G);
+		assert_true(bars[i]->base + bars[i]->size - 1 <= LIMIT_4G);
+	}
+	assert_int_equal(highest_end_below_4g(), FIXED_MMIO_BASE);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_allocate_endpoints_on_domain),
+		cmocka_unit_test(test_allocate_64bit_prefetch_above_4g),
+		cmocka_unit_test(test_allocate_fails_when_window_exhausted),
+		cmocka_unit_test(test_allocate_large_tree),
+		cmocka_unit_test(test_pack_policy),
+		cmocka_unit_test(test_pack_policy_falls_back_below_4g),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
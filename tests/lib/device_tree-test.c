@@ -0,0 +1,563 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <device_tree.h>
+#include <endian.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tests/test.h>
+
+#define DT_TEST_GUARD		64
+
+/* Allocations of a fixup or an overlay that don't depend on the size of the tree. */
+#define DT_TEST_FIXED_ALLOCATIONS	16
+
+#define DT_TEST_MAX_NAMES	8192
+/* Number of names the string pool of dt_flatten() deduplicates. */
+#define DT_TEST_POOL_NAMES	384
+
+static struct fdt_header template_header;
+
+static const char *const compatibles[] = {
+	"snps,dw-apb-uart",
+	"snps,designware-i2c",
+	"arm,pl022",
+	"cdns,sd4hc",
+	"generic-ehci",
+	"marvell,armada-3700-spi",
+};
+
+static struct device_tree *new_tree(void)
+{
+	struct device_tree *tree = malloc(sizeof(*tree));
+
+	template_header.magic = htobe32(FDT_HEADER_MAGIC);
+	template_header.version = htobe32(FDT_SUPPORTED_VERSION);
+	template_header.last_comp_version = htobe32(16);
+	template_header.reserve_map_offset = htobe32(sizeof(template_header));
+
+	memset(tree, 0, sizeof(*tree));
+	tree->header = &template_header;
+	tree->header_size = sizeof(template_header);
+	tree->root = malloc(sizeof(*tree->root));
+	memset(tree->root, 0, sizeof(*tree->root));
+	tree->root->name = "";
+
+	return tree;
+}
+
+static struct device_tree_node *add_node(struct device_tree *tree, const char *path)
+{
+	struct device_tree_node *node = dt_find_node_by_path(tree, path, NULL, NULL, 1);
+
+	assert_non_null(node);
+	return node;
+}
+
+/* A tree in the shape of an ARM SoC devicetree, with |cpus| CPUs and |devices| devices. */
+static struct device_tree *build_tree(size_t cpus, size_t devices)
+{
+	struct device_tree *tree = new_tree();
+	struct device_tree_node *node;
+	char path[64];
+	u64 addr, size;
+	size_t i;
+
+	dt_add_u32_prop(tree->root, "#address-cells", 2);
+	dt_add_u32_prop(tree->root, "#size-cells", 2);
+	dt_add_string_prop(tree->root, "compatible", "coreboot,test-board");
+	dt_add_string_prop(tree->root, "model", "coreboot test board");
+
+	node = add_node(tree, "/chosen");
+	dt_add_string_prop(node, "stdout-path", "serial0:115200n8");
+
+	node = add_node(tree, "/cpus");
+	dt_add_u32_prop(node, "#address-cells", 1);
+	dt_add_u32_prop(node, "#size-cells", 0);
+	for (i = 0; i < cpus; i++) {
+		snprintf(path, sizeof(path), "/cpus/cpu@%zx", i);
+		node = add_node(tree, path);
+		dt_add_string_prop(node, "device_type", "cpu");
+		dt_add_string_prop(node, "compatible", "arm,cortex-a72");
+		dt_add_u32_prop(node, "reg", i);
+		dt_add_string_prop(node, "enable-method", "psci");
+		dt_add_u32_prop(node, "next-level-cache", 1);
+		dt_add_u32_prop(node, "clock-frequency", 2000000000);
+		dt_add_u32_prop(node, "phandle", 2 + i);
+	}
+
+	node = add_node(tree, "/soc");
+	dt_add_string_prop(node, "compatible", "simple-bus");
+	dt_add_u32_prop(node, "#address-cells", 2);
+	dt_add_u32_prop(node, "#size-cells", 2);
+	for (i = 0; i < devices; i++) {
+		addr = 0x80000000 + i * 0x1000;
+		size = 0x1000;
+		snprintf(path, sizeof(path), "/soc/device@%llx", (unsigned long long)addr);
+		node = add_node(tree, path);
+		dt_add_string_prop(node, "compatible", compatibles[i % ARRAY_SIZE(compatibles)]);
+		dt_add_reg_prop(node, &addr, &size, 1, 2, 2);
+		dt_add_u32_prop(node, "interrupts", 32 + i);
+		dt_add_u32_prop(node, "interrupt-parent", 1);
+		dt_add_u32_prop(node, "clocks", 1);
+		dt_add_string_prop(node, "clock-names", "apb_pclk");
+		dt_add_string_prop(node, "status", "okay");
+		dt_add_u32_prop(node, "phandle", 2 + cpus + i);
+	}
+
+	return tree;
+}
+
+/* Heap allocations, counted through the malloc() wrapper. */
+static size_t allocations;
+
+void *__real_malloc(size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	allocations++;
+	return __real_malloc(size);
+}
+
+/* Sum of the sizes of the distinct property names, i.e. what the strings block needs. */
+static size_t unique_names_size(const struct device_tree_node *node, const char **names,
+				size_t *count)
+{
+	const struct device_tree_property *prop;
+	const struct device_tree_node *child;
+	size_t i, size = 0;
+
+	list_for_each(prop, node->properties, list_node) {
+		for (i = 0; i < *count; i++)
+			if (!strcmp(names[i], prop->prop.name))
+				break;
+		if (i < *count)
+			continue;
+		assert_true(*count < DT_TEST_MAX_NAMES);
+		names[(*count)++] = prop->prop.name;
+		size += strlen(prop->prop.name) + 1;
+	}
+
+	list_for_each(child, node->children, list_node)
+		size += unique_names_size(child, names, count);
+
+	return size;
+}
+
+/*
+ * Flatten |tree| into a new buffer and check it against dt_flat_size() and the expected
+ * strings block size. The buffer is followed by guard bytes to catch overruns.
+ */
+static uint8_t *flatten(const struct device_tree *tree, uint32_t *size)
+{
+	const struct fdt_header *header;
+	static const char *names[DT_TEST_MAX_NAMES];
+	size_t i, count = 0, strings_size;
+	uint8_t *blob;
+
+	*size = dt_flat_size(tree);
+	blob = malloc(*size + DT_TEST_GUARD);
+	memset(blob, 0xa5, *size + DT_TEST_GUARD);
+
+	dt_flatten(tree, blob);
+
+	header = (const struct fdt_header *)blob;
+	assert_int_equal(be32toh(header->magic), FDT_HEADER_MAGIC);
+	assert_int_equal(be32toh(header->totalsize), *size);
+	strings_size = unique_names_size(tree->root, names, &count);
+	if (count <= DT_TEST_POOL_NAMES)
+		assert_int_equal(be32toh(header->strings_size), strings_size);
+	else
+		assert_true(be32toh(header->strings_size) > strings_size);
+	assert_int_equal(be32toh(header->strings_offset) + be32toh(header->strings_size),
+			 *size);
+	for (i = 0; i < DT_TEST_GUARD; i++)
+		assert_int_equal(blob[*size + i], 0xa5);
+
+	return blob;
+}
+
+/* Unflattening and flattening again has to reproduce the blob byte by byte. */
+static void check_round_trip(const uint8_t *blob, uint32_t size)
+{
+	struct device_tree *tree;
+	uint8_t *copy;
+	uint32_t copy_size;
+
+	tree = fdt_unflatten(blob);
+	assert_non_null(tree);
+
+	copy = flatten(tree, &copy_size);
+	assert_int_equal(copy_size, size);
+	assert_memory_equal(copy, blob, size);
+
+	free(copy);
+}
+
+static void test_dt_flatten(void **state)
+{
+	struct device_tree *tree = build_tree(4, 32);
+	const struct fdt_header *header;
+	uint8_t *blob;
+	uint32_t size;
+
+	blob = flatten(tree, &size);
+	header = (const struct fdt_header *)blob;
+
+	/* Every property name is stored once. */
+	assert_true(be32toh(header->strings_size) < 256);
+
+	check_round_trip(blob, size);
+	free(blob);
+}
+
+/* More property names than the string pool can hold are stored without deduplication. */
+static void test_dt_flatten_many_names(void **state)
+{
+	struct device_tree *tree = new_tree();
+	struct device_tree_node *node;
+	const void *data;
+	char *name;
+	uint8_t *blob;
+	uint32_t size;
+	size_t i, len;
+
+	node = add_node(tree, "/names");
+	for (i = 0; i < 1000; i++) {
+		name = malloc(32);
+		snprintf(name, 32, "property-%zu", i);
+		dt_add_u32_prop(node, name, i);
+		/* Duplicate names in another node. */
+		if (i % 2)
+			dt_add_u32_prop(tree->root, name, i);
+	}
+
+	blob = flatten(tree, &size);
+	check_round_trip(blob, size);
+
+	tree = fdt_unflatten(blob);
+	node = dt_find_node_by_path(tree, "/names", NULL, NULL, 0);
+	assert_non_null(node);
+	for (i = 0; i < 1000; i += 97) {
+		char expected[32];
+
+		snprintf(expected, sizeof(expected), "property-%zu", i);
+		dt_find_bin_prop(node, expected, &data, &len);
+		assert_int_equal(len, sizeof(u32));
+		assert_int_equal(be32dec(data), i);
+	}
+
+	free(blob);
+}
+
+/*
+ * The usual life of a devicetree in coreboot: unflatten the blob, apply fixups and flatten it
+ * for the payload. The heap allocations of each step must not grow with the tree.
+ */
+static void run_bench(const char *name, size_t cpus, size_t devices)
+{
+	struct device_tree *tree = build_tree(cpus, devices);
+	struct device_tree_node *node, *soc;
+	size_t modify_allocations;
+	u64 addr = 0x80000000, size = 0x80000000;
+	uint8_t *blob, *out;
+	uint32_t blob_size, out_size, offset;
+
+	blob = flatten(tree, &blob_size);
+
+	/* The tree and one arena for all nodes and properties. */
+	allocations = 0;
+	tree = fdt_unflatten(blob);
+	assert_non_null(tree);
+	assert_int_equal(allocations, 2);
+
+	allocations = 0;
+	node = dt_find_node_by_path(tree, "/memory", NULL, NULL, 1);
+	dt_add_string_prop(node, "device_type", "memory");
+	dt_add_reg_prop(node, &addr, &size, 1, 2, 2);
+	node = dt_find_node_by_path(tree, "/chosen", NULL, NULL, 1);
+	dt_add_string_prop(node, "bootargs", "console=ttyS0,115200n8 earlycon");
+	soc = dt_find_node_by_path(tree, "/soc", NULL, NULL, 0);
+	assert_non_null(soc);
+	node = NULL;
+	while ((node = dt_find_next_compat_child(soc, node, compatibles[0])))
+		dt_add_string_prop(node, "status", "disabled");
+	modify_allocations = allocations;
+
+	/* The string pool is static. */
+	out_size = dt_flat_size(tree);
+	out = malloc(out_size);
+	allocations = 0;
+	dt_flatten(tree, out);
+	assert_int_equal(allocations, 0);
+
+	check_round_trip(out, out_size);
+	free(out);
+
+	/* The same changes on the flat tree, without any allocations. */
+	out_size = blob_size + 4096;
+	out = malloc(out_size);
+	allocations = 0;
+	assert_int_equal(fdt_open_into(blob, out, out_size), 0);
+	offset = fdt_find_node_by_path(out, "/memory", NULL, NULL, 1);
+	fdt_add_string_prop(out, offset, "device_type", "memory");
+	fdt_add_reg_prop(out, offset, &addr, &size, 1, 2, 2);
+	offset = fdt_find_node_by_path(out, "/chosen", NULL, NULL, 1);
+	fdt_add_string_prop(out, offset, "bootargs", "console=ttyS0,115200n8 earlycon");
+	fdt_pack(out);
+	assert_int_equal(allocations, 0);
+
+	print_message("%-6s %4zu cpus %5zu devices %8u bytes: %zu allocations to modify\n",
+		      name, cpus, devices, blob_size, modify_allocations);
+	assert_true(modify_allocations <= DT_TEST_FIXED_ALLOCATIONS);
+
+	free(out);
+	free(blob);
+}
+
+static void test_dt_bench(void **state)
+{
+	run_bench("small", 4, 32);
+	run_bench("medium", 16, 512);
+	run_bench("large", 64, 4096);
+}
+
+/* Lookups through the index have to follow the changes of the tree. */
+static void test_dt_lookup_index(void **state)
+{
+	struct device_tree *tree = build_tree(4, 32);
+	struct device_tree_node *node, *soc;
+	uint32_t size;
+	uint8_t *blob;
+	int i;
+
+	/* Unflattening fills in the phandles of the nodes. */
+	blob = flatten(tree, &size);
+	tree = fdt_unflatten(blob);
+	assert_non_null(tree);
+
+	/* The index is built on the second lookup. */
+	for (i = 0; i < 2; i++) {
+		node = dt_find_node_by_path(tree, "/soc/device@80001000", NULL, NULL, 0);
+		assert_non_null(node);
+		assert_string_equal(node->name, "device@80001000");
+		assert_ptr_equal(dt_find_node_by_phandle(tree, 2 + 4 + 1), node);
+		assert_null(dt_find_node_by_path(tree, "/soc/device@1", NULL, NULL, 0));
+	}
+	assert_ptr_equal(dt_find_node_by_path(tree, "/", NULL, NULL, 0), tree->root);
+	soc = dt_find_node_by_path(tree, "/soc", NULL, NULL, 0);
+	assert_non_null(soc);
+
+	/* Added nodes are found too. */
+	node = dt_find_node_by_path(tree, "/soc/new@0", NULL, NULL, 1);
+	assert_non_null(node);
+	node->phandle = 100;
+	for (i = 0; i < 2; i++) {
+		assert_ptr_equal(dt_find_node_by_path(tree, "/soc/new@0", NULL, NULL, 0), node);
+		assert_ptr_equal(dt_find_node_by_phandle(tree, 100), node);
+	}
+
+	/* Removed nodes are not. */
+	node = dt_find_node_by_path(tree, "/soc/device@80002000", NULL, NULL, 0);
+	assert_non_null(node);
+	list_remove(&node->list_node);
+	dt_nodes_changed();
+	for (i = 0; i < 2; i++) {
+		assert_null(dt_find_node_by_path(tree, "/soc/device@80002000", NULL, NULL, 0));
+		assert_null(dt_find_node_by_phandle(tree, 2 + 4 + 2));
+		assert_ptr_equal(dt_find_node_by_path(tree, "/soc", NULL, NULL, 0), soc);
+	}
+
+	free(blob);
+}
+
+/* Add a /__symbols__ node with a label for every device to the tree. */
+static void add_symbols(struct device_tree *tree, size_t devices)
+{
+	struct device_tree_node *node = add_node(tree, "/__symbols__");
+	char *label, *path;
+	size_t i;
+
+	for (i = 0; i < devices; i++) {
+		label = malloc(16);
+		path = malloc(32);
+		snprintf(label, 16, "dev%zu", i);
+		snprintf(path, 32, "/soc/device@%llx", 0x80000000ULL + i * 0x1000);
+		dt_add_string_prop(node, label, path);
+	}
+}
+
+/*
+ * An overlay with |fragments| fragments that each disable one of the |devices| devices and
+ * add a child node with a phandle to it. The targets are phandle references to the labels of
+ * the base tree, like dtc generates them.
+ */
+static struct device_tree *build_overlay(size_t fragments, size_t devices)
+{
+	struct device_tree *overlay = new_tree();
+	struct device_tree_node *node, *fixups;
+	char path[64], *label, *fixup;
+	size_t i;
+
+	fixups = add_node(overlay, "/__fixups__");
+	for (i = 0; i < fragments; i++) {
+		snprintf(path, sizeof(path), "/fragment@%zu", i);
+		node = add_node(overlay, path);
+		dt_add_u32_prop(node, "target", 0xffffffff);
+
+		snprintf(path, sizeof(path), "/fragment@%zu/__overlay__", i);
+		node = add_node(overlay, path);
+		dt_add_string_prop(node, "status", "disabled");
+
+		snprintf(path, sizeof(path), "/fragment@%zu/__overlay__/extra", i);
+		node = add_node(overlay, path);
+		dt_add_string_prop(node, "compatible", "coreboot,extra");
+		dt_add_u32_prop(node, "phandle", 1 + i);
+
+		label = malloc(16);
+		fixup = malloc(32);
+		snprintf(label, 16, "dev%zu", i * devices / fragments);
+		snprintf(fixup, 32, "/fragment@%zu:target:0", i);
+		dt_add_string_prop(fixups, label, fixup);
+	}
+
+	return overlay;
+}
+
+static void run_overlay_bench(const char *name, size_t cpus, size_t devices, size_t fragments)
+{
+	struct device_tree *tree = build_tree(cpus, devices);
+	struct device_tree *overlay = build_overlay(fragments, devices);
+	struct device_tree_node *node, *extra;
+	uint32_t blob_size, max_phandle;
+	char path[64];
+	uint8_t *blob;
+	size_t i;
+
+	add_symbols(tree, devices);
+	blob = flatten(tree, &blob_size);
+	tree = fdt_unflatten(blob);
+	assert_non_null(tree);
+	max_phandle = tree->max_phandle;
+
+	allocations = 0;
+	assert_int_equal(dt_apply_overlay(tree, overlay), 0);
+
+	print_message("%-6s %5zu devices %5zu fragments %8u bytes: %zu allocations\n",
+		      name, devices, fragments, blob_size, allocations);
+	/* One per fragment for the added node, the rest is reused from the overlay. */
+	assert_true(allocations <= fragments + DT_TEST_FIXED_ALLOCATIONS);
+
+	for (i = 0; i < fragments; i++) {
+		snprintf(path, sizeof(path), "/soc/device@%llx",
+			 0x80000000ULL + i * devices / fragments * 0x1000);
+		node = dt_find_node_by_path(tree, path, NULL, NULL, 0);
+		assert_non_null(node);
+		assert_string_equal(dt_find_string_prop(node, "status"), "disabled");
+
+		snprintf(path, sizeof(path), "/soc/device@%llx/extra",
+			 0x80000000ULL + i * devices / fragments * 0x1000);
+		extra = dt_find_node_by_path(tree, path, NULL, NULL, 0);
+		assert_non_null(extra);
+		assert_ptr_equal(dt_find_node_by_phandle(tree, max_phandle + 1 + i), extra);
+	}
+
+	free(blob);
+}
+
+static void test_dt_overlay_bench(void **state)
+{
+	run_overlay_bench("small", 4, 32, 8);
+	run_overlay_bench("medium", 16, 512, 64);
+	run_overlay_bench("large", 64, 4096, 512);
+}
+
+/* Edit a flat tree in place and check the result through the unflattened tree. */
+static void test_fdt_edit_in_place(void **state)
+{
+	struct device_tree *tree = build_tree(4, 32);
+	struct device_tree_node *node;
+	struct device_tree_reserve_map_entry *entry;
+	u64 addr = 0x80000000, size = 0x40000000;
+	u32 addr_cells = 0, size_cells = 0;
+	uint8_t *blob, *buf;
+	uint32_t blob_size, buf_size, offset;
+	const void *data;
+	size_t len;
+
+	blob = flatten(tree, &blob_size);
+	buf_size = blob_size + 4096;
+	buf = malloc(buf_size);
+
+	assert_int_equal(fdt_open_into(blob, buf, buf_size), 0);
+
+	offset = fdt_find_node_by_path(buf, "/memory", &addr_cells, &size_cells, 1);
+	assert_int_not_equal(offset, 0);
+	assert_int_equal(addr_cells, 2);
+	assert_int_equal(size_cells, 2);
+	assert_int_equal(fdt_add_string_prop(buf, offset, "device_type", "memory"), 0);
+	assert_int_equal(fdt_add_reg_prop(buf, offset, &addr, &size, 1, 2, 2), 0);
+
+	offset = fdt_find_node_by_path(buf, "/chosen", NULL, NULL, 0);
+	assert_int_not_equal(offset, 0);
+	assert_int_equal(fdt_add_string_prop(buf, offset, "stdout-path", "serial1"), 0);
+	assert_int_equal(fdt_add_u32_prop(buf, offset, "linux,initrd-start", 0x1000), 0);
+
+	offset = fdt_find_node_by_path(buf, "/soc/device@80001000", NULL, NULL, 0);
+	assert_int_not_equal(offset, 0);
+	assert_int_equal(fdt_delete_node(buf, offset), 0);
+
+	assert_int_equal(fdt_add_reserve_map_entry(buf, 0x1000, 0x2000), 0);
+
+	/* Running out of room fails without corrupting the tree. */
+	offset = fdt_find_node_by_path(buf, "/chosen", NULL, NULL, 0);
+	assert_int_equal(fdt_add_bin_prop(buf, offset, "too-big", NULL, buf_size), -1);
+
+	assert_true(fdt_pack(buf) < buf_size);
+
+	tree = fdt_unflatten(buf);
+	assert_non_null(tree);
+
+	node = dt_find_node_by_path(tree, "/memory", NULL, NULL, 0);
+	assert_non_null(node);
+	assert_string_equal(dt_find_string_prop(node, "device_type"), "memory");
+	dt_find_bin_prop(node, "reg", &data, &len);
+	assert_int_equal(len, 4 * sizeof(u32));
+	assert_int_equal(be32dec((const u32 *)data + 2), 0);
+	assert_int_equal(be32dec((const u32 *)data + 3), 0x40000000);
+
+	node = dt_find_node_by_path(tree, "/chosen", NULL, NULL, 0);
+	assert_non_null(node);
+	assert_string_equal(dt_find_string_prop(node, "stdout-path"), "serial1");
+	dt_find_bin_prop(node, "too-big", &data, &len);
+	assert_int_equal(len, 0);
+
+	assert_null(dt_find_node_by_path(tree, "/soc/device@80001000", NULL, NULL, 0));
+	assert_non_null(dt_find_node_by_path(tree, "/soc/device@80002000", NULL, NULL, 0));
+
+	len = 0;
+	list_for_each(entry, tree->reserve_map, list_node) {
+		assert_int_equal(entry->start, 0x1000);
+		assert_int_equal(entry->size, 0x2000);
+		len++;
+	}
+	assert_int_equal(len, 1);
+
+	free(buf);
+	free(blob);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_dt_flatten),
+		cmocka_unit_test(test_dt_flatten_many_names),
+		cmocka_unit_test(test_dt_bench),
+		cmocka_unit_test(test_dt_lookup_index),
+		cmocka_unit_test(test_dt_overlay_bench),
+		cmocka_unit_test(test_fdt_edit_in_place),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
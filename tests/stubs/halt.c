@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <halt.h>
+#include <tests/test.h>
+
+void halt(void)
+{
+	fail_msg("halt() called");
+	while (1)
+		;
+}
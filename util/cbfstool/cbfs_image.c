@@ -150,7 +150,7 @@ static void cbfs_decode_payload_segment(struct cbfs_payload_segment *output,
 	assert(seg.size == 0);
 }
 
-static int cbfs_file_get_compression_info(struct cbfs_file *entry,
+int cbfs_file_get_compression_info(struct cbfs_file *entry,
 	uint32_t *decompressed_size)
 {
 	unsigned int compression = CBFS_COMPRESS_NONE;
@@ -629,6 +629,367 @@ int cbfs_compact_instance(struct cbfs_image *image)
 	return 0;
 }
 
+/* Page size used to count page splits of early boot files. */
+#define LAYOUT_PAGE_SIZE	4096
+
+struct layout_entry {
+	struct cbfs_file *file;
+	size_t offset;
+	size_t size;		/* Including the alignment padding. */
+	size_t new_offset;
+	bool pinned;
+	int hot;		/* Position in the list of early boot files. */
+};
+
+struct layout_stats {
+	size_t read_bytes;
+	size_t read_span;
+	unsigned int page_splits;
+	unsigned int empty_entries;
+	size_t largest_empty;
+};
+
+static size_t layout_align(const struct cbfs_image *image)
+{
+	return image->has_header ? image->header.align : CBFS_ENTRY_ALIGNMENT;
+}
+
+/* Page of an offset into the image, pages are aligned in the whole flash. */
+static size_t layout_page(const struct cbfs_image *image, size_t offset)
+{
+	return (offset + buffer_offset(&image->buffer)) / LAYOUT_PAGE_SIZE;
+}
+
+/*
+ * Files that can't be moved even if they were asked to: the bootblock and the
+ * master header, files the firmware finds by their address (microcode for the
+ * FIT, FSPs, which are relocated to where they are placed) and stages that
+ * execute in place from the memory mapped flash. Files added at a fixed
+ * address with -b can't be told apart from the others, so only the files
+ * named by the caller are moved at all.
+ */
+static bool layout_is_pinned(struct cbfs_image *image, struct cbfs_file *file,
+			     uint64_t mmap_base)
+{
+	struct buffer reader;
+	uint64_t load;
+
+	switch (ntohl(file->type)) {
+	case CBFS_COMPONENT_BOOTBLOCK:
+	case CBFS_COMPONENT_CBFSHEADER:
+	case CBFS_COMPONENT_MICROCODE:
+	case CBFS_COMPONENT_FSP:
+		return true;
+	case CBFS_COMPONENT_STAGE:
+		if (ntohl(file->len) < sizeof(struct cbfs_stage))
+			break;
+
+		/* The stage metadata is in little endian. */
+		buffer_init(&reader, NULL, CBFS_SUBHEADER(file),
+			    sizeof(struct cbfs_stage));
+		xdr_le.get32(&reader);		/* compression */
+		xdr_le.get64(&reader);		/* entry */
+		load = xdr_le.get64(&reader);
+		if (load >= mmap_base &&
+		    load < mmap_base + buffer_size(&image->buffer))
+			return true;
+		break;
+	}
+
+	return false;
+}
+
+static bool layout_name_in(const char *name, const char * const *names,
+			   size_t num_names)
+{
+	for (size_t i = 0; i < num_names; i++)
+		if (!strcmp(name, names[i]))
+			return true;
+	return false;
+}
+
+/*
+ * The firmware looks files up by walking the CBFS from the start and reading
+ * the metadata of every file on the way. Estimate how much is read from flash
+ * to find and load all the early boot files in order.
+ */
+static void layout_get_stats(struct cbfs_image *image,
+			     const char * const *hot, size_t num_hot,
+			     struct layout_stats *stats)
+{
+	struct cbfs_file *entry;
+	size_t first = 0, last = 0;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (entry = cbfs_find_first_entry(image);
+	     entry && cbfs_is_valid_entry(image, entry);
+	     entry = cbfs_find_next_entry(image, entry)) {
+		uint32_t type = ntohl(entry->type);
+
+		if (type == CBFS_COMPONENT_NULL ||
+		    type == CBFS_COMPONENT_DELETED) {
+			stats->empty_entries++;
+			stats->largest_empty = MAX(stats->largest_empty,
+						   cbfs_file_entry_size(entry));
+		}
+	}
+
+	for (size_t i = 0; i < num_hot; i++) {
+		size_t walked = 0;
+
+		for (entry = cbfs_find_first_entry(image);
+		     entry && cbfs_is_valid_entry(image, entry);
+		     entry = cbfs_find_next_entry(image, entry)) {
+			size_t addr = cbfs_get_entry_addr(image, entry);
+			size_t data = addr + cbfs_file_entry_metadata_size(entry);
+			size_t len = cbfs_file_entry_data_size(entry);
+
+			walked += cbfs_file_entry_metadata_size(entry);
+			if (strcmp(entry->filename, hot[i]))
+				continue;
+
+			/* Files that aren't in the image don't count. */
+			stats->read_bytes += walked + len;
+			if (len && layout_page(image, data + len - 1) -
+				   layout_page(image, data) >
+				   (len - 1) / LAYOUT_PAGE_SIZE)
+				stats->page_splits++;
+			if (!last || addr < first)
+				first = addr;
+			last = MAX(last, data + len);
+			break;
+		}
+	}
+	stats->read_span = last - first;
+}
+
+struct layout_gap {
+	size_t start;
+	size_t end;
+};
+
+/* Returns true if an entry can be placed at start in the gap. */
+static bool layout_fits(const struct layout_gap *gap, size_t start,
+			size_t size, size_t min_empty)
+{
+	size_t before = start - gap->start;
+	size_t after;
+
+	if (start < gap->start || start + size > gap->end)
+		return false;
+	after = gap->end - start - size;
+	return (!before || before >= min_empty) &&
+	       (!after || after >= min_empty);
+}
+
+/*
+ * Place an entry in the first gap it fits in. Small early boot files are
+ * placed so they don't cross a page if the space in front of them can hold an
+ * empty entry, later files may fill it.
+ */
+static bool layout_place(const struct cbfs_image *image,
+			 struct layout_entry *e, struct layout_gap **gaps,
+			 size_t *num_gaps, size_t align, size_t min_empty)
+{
+	size_t metadata = cbfs_file_entry_metadata_size(e->file);
+	size_t len = cbfs_file_entry_data_size(e->file);
+
+	for (size_t i = 0; i < *num_gaps; i++) {
+		struct layout_gap *gap = &(*gaps)[i];
+		size_t start = gap->start;
+		size_t data = start + metadata;
+
+		if (e->hot >= 0 && len && len <= LAYOUT_PAGE_SIZE - align &&
+		    layout_page(image, data) !=
+		    layout_page(image, data + len - 1)) {
+			size_t page = (layout_page(image, data) + 1) *
+				LAYOUT_PAGE_SIZE - buffer_offset(&image->buffer);
+			size_t shifted = align_up(page - metadata, align);
+
+			if (layout_fits(gap, shifted, e->size, min_empty))
+				start = shifted;
+		}
+
+		if (!layout_fits(gap, start, e->size, min_empty))
+			continue;
+
+		e->new_offset = start;
+		if (start == gap->start) {
+			gap->start += e->size;
+			return true;
+		}
+
+		/* Split the gap around the entry. */
+		struct layout_gap *tmp = realloc(*gaps,
+						 (*num_gaps + 1) * sizeof(*tmp));
+		if (!tmp)
+			return false;
+		*gaps = tmp;
+		gap = &tmp[i];
+		memmove(gap + 1, gap, (*num_gaps - i) * sizeof(*gap));
+		gap->end = start;
+		gap[1].start = start + e->size;
+		(*num_gaps)++;
+		return true;
+	}
+
+	return false;
+}
+
+static int layout_compare_size(const void *a, const void *b)
+{
+	const struct layout_entry *ea = *(const struct layout_entry * const *)a;
+	const struct layout_entry *eb = *(const struct layout_entry * const *)b;
+
+	if (ea->hot != eb->hot) {
+		if (ea->hot < 0)
+			return 1;
+		if (eb->hot < 0)
+			return -1;
+		return ea->hot - eb->hot;
+	}
+	if (ea->size != eb->size)
+		return ea->size < eb->size ? 1 : -1;
+	/* Keep the order stable for files of the same size. */
+	return ea->offset < eb->offset ? -1 : ea->offset > eb->offset;
+}
+
+static void layout_print_stats(const struct layout_stats *before,
+			       const struct layout_stats *after)
+{
+	printf("%-28s %12s %12s\n", "", "before", "after");
+	printf("%-28s %12zu %12zu\n", "early boot read bytes",
+	       before->read_bytes, after->read_bytes);
+	printf("%-28s %12zu %12zu\n", "early boot read span",
+	       before->read_span, after->read_span);
+	printf("%-28s %12u %12u\n", "early boot page splits",
+	       before->page_splits, after->page_splits);
+	printf("%-28s %12u %12u\n", "empty entries",
+	       before->empty_entries, after->empty_entries);
+	printf("%-28s %12zu %12zu\n", "largest empty entry",
+	       before->largest_empty, after->largest_empty);
+}
+
+int cbfs_optimize_layout(struct cbfs_image *image, const char * const *hot,
+			 size_t num_hot, const char * const *movable,
+			 size_t num_movable, uint64_t mmap_base)
+{
+	const size_t align = layout_align(image);
+	const size_t min_empty = cbfs_calculate_file_header_size("");
+	struct layout_entry *entries = NULL, **order = NULL;
+	struct layout_gap *gaps = NULL;
+	struct layout_stats before, after;
+	struct cbfs_file *entry;
+	size_t num_entries = 0, num_order = 0, num_gaps = 0;
+	size_t begin, end = 0, prev_end;
+	uint8_t *copy = NULL;
+	int ret = 1;
+
+	cbfs_walk(image, cbfs_merge_empty_entry, NULL);
+	layout_get_stats(image, hot, num_hot, &before);
+
+	entry = cbfs_find_first_entry(image);
+	if (!entry || !cbfs_is_valid_entry(image, entry)) {
+		ERROR("No valid CBFS entries found.\n");
+		return 1;
+	}
+	begin = cbfs_get_entry_addr(image, entry);
+
+	for (; entry && cbfs_is_valid_entry(image, entry);
+	     entry = cbfs_find_next_entry(image, entry)) {
+		uint32_t type = ntohl(entry->type);
+		struct layout_entry *e;
+
+		end = align_up(cbfs_get_entry_addr(image, entry) +
+			       cbfs_file_entry_size(entry), align);
+		if (type == CBFS_COMPONENT_NULL ||
+		    type == CBFS_COMPONENT_DELETED)
+			continue;
+
+		e = realloc(entries, (num_entries + 1) * sizeof(*e));
+		if (!e)
+			goto out;
+		entries = e;
+		e = &entries[num_entries++];
+		e->file = entry;
+		e->offset = cbfs_get_entry_addr(image, entry);
+		e->size = end - e->offset;
+		e->new_offset = e->offset;
+		e->hot = -1;
+		for (size_t i = 0; i < num_hot; i++) {
+			if (!strcmp(entry->filename, hot[i])) {
+				e->hot = i;
+				break;
+			}
+		}
+		e->pinned = layout_is_pinned(image, entry, mmap_base) ||
+			    (e->hot < 0 && !layout_name_in(entry->filename,
+							   movable, num_movable));
+	}
+
+	/* The space between pinned files is free for the others. */
+	order = calloc(num_entries, sizeof(*order));
+	gaps = calloc(num_entries + 1, sizeof(*gaps));
+	if (!order || !gaps)
+		goto out;
+	prev_end = begin;
+	for (size_t i = 0; i < num_entries; i++) {
+		if (!entries[i].pinned) {
+			order[num_order++] = &entries[i];
+			continue;
+		}
+		DEBUG("'%s' can't be moved\n", entries[i].file->filename);
+		if (entries[i].offset > prev_end)
+			gaps[num_gaps++] = (struct layout_gap){
+				prev_end, entries[i].offset };
+		prev_end = entries[i].offset + entries[i].size;
+	}
+	if (end > prev_end)
+		gaps[num_gaps++] = (struct layout_gap){ prev_end, end };
+
+	/* Early boot files first and in boot order, then the other movable files
+	   from the largest to the smallest so the small ones fill the remaining
+	   holes. */
+	qsort(order, num_order, sizeof(*order), layout_compare_size);
+	for (size_t i = 0; i < num_order; i++) {
+		if (!layout_place(image, order[i], &gaps, &num_gaps, align,
+				  min_empty)) {
+			ERROR("Can't find a place for '%s', image is too fragmented.\n",
+			      order[i]->file->filename);
+			goto out;
+		}
+	}
+
+	/* Build the new layout in a copy, so entries can be moved freely. */
+	copy = malloc(end - begin);
+	if (!copy)
+		goto out;
+	memset(copy, CBFS_CONTENT_DEFAULT_VALUE, end - begin);
+	for (size_t i = 0; i < num_entries; i++)
+		memcpy(copy + entries[i].new_offset - begin, entries[i].file,
+		       cbfs_file_entry_size(entries[i].file));
+	for (size_t i = 0; i < num_gaps; i++) {
+		if (gaps[i].end == gaps[i].start)
+			continue;
+		cbfs_create_empty_entry(
+			(struct cbfs_file *)(copy + gaps[i].start - begin),
+			CBFS_COMPONENT_NULL,
+			gaps[i].end - gaps[i].start - min_empty, "");
+	}
+	memcpy(image->buffer.data + begin, copy, end - begin);
+
+	layout_get_stats(image, hot, num_hot, &after);
+	layout_print_stats(&before, &after);
+	ret = 0;
+out:
+	free(copy);
+	free(gaps);
+	free(order);
+	free(entries);
+	return ret;
+}
+
 int cbfs_image_delete(struct cbfs_image *image)
 {
 	if (image == NULL)
@@ -68,6 +68,18 @@ int cbfs_copy_instance(struct cbfs_image *image, struct buffer *dst);
  * beginning of the image. Returns 0 on success, otherwise non-zero.  */
 int cbfs_compact_instance(struct cbfs_image *image);
 
+/* Reorder the files of a CBFS image for a faster boot: the files named in hot
+ * (in boot order) are placed as early in the image as possible, not crossing
+ * pages if possible, the files named in movable are packed behind them to
+ * reduce fragmentation. All other files stay where they are, as they may be
+ * found by their address. So do files that must stay where they are, like
+ * stages executing in place from flash mapped at mmap_base, even if named.
+ * Prints the estimated early boot flash reads before and after. Returns 0 on
+ * success, otherwise non-zero. */
+int cbfs_optimize_layout(struct cbfs_image *image, const char * const *hot,
+			 size_t num_hot, const char * const *movable,
+			 size_t num_movable, uint64_t mmap_base);
+
 /* Expand a CBFS image inside an fmap region to the entire region's space.
    Returns 0 on success, otherwise non-zero. */
 int cbfs_expand_to_region(struct buffer *region);
@@ -182,6 +194,11 @@ struct cbfs_file_attribute *cbfs_file_first_attr(struct cbfs_file *file);
 struct cbfs_file_attribute *cbfs_file_next_attr(struct cbfs_file *file,
 	struct cbfs_file_attribute *attr);
 
+/* Returns the compression algorithm of a file according to its attributes and
+ * stores its decompressed size in decompressed_size, if that isn't NULL. */
+int cbfs_file_get_compression_info(struct cbfs_file *entry,
+	uint32_t *decompressed_size);
+
 /* Adds to header a new extended attribute tagged 'tag', sized 'size'.
  * Returns pointer to the new attribute, or NULL on error. */
 struct cbfs_file_attribute *cbfs_add_file_attr(struct cbfs_file *header,
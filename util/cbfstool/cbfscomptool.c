@@ -1,6 +1,7 @@
 /* cbfs-compression-tool, CLI utility for dealing with CBFS compressed data */
 /* SPDX-License-Identifier: GPL-2.0-only */
 
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,10 +10,18 @@
 
 #include "common.h"
 
-const char *usage_text = "cbfs-compression-tool benchmark\n"
-	"  runs benchmarks for all implemented algorithms\n"
+const char *usage_text = "cbfs-compression-tool benchmark [file...]\n"
+	"  runs benchmarks for all implemented algorithms on the files,\n"
+	"  reporting the compression ratio and the (de)compression speed\n"
 	"cbfs-compression-tool compress inFile outFile algo\n"
 	"  compresses inFile with algo and stores in outFile\n"
+	"cbfs-compression-tool select -f flashMBps [-b budget] [-s slowdown] file...\n"
+	"  picks the algorithm with the shortest estimated load time for\n"
+	"  each file, given the flash read speed in MB/s. The decompression\n"
+	"  speed is measured on the host and divided by slowdown to estimate\n"
+	"  the speed on the target. If the files together need more than\n"
+	"  budget bytes, the files that lose the least time per saved byte\n"
+	"  are compressed better until they fit\n"
 	"\n"
 	"'compress' file format:\n"
 	" 4 bytes little endian: algorithm ID (as used in CBFS)\n"
@@ -24,55 +33,6 @@ static void usage(void)
 	puts(usage_text);
 }
 
-static int benchmark(void)
-{
-	const int bufsize = 10*1024*1024;
-	char *data = malloc(bufsize);
-	if (!data) {
-		fprintf(stderr, "out of memory\n");
-		return 1;
-	}
-	char *compressed_data = malloc(bufsize);
-	if (!compressed_data) {
-		free(data);
-		fprintf(stderr, "out of memory\n");
-		return 1;
-	}
-	int i, l = strlen(usage_text) + 1;
-	for (i = 0; i + l < bufsize; i += l) {
-		memcpy(data + i, usage_text, l);
-	}
-	memset(data + i, 0, bufsize - i);
-	const struct typedesc_t *algo;
-	for (algo = &types_cbfs_compression[0]; algo->name != NULL; algo++) {
-		int outsize = bufsize;
-		printf("measuring '%s'\n", algo->name);
-		comp_func_ptr comp = compression_function(algo->type);
-		if (comp == NULL) {
-			printf("no handler associated with algorithm\n");
-			free(data);
-			free(compressed_data);
-			return 1;
-		}
-
-		struct timespec t_s, t_e;
-		clock_gettime(CLOCK_MONOTONIC, &t_s);
-
-		if (comp(data, bufsize, compressed_data, &outsize)) {
-			printf("compression failed");
-			return 1;
-		}
-
-		clock_gettime(CLOCK_MONOTONIC, &t_e);
-		printf("compressing %d bytes to %d took %ld seconds\n",
-			bufsize, outsize,
-			(long)(t_e.tv_sec - t_s.tv_sec));
-	}
-	free(data);
-	free(compressed_data);
-	return 0;
-}
-
 static int compress(char *infile, char *outfile, char *algoname,
 		    int write_header)
 {
@@ -177,14 +137,406 @@ out:
 	return err;
 }
 
+struct select_option {
+	int algo;
+	size_t size;		/* Size in flash */
+	double time;		/* Estimated load time in seconds */
+};
+
+struct select_file {
+	const char *name;
+	size_t size;
+	struct select_option options[ARRAY_SIZE(types_cbfs_compression) - 1];
+	size_t num_options;
+	size_t choice;
+};
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Seconds it takes to decompress |in| on the host, averaged over a few runs. */
+static double decompression_time(int algo, char *in, int in_len, char *out,
+				 int out_len)
+{
+	decomp_func_ptr decomp = decompression_function(algo);
+	double start = now(), elapsed;
+	int runs = 0;
+
+	do {
+		if (decomp(in, in_len, out, out_len, NULL))
+			return -1;
+		runs++;
+		elapsed = now() - start;
+	} while (elapsed < 0.05);
+
+	return elapsed / runs;
+}
+
+static char *read_file(const char *name, size_t *size)
+{
+	char *data = NULL;
+	long len;
+	FILE *f;
+
+	f = fopen(name, "rb");
+	if (!f) {
+		fprintf(stderr, "could not open '%s'\n", name);
+		return NULL;
+	}
+	if (fseek(f, 0, SEEK_END) || (len = ftell(f)) <= 0) {
+		fprintf(stderr, "could not determine size of '%s'\n", name);
+		goto out;
+	}
+	rewind(f);
+	data = malloc(len);
+	if (!data || fread(data, len, 1, f) != 1) {
+		fprintf(stderr, "could not read '%s'\n", name);
+		free(data);
+		data = NULL;
+		goto out;
+	}
+	*size = len;
+out:
+	fclose(f);
+	return data;
+}
+
+struct benchmark_total {
+	size_t size;
+	double time;		/* Decompression time in seconds */
+	int available;
+};
+
+static int benchmark_data(const char *name, char *data, int size,
+			  struct benchmark_total *totals)
+{
+	const struct typedesc_t *algo;
+	char *compressed, *out;
+	int ret = 1;
+
+	compressed = malloc(size);
+	out = malloc(size);
+	if (!compressed || !out) {
+		fprintf(stderr, "out of memory\n");
+		goto out;
+	}
+
+	printf("%s: %d bytes\n", name, size);
+	printf("  %-8s %10s %7s %11s %11s\n", "algo", "size", "ratio",
+	       "comp MB/s", "decomp MB/s");
+	for (algo = types_cbfs_compression; algo->name; algo++, totals++) {
+		comp_func_ptr comp = compression_function(algo->type);
+		double start, comp_time, decomp_time;
+		int outsize;
+
+		if (!comp) {
+			printf("  %-8s not available\n", algo->name);
+			continue;
+		}
+		totals->available = 1;
+
+		start = now();
+		if (comp(data, size, compressed, &outsize)) {
+			/* cbfstool stores it uncompressed. */
+			printf("  %-8s doesn't compress\n", algo->name);
+			totals->size += size;
+			continue;
+		}
+		comp_time = now() - start;
+
+		memset(out, 0, size);
+		decomp_time = decompression_time(algo->type, compressed,
+						 outsize, out, size);
+		if (decomp_time < 0 || memcmp(out, data, size)) {
+			fprintf(stderr, "%s: decompressing '%s' failed\n",
+				algo->name, name);
+			goto out;
+		}
+
+		printf("  %-8s %10d %6.1f%% %11.1f %11.1f\n", algo->name,
+		       outsize, 100.0 * outsize / size, size / comp_time / MiB,
+		       size / decomp_time / MiB);
+		totals->size += outsize;
+		totals->time += decomp_time;
+	}
+	ret = 0;
+out:
+	free(out);
+	free(compressed);
+	return ret;
+}
+
+/*
+ * Compresses each file with every algorithm and reports the compression ratio
+ * and the compression and decompression speed on the host. Without files, it
+ * uses 10MiB of repeated usage text.
+ */
+static int benchmark(int argc, char **argv)
+{
+	struct benchmark_total totals[ARRAY_SIZE(types_cbfs_compression)] = { 0 };
+	const struct typedesc_t *algo;
+	size_t total_raw = 0;
+	int i, ret = 1;
+
+	if (argc == 0) {
+		const int bufsize = 10*1024*1024;
+		int l = strlen(usage_text) + 1;
+		char *data = malloc(bufsize);
+		if (!data) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+		for (i = 0; i + l < bufsize; i += l) {
+			memcpy(data + i, usage_text, l);
+		}
+		memset(data + i, 0, bufsize - i);
+		ret = benchmark_data("usage text", data, bufsize, totals);
+		free(data);
+		return ret;
+	}
+
+	for (i = 0; i < argc; i++) {
+		size_t size;
+		char *data = read_file(argv[i], &size);
+		if (!data)
+			return 1;
+		ret = benchmark_data(argv[i], data, size, totals);
+		free(data);
+		if (ret)
+			return ret;
+		total_raw += size;
+	}
+
+	if (argc == 1)
+		return 0;
+	printf("total: %zu bytes\n", total_raw);
+	printf("  %-8s %10s %7s %11s\n", "algo", "size", "ratio", "decomp MB/s");
+	for (algo = types_cbfs_compression, i = 0; algo->name; algo++, i++) {
+		if (!totals[i].available)
+			continue;
+		printf("  %-8s %10zu %6.1f%%", algo->name, totals[i].size,
+		       100.0 * totals[i].size / total_raw);
+		if (totals[i].time > 0)
+			printf(" %11.1f\n", total_raw / totals[i].time / MiB);
+		else
+			printf(" %11s\n", "-");
+	}
+	return 0;
+}
+
+static int select_measure(struct select_file *file, double flash_speed,
+			  double slowdown)
+{
+	const struct typedesc_t *algo;
+	char *data, *compressed = NULL, *out = NULL;
+	int ret = 1;
+
+	data = read_file(file->name, &file->size);
+	if (!data)
+		return 1;
+	compressed = malloc(file->size);
+	out = malloc(file->size);
+	if (!compressed || !out) {
+		fprintf(stderr, "out of memory\n");
+		goto out;
+	}
+
+	for (algo = types_cbfs_compression; algo->name; algo++) {
+		struct select_option *opt = &file->options[file->num_options];
+		comp_func_ptr comp = compression_function(algo->type);
+		int size;
+
+		if (!comp || comp(data, file->size, compressed, &size))
+			continue;
+		double decomp = 0;
+		if (algo->type != CBFS_COMPRESS_NONE) {
+			decomp = decompression_time(algo->type, compressed,
+						    size, out, file->size);
+			if (decomp < 0)
+				continue;
+		}
+		opt->algo = algo->type;
+		opt->size = size;
+		opt->time = size / flash_speed + decomp * slowdown;
+		file->num_options++;
+	}
+	ret = 0;
+out:
+	free(out);
+	free(compressed);
+	free(data);
+	return ret;
+}
+
+static const char *algo_name(int type)
+{
+	const struct typedesc_t *algo;
+
+	for (algo = types_cbfs_compression; algo->name; algo++) {
+		if ((int)algo->type == type)
+			return algo->name;
+	}
+	return "?";
+}
+
+/*
+ * Every file starts with its fastest option. As long as the files don't fit
+ * into the budget, switch the one file to a smaller option that costs the
+ * least load time per saved byte.
+ */
+static int select_fit(struct select_file *files, int num_files, size_t budget)
+{
+	size_t total = 0;
+	int i;
+
+	for (i = 0; i < num_files; i++) {
+		struct select_file *f = &files[i];
+		size_t j;
+
+		f->choice = 0;
+		for (j = 1; j < f->num_options; j++) {
+			if (f->options[j].time < f->options[f->choice].time)
+				f->choice = j;
+		}
+		total += f->options[f->choice].size;
+	}
+
+	while (budget && total > budget) {
+		struct select_file *best_file = NULL;
+		size_t best_opt = 0;
+		double best_cost = 0;
+
+		for (i = 0; i < num_files; i++) {
+			const struct select_option *cur =
+				&files[i].options[files[i].choice];
+			size_t j;
+
+			for (j = 0; j < files[i].num_options; j++) {
+				const struct select_option *opt =
+					&files[i].options[j];
+				if (opt->size >= cur->size)
+					continue;
+				double cost = (opt->time - cur->time) /
+					      (cur->size - opt->size);
+				if (!best_file || cost < best_cost) {
+					best_file = &files[i];
+					best_opt = j;
+					best_cost = cost;
+				}
+			}
+		}
+		if (!best_file)
+			return 1;
+
+		total -= best_file->options[best_file->choice].size;
+		best_file->choice = best_opt;
+		total += best_file->options[best_opt].size;
+	}
+	return 0;
+}
+
+static int select_algos(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{"flash-speed", required_argument, 0, 'f'},
+		{"budget",      required_argument, 0, 'b'},
+		{"slowdown",    required_argument, 0, 's'},
+		{NULL,          0,                 0,  0 }
+	};
+	double flash_speed = 0, slowdown = 1, total_time = 0;
+	size_t budget = 0, total_size = 0, total_raw = 0;
+	struct select_file *files;
+	int c, i, num_files, ret = 1;
+
+	while ((c = getopt_long(argc, argv, "f:b:s:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'f':
+			flash_speed = strtod(optarg, NULL) * MiB;
+			break;
+		case 'b':
+			budget = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			slowdown = strtod(optarg, NULL);
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	num_files = argc - optind;
+	if (flash_speed <= 0 || slowdown <= 0 || num_files <= 0) {
+		usage();
+		return 1;
+	}
+
+	files = calloc(num_files, sizeof(*files));
+	if (!files) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for (i = 0; i < num_files; i++) {
+		files[i].name = argv[optind + i];
+		if (select_measure(&files[i], flash_speed, slowdown))
+			goto out;
+	}
+
+	if (select_fit(files, num_files, budget))
+		fprintf(stderr, "The files don't fit into %zu bytes.\n", budget);
+	else
+		ret = 0;
+
+	printf("%-32s %10s", "file", "size");
+	for (const struct typedesc_t *algo = types_cbfs_compression;
+	     algo->name; algo++)
+		printf(" %10s %9s", algo->name, "time/ms");
+	printf("  choice\n");
+
+	for (i = 0; i < num_files; i++) {
+		const struct select_file *f = &files[i];
+		const struct select_option *choice = &f->options[f->choice];
+		size_t j = 0;
+
+		printf("%-32s %10zu", f->name, f->size);
+		for (const struct typedesc_t *algo = types_cbfs_compression;
+		     algo->name; algo++) {
+			if (j < f->num_options &&
+			    f->options[j].algo == (int)algo->type) {
+				printf(" %10zu %9.3f", f->options[j].size,
+				       f->options[j].time * 1000);
+				j++;
+			} else {
+				printf(" %10s %9s", "-", "-");
+			}
+		}
+		printf("  %s\n", algo_name(choice->algo));
+		total_raw += f->size;
+		total_size += choice->size;
+		total_time += choice->time;
+	}
+	printf("total: %zu bytes stored in %zu bytes", total_raw, total_size);
+	if (budget)
+		printf(" (budget %zu)", budget);
+	printf(", estimated load time %.3f ms\n", total_time * 1000);
+out:
+	free(files);
+	return ret;
+}
+
 int main(int argc, char **argv)
 {
-	if ((argc == 2) && (strcmp(argv[1], "benchmark") == 0))
-		return benchmark();
+	if ((argc >= 2) && (strcmp(argv[1], "benchmark") == 0))
+		return benchmark(argc - 2, argv + 2);
 	if ((argc == 5) && (strcmp(argv[1], "compress") == 0))
 		return compress(argv[2], argv[3], argv[4], 1);
 	if ((argc == 5) && (strcmp(argv[1], "rawcompress") == 0))
 		return compress(argv[2], argv[3], argv[4], 0);
+	if ((argc >= 2) && (strcmp(argv[1], "select") == 0))
+		return select_algos(argc - 1, argv + 1);
 	usage();
 	return 1;
 }
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <strings.h>
 #include <ctype.h>
+#include <errno.h>
 #include <unistd.h>
 #include <getopt.h>
 #include "common.h"
@@ -70,6 +71,10 @@ static struct param {
 	bool machine_parseable;
 	bool unprocessed;
 	bool ibb;
+	unsigned int threads;
+	const char *compression_cache;
+	const char *compression_cache_stats;
+	const char *movable;
 	enum comp_algo compression;
 	int precompression;
 	enum vb2_hash_algorithm hash;
@@ -77,7 +82,9 @@ static struct param {
 	char *initrd;
 	char *cmdline;
 	int force;
-} param = {
+} param;
+
+static const struct param param_defaults = {
 	/* All variables not listed are initialized as zero. */
 	.arch = CBFS_ARCHITECTURE_UNKNOWN,
 	.compression = CBFS_COMPRESS_NONE,
@@ -85,6 +92,7 @@ static struct param {
 	.headeroffset = ~0,
 	.region_name = SECTION_NAME_PRIMARY_CBFS,
 	.u64val = -1,
+	.threads = 1,
 };
 
 static bool region_is_flashmap(const char *region)
@@ -1232,6 +1240,83 @@ static int cbfs_compact(void)
 	return cbfs_compact_instance(&image);
 }
 
+/* Files read before ramstage runs, in the order they are usually needed. */
+static const char *const default_hot_files[] = {
+	"fallback/verstage",
+	"fallback/romstage",
+	"cmos_layout.bin",
+	"cmos.default",
+	"fspm.bin",
+	"spd.bin",
+	"fallback/postcar",
+	"fallback/ramstage",
+};
+
+/*
+ * Split a comma separated list of names. The names point into *buf, which
+ * the caller frees along with the returned array.
+ */
+static const char **split_names(const char *list, char **buf, size_t *num)
+{
+	const char **names = NULL;
+
+	*num = 0;
+	*buf = strdup(list);
+	if (!*buf)
+		return NULL;
+	for (char *name = strtok(*buf, ","); name; name = strtok(NULL, ",")) {
+		const char **tmp = realloc(names, (*num + 1) * sizeof(*names));
+		if (!tmp) {
+			free(names);
+			return NULL;
+		}
+		names = tmp;
+		names[(*num)++] = name;
+	}
+	return names;
+}
+
+static int cbfs_optimize(void)
+{
+	const char * const *hot = default_hot_files;
+	size_t num_hot = ARRAY_SIZE(default_hot_files), num_movable = 0;
+	const char **hot_list = NULL, **movable = NULL;
+	char *hot_buf = NULL, *movable_buf = NULL;
+	struct cbfs_image image;
+	uint64_t mmap_base;
+	int ret = 1;
+
+	if (cbfs_image_from_buffer(&image, param.image_region,
+							param.headeroffset))
+		return 1;
+
+	if (param.name) {
+		hot_list = split_names(param.name, &hot_buf, &num_hot);
+		if (!hot_list)
+			goto out;
+		hot = hot_list;
+	}
+	if (param.movable) {
+		movable = split_names(param.movable, &movable_buf,
+				      &num_movable);
+		if (!movable)
+			goto out;
+	}
+
+	/* Where the region appears in the x86 memory mapped flash. */
+	mmap_base = (1ULL << 32) -
+		convert_to_from_absolute_top_aligned(param.image_region, 0);
+
+	ret = cbfs_optimize_layout(&image, hot, num_hot, movable, num_movable,
+				   mmap_base);
+out:
+	free(movable);
+	free(movable_buf);
+	free(hot_list);
+	free(hot_buf);
+	return ret;
+}
+
 static int cbfs_expand(void)
 {
 	struct buffer src_buf;
@@ -1278,6 +1363,7 @@ static const struct command commands[] = {
 	{"create", "M:r:s:B:b:H:o:m:vh?", cbfs_create, true, true},
 	{"extract", "H:r:m:n:f:Uvh?", cbfs_extract, true, false},
 	{"layout", "wvh?", cbfs_layout, false, false},
+	{"optimize", "H:r:n:vh?", cbfs_optimize, true, true},
 	{"print", "H:r:vkh?", cbfs_print, true, false},
 	{"read", "r:f:vh?", cbfs_read, true, false},
 	{"remove", "H:r:n:vh?", cbfs_remove, true, true},
@@ -1290,6 +1376,10 @@ enum {
 	/* begin after ASCII characters */
 	LONGOPT_START = 256,
 	LONGOPT_IBB = LONGOPT_START,
+	LONGOPT_THREADS,
+	LONGOPT_COMPRESSION_CACHE,
+	LONGOPT_COMPRESSION_CACHE_STATS,
+	LONGOPT_MOVABLE,
 	LONGOPT_END,
 };
 
@@ -1333,9 +1423,37 @@ static struct option long_options[] = {
 	{"mach-parseable",no_argument,       0, 'k' },
 	{"unprocessed",   no_argument,       0, 'U' },
 	{"ibb",           no_argument,       0, LONGOPT_IBB },
+	{"threads",       required_argument, 0, LONGOPT_THREADS },
+	{"compression-cache", required_argument, 0, LONGOPT_COMPRESSION_CACHE },
+	{"compression-cache-stats", required_argument, 0,
+					LONGOPT_COMPRESSION_CACHE_STATS },
+	{"movable",       required_argument, 0, LONGOPT_MOVABLE },
 	{NULL,            0,                 0,  0  }
 };
 
+/* Regions modified by the commands of a batch, written back once at the end. */
+static struct buffer *batch_regions;
+static size_t batch_num_regions;
+/* A failing batch reports once that the image is left unmodified. */
+static bool batch_running;
+
+static void report_unmodified(void)
+{
+	if (!batch_running)
+		ERROR("The image will be left unmodified.\n");
+}
+
+/* Have getopt start over at argv[1] for the next command of a batch. */
+static void reset_getopt(void)
+{
+#ifdef __GLIBC__
+	optind = 0;
+#else
+	optreset = 1;
+	optind = 1;
+#endif
+}
+
 static int dispatch_command(struct command command)
 {
 	if (command.accesses_region) {
@@ -1347,7 +1465,7 @@ static int dispatch_command(struct command command)
 		}
 		if (!partitioned_file_read_region(param.image_region,
 					param.image_file, param.region_name)) {
-			ERROR("The image will be left unmodified.\n");
+			report_unmodified();
 			return 1;
 		}
 
@@ -1359,7 +1477,7 @@ static int dispatch_command(struct command command)
 			if (region_is_flashmap(param.region_name)) {
 				ERROR("Image region '%s' is read-only because it contains the FMAP.\n",
 							param.region_name);
-				ERROR("The image will be left unmodified.\n");
+				report_unmodified();
 				return 1;
 			}
 			// We don't allow writing raw data to regions that
@@ -1369,7 +1487,7 @@ static int dispatch_command(struct command command)
 					param.image_file, param.region_name)) {
 				ERROR("Image region '%s' is read-only because it contains nested regions.\n",
 							param.region_name);
-				ERROR("The image will be left unmodified.\n");
+				report_unmodified();
 				return 1;
 			}
 		}
@@ -1379,7 +1497,7 @@ static int dispatch_command(struct command command)
 		if (partitioned_file_is_partitioned(param.image_file)) {
 			ERROR("Failed while operating on '%s' region!\n",
 							param.region_name);
-			ERROR("The image will be left unmodified.\n");
+			report_unmodified();
 		}
 		return 1;
 	}
@@ -1401,6 +1519,11 @@ static void usage(char *name)
 	     "  -g               Generate position and alignment arguments\n"
 	     "  -U               Unprocessed; don't decompress or make ELF\n"
 	     "  -v               Provide verbose output\n"
+	     "  --threads N      Compress with up to N threads\n"
+	     "  --compression-cache DIR\n"
+	     "                   Reuse compressed data stored in DIR\n"
+	     "  --compression-cache-stats FILE\n"
+	     "                   Append cache hits and misses to FILE\n"
 	     "  -h               Display this help message\n\n"
 	     "COMMANDs:\n"
 	     " add [-r image,regions] -f FILE -n NAME -t TYPE [-A hash] \\\n"
@@ -1432,6 +1555,9 @@ static void usage(char *name)
 			"Remove a component\n"
 	     " compact -r image,regions                                    "
 			"Defragment CBFS image.\n"
+	     " optimize [-r image,regions] [-n NAME,NAME...] \\\n"
+	     "        [--movable NAME,NAME...]                             "
+			"Place early boot files first, pack the rest\n"
 	     " copy -r image,regions -R source-region                      "
 			"Create a copy (duplicate) cbfs instance in fmap\n"
 	     " create -m ARCH -s size [-b bootblock offset] \\\n"
@@ -1456,6 +1582,8 @@ static void usage(char *name)
 			"Truncate CBFS and print new size on stdout\n"
 	     " expand [-r fmap-region]                                     "
 			"Expand CBFS to span entire region\n"
+	     " batch -f MANIFEST                                           "
+			"Run the commands listed in MANIFEST\n"
 	     "OFFSETs:\n"
 	     "  Numbers accompanying -b, -H, and -o switches* may be provided\n"
 	     "  in two possible formats: if their value is greater than\n"
@@ -1486,6 +1614,22 @@ static void usage(char *name)
 	     SECTION_NAME_FMAP, SECTION_NAME_PRIMARY_CBFS,
 	     SECTION_NAME_PRIMARY_CBFS
 	     );
+	printf(
+	     "BATCH:\n"
+	     "  A MANIFEST lists one command per line, with its\n"
+	     "  parameters as they would follow FILE on the command line.\n"
+	     "  Arguments can be quoted with '' or \"\", empty lines and lines\n"
+	     "  starting with # are ignored. The image is read once and each\n"
+	     "  changed region is written back once after all commands ran,\n"
+	     "  giving the same result as running them one by one. If one\n"
+	     "  fails, the image is left unmodified. The commands create and\n"
+	     "  batch can't be used in a manifest.\n"
+	     "OPTIMIZE:\n"
+	     "  Only the early boot files given with -n (a default list of\n"
+	     "  stages and their data otherwise) and the files given with\n"
+	     "  --movable are moved. All other files keep their address, as\n"
+	     "  they may have been placed with -b to be found by it.\n"
+	     );
 }
 
 static bool valid_opt(size_t i, int c)
@@ -1505,351 +1649,587 @@ static bool valid_opt(size_t i, int c)
 	return false;
 }
 
-int main(int argc, char **argv)
+static void close_image_file(partitioned_file_t *batch_file)
 {
-	size_t i;
-	int c;
+	if (!batch_file)
+		partitioned_file_close(param.image_file);
+}
 
-	if (argc < 3) {
-		usage(argv[0]);
+static int batch_add_region(const struct buffer *region)
+{
+	struct buffer *regions;
+
+	for (size_t i = 0; i < batch_num_regions; i++) {
+		if (batch_regions[i].offset == region->offset &&
+		    batch_regions[i].size == region->size)
+			return 0;
+	}
+
+	regions = realloc(batch_regions,
+			  (batch_num_regions + 1) * sizeof(*regions));
+	if (!regions) {
+		ERROR("Out of memory.\n");
 		return 1;
 	}
+	batch_regions = regions;
+	batch_regions[batch_num_regions++] = *region;
+	return 0;
+}
 
-	char *image_name = argv[1];
-	char *cmd = argv[2];
-	optind += 2;
+/*
+ * Parse the options of commands[i] from argv, starting at optind, and run it.
+ * In batch mode, the command works on the already opened batch_file and the
+ * regions it modifies are only recorded, to be written back by cbfs_batch().
+ */
+static int run_command(size_t i, const char *image_name, int argc, char **argv,
+		       partitioned_file_t *batch_file)
+{
+	int c;
 
-	for (i = 0; i < ARRAY_SIZE(commands); i++) {
-		if (strcmp(cmd, commands[i].name) != 0)
-			continue;
+	param = param_defaults;
 
-		while (1) {
-			char *suffix = NULL;
-			int option_index = 0;
+	while (1) {
+		char *suffix = NULL;
+		int option_index = 0;
 
-			c = getopt_long(argc, argv, commands[i].optstring,
-						long_options, &option_index);
-			if (c == -1) {
-				if (optind < argc) {
-					ERROR("%s: excessive argument -- '%s'"
-						"\n", argv[0], argv[optind]);
-					return 1;
-				}
-				break;
+		c = getopt_long(argc, argv, commands[i].optstring,
+					long_options, &option_index);
+		if (c == -1) {
+			if (optind < argc) {
+				ERROR("%s: excessive argument -- '%s'"
+					"\n", argv[0], argv[optind]);
+				return 1;
 			}
+			break;
+		}
 
-			/* Filter out illegal long options */
-			if (!valid_opt(i, c)) {
-				ERROR("%s: invalid option -- '%d'\n",
-				      argv[0], c);
-				c = '?';
-			}
+		/* Filter out illegal long options */
+		if (!valid_opt(i, c)) {
+			ERROR("%s: invalid option -- '%d'\n",
+			      argv[0], c);
+			c = '?';
+		}
 
-			switch(c) {
-			case 'n':
-				param.name = optarg;
-				break;
-			case 't':
-				if (intfiletype(optarg) != ((uint64_t) - 1))
-					param.type = intfiletype(optarg);
-				else
-					param.type = strtoul(optarg, NULL, 0);
-				if (param.type == 0)
-					WARN("Unknown type '%s' ignored\n",
-							optarg);
-				break;
-			case 'c': {
-				if (strcmp(optarg, "precompression") == 0) {
-					param.precompression = 1;
-					break;
-				}
-				int algo = cbfs_parse_comp_algo(optarg);
-				if (algo >= 0)
-					param.compression = algo;
-				else
-					WARN("Unknown compression '%s' ignored.\n",
-									optarg);
-				break;
-			}
-			case 'A': {
-				int algo = cbfs_parse_hash_algo(optarg);
-				if (algo >= 0)
-					param.hash = algo;
-				else {
-					ERROR("Unknown hash algorithm '%s'.\n",
+		switch(c) {
+		case 'n':
+			param.name = optarg;
+			break;
+		case 't':
+			if (intfiletype(optarg) != ((uint64_t) - 1))
+				param.type = intfiletype(optarg);
+			else
+				param.type = strtoul(optarg, NULL, 0);
+			if (param.type == 0)
+				WARN("Unknown type '%s' ignored\n",
 						optarg);
-					return 1;
-				}
+			break;
+		case 'c': {
+			if (strcmp(optarg, "precompression") == 0) {
+				param.precompression = 1;
 				break;
 			}
-			case 'M':
-				param.fmap = optarg;
-				break;
-			case 'r':
-				param.region_name = optarg;
-				break;
-			case 'R':
-				param.source_region = optarg;
-				break;
-			case 'b':
-				param.baseaddress = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid base address '%s'.\n",
-						optarg);
-					return 1;
-				}
-				// baseaddress may be zero on non-x86, so we
-				// need an explicit "baseaddress_assigned".
-				param.baseaddress_assigned = 1;
-				break;
-			case 'l':
-				param.loadaddress = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid load address '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'e':
-				param.entrypoint = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid entry point '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 's':
-				param.size = strtoul(optarg, &suffix, 0);
-				if (!*optarg) {
-					ERROR("Empty size specified.\n");
-					return 1;
-				}
-				switch (tolower((int)suffix[0])) {
-				case 'k':
-					param.size *= 1024;
-					break;
-				case 'm':
-					param.size *= 1024 * 1024;
-					break;
-				case '\0':
-					break;
-				default:
-					ERROR("Invalid suffix for size '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'B':
-				param.bootblock = optarg;
-				break;
-			case 'H':
-				param.headeroffset = strtoul(
-						optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid header offset '%s'.\n",
-						optarg);
-					return 1;
-				}
-				param.headeroffset_assigned = 1;
-				break;
-			case 'a':
-				param.alignment = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid alignment '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'p':
-				param.padding = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid pad size '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'P':
-				param.pagesize = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid page size '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'Q':
-				param.force_pow2_pagesize = 1;
-				break;
-			case 'o':
-				param.cbfsoffset = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid cbfs offset '%s'.\n",
-						optarg);
-					return 1;
-				}
-				param.cbfsoffset_assigned = 1;
-				break;
-			case 'f':
-				param.filename = optarg;
-				break;
-			case 'F':
-				param.force = 1;
-				break;
-			case 'i':
-				param.u64val = strtoull(optarg, &suffix, 0);
-				param.u64val_assigned = 1;
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid int parameter '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'u':
-				param.fill_partial_upward = true;
-				break;
-			case 'd':
-				param.fill_partial_downward = true;
-				break;
-			case 'w':
-				param.show_immutable = true;
-				break;
-			case 'j':
-				param.topswap_size = strtol(optarg, NULL, 0);
-				if (!is_valid_topswap())
-					return 1;
-				break;
-			case 'q':
-				param.ucode_region = optarg;
-				break;
-			case 'v':
-				verbose++;
-				break;
-			case 'm':
-				param.arch = string_to_arch(optarg);
-				break;
-			case 'I':
-				param.initrd = optarg;
-				break;
-			case 'C':
-				param.cmdline = optarg;
-				break;
-			case 'S':
-				param.ignore_section = optarg;
-				break;
-			case 'y':
-				param.stage_xip = true;
-				break;
-			case 'g':
-				param.autogen_attr = true;
-				break;
+			int algo = cbfs_parse_comp_algo(optarg);
+			if (algo >= 0)
+				param.compression = algo;
+			else
+				WARN("Unknown compression '%s' ignored.\n",
+								optarg);
+			break;
+		}
+		case 'A': {
+			int algo = cbfs_parse_hash_algo(optarg);
+			if (algo >= 0)
+				param.hash = algo;
+			else {
+				ERROR("Unknown hash algorithm '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		}
+		case 'M':
+			param.fmap = optarg;
+			break;
+		case 'r':
+			param.region_name = optarg;
+			break;
+		case 'R':
+			param.source_region = optarg;
+			break;
+		case 'b':
+			param.baseaddress = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid base address '%s'.\n",
+					optarg);
+				return 1;
+			}
+			// baseaddress may be zero on non-x86, so we
+			// need an explicit "baseaddress_assigned".
+			param.baseaddress_assigned = 1;
+			break;
+		case 'l':
+			param.loadaddress = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid load address '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'e':
+			param.entrypoint = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid entry point '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			param.size = strtoul(optarg, &suffix, 0);
+			if (!*optarg) {
+				ERROR("Empty size specified.\n");
+				return 1;
+			}
+			switch (tolower((int)suffix[0])) {
 			case 'k':
-				param.machine_parseable = true;
+				param.size *= 1024;
 				break;
-			case 'U':
-				param.unprocessed = true;
+			case 'm':
+				param.size *= 1024 * 1024;
 				break;
-			case LONGOPT_IBB:
-				param.ibb = true;
+			case '\0':
 				break;
-			case 'h':
-			case '?':
-				usage(argv[0]);
-				return 1;
 			default:
-				break;
+				ERROR("Invalid suffix for size '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'B':
+			param.bootblock = optarg;
+			break;
+		case 'H':
+			param.headeroffset = strtoul(
+					optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid header offset '%s'.\n",
+					optarg);
+				return 1;
+			}
+			param.headeroffset_assigned = 1;
+			break;
+		case 'a':
+			param.alignment = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid alignment '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'p':
+			param.padding = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid pad size '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'P':
+			param.pagesize = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid page size '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'Q':
+			param.force_pow2_pagesize = 1;
+			break;
+		case 'o':
+			param.cbfsoffset = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid cbfs offset '%s'.\n",
+					optarg);
+				return 1;
+			}
+			param.cbfsoffset_assigned = 1;
+			break;
+		case 'f':
+			param.filename = optarg;
+			break;
+		case 'F':
+			param.force = 1;
+			break;
+		case 'i':
+			param.u64val = strtoull(optarg, &suffix, 0);
+			param.u64val_assigned = 1;
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid int parameter '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'u':
+			param.fill_partial_upward = true;
+			break;
+		case 'd':
+			param.fill_partial_downward = true;
+			break;
+		case 'w':
+			param.show_immutable = true;
+			break;
+		case 'j':
+			param.topswap_size = strtol(optarg, NULL, 0);
+			if (!is_valid_topswap())
+				return 1;
+			break;
+		case 'q':
+			param.ucode_region = optarg;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		case 'm':
+			param.arch = string_to_arch(optarg);
+			break;
+		case 'I':
+			param.initrd = optarg;
+			break;
+		case 'C':
+			param.cmdline = optarg;
+			break;
+		case 'S':
+			param.ignore_section = optarg;
+			break;
+		case 'y':
+			param.stage_xip = true;
+			break;
+		case 'g':
+			param.autogen_attr = true;
+			break;
+		case 'k':
+			param.machine_parseable = true;
+			break;
+		case 'U':
+			param.unprocessed = true;
+			break;
+		case LONGOPT_IBB:
+			param.ibb = true;
+			break;
+		case LONGOPT_COMPRESSION_CACHE:
+			param.compression_cache = optarg;
+			break;
+		case LONGOPT_COMPRESSION_CACHE_STATS:
+			param.compression_cache_stats = optarg;
+			break;
+		case LONGOPT_MOVABLE:
+			param.movable = optarg;
+			break;
+		case LONGOPT_THREADS:
+			param.threads = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix) || !param.threads) {
+				ERROR("Invalid thread count '%s'.\n",
+					optarg);
+				return 1;
 			}
+			break;
+		case 'h':
+		case '?':
+			usage(argv[0]);
+			return 1;
+		default:
+			break;
 		}
+	}
 
-		if (commands[i].function == cbfs_create) {
-			if (param.fmap) {
-				struct buffer flashmap;
-				if (buffer_from_file(&flashmap, param.fmap))
-					return 1;
-				param.image_file = partitioned_file_create(
-							image_name, &flashmap);
-				buffer_delete(&flashmap);
-			} else if (param.size) {
-				param.image_file = partitioned_file_create_flat(
-							image_name, param.size);
-			} else {
-				ERROR("You need to specify a valid -M/--flashmap or -s/--size.\n");
+	do_lzma_set_threads(param.threads);
+	compression_cache_init(param.compression_cache,
+			       param.compression_cache_stats);
+
+	if (batch_file) {
+		param.image_file = batch_file;
+	} else if (commands[i].function == cbfs_create) {
+		if (param.fmap) {
+			struct buffer flashmap;
+			if (buffer_from_file(&flashmap, param.fmap))
 				return 1;
-			}
+			param.image_file = partitioned_file_create(
+						image_name, &flashmap);
+			buffer_delete(&flashmap);
+		} else if (param.size) {
+			param.image_file = partitioned_file_create_flat(
+						image_name, param.size);
 		} else {
-			bool write_access = commands[i].modifies_region;
+			ERROR("You need to specify a valid -M/--flashmap or -s/--size.\n");
+			return 1;
+		}
+	} else {
+		bool write_access = commands[i].modifies_region;
+
+		param.image_file =
+			partitioned_file_reopen(image_name,
+						write_access);
+	}
+	if (!param.image_file)
+		return 1;
 
-			param.image_file =
-				partitioned_file_reopen(image_name,
-							write_access);
+	unsigned num_regions = 1;
+	for (const char *list = strchr(param.region_name, ','); list;
+					list = strchr(list + 1, ','))
+		++num_regions;
+
+	// If the action needs to read an image region, as indicated by
+	// having accesses_region set in its command struct, that
+	// region's buffer struct will be stored here and the client
+	// will receive a pointer to it via param.image_region. It
+	// need not write the buffer back to the image file itself,
+	// since this behavior can be requested via its modifies_region
+	// field. Additionally, it should never free the region buffer,
+	// as that is performed automatically once it completes.
+	struct buffer image_regions[num_regions];
+	memset(image_regions, 0, sizeof(image_regions));
+
+	bool seen_primary_cbfs = false;
+	char region_name_scratch[strlen(param.region_name) + 1];
+	strcpy(region_name_scratch, param.region_name);
+	param.region_name = strtok(region_name_scratch, ",");
+	for (unsigned region = 0; region < num_regions; ++region) {
+		if (!param.region_name) {
+			ERROR("Encountered illegal degenerate region name in -r list\n");
+			report_unmodified();
+			close_image_file(batch_file);
+			return 1;
 		}
-		if (!param.image_file)
+
+		if (strcmp(param.region_name, SECTION_NAME_PRIMARY_CBFS)
+								== 0)
+			seen_primary_cbfs = true;
+
+		param.image_region = image_regions + region;
+		if (dispatch_command(commands[i])) {
+			close_image_file(batch_file);
 			return 1;
+		}
+
+		param.region_name = strtok(NULL, ",");
+	}
+
+	if (commands[i].function == cbfs_create && !seen_primary_cbfs) {
+		ERROR("The creation -r list must include the mandatory '%s' section.\n",
+					SECTION_NAME_PRIMARY_CBFS);
+		report_unmodified();
+		close_image_file(batch_file);
+		return 1;
+	}
+
+	if (commands[i].modifies_region) {
+		assert(param.image_file);
+		for (unsigned region = 0; region < num_regions;
+							++region) {
+			if (batch_file) {
+				if (batch_add_region(image_regions + region))
+					return 1;
+				continue;
+			}
 
-		unsigned num_regions = 1;
-		for (const char *list = strchr(param.region_name, ','); list;
-						list = strchr(list + 1, ','))
-			++num_regions;
-
-		// If the action needs to read an image region, as indicated by
-		// having accesses_region set in its command struct, that
-		// region's buffer struct will be stored here and the client
-		// will receive a pointer to it via param.image_region. It
-		// need not write the buffer back to the image file itself,
-		// since this behavior can be requested via its modifies_region
-		// field. Additionally, it should never free the region buffer,
-		// as that is performed automatically once it completes.
-		struct buffer image_regions[num_regions];
-		memset(image_regions, 0, sizeof(image_regions));
-
-		bool seen_primary_cbfs = false;
-		char region_name_scratch[strlen(param.region_name) + 1];
-		strcpy(region_name_scratch, param.region_name);
-		param.region_name = strtok(region_name_scratch, ",");
-		for (unsigned region = 0; region < num_regions; ++region) {
-			if (!param.region_name) {
-				ERROR("Encountered illegal degenerate region name in -r list\n");
-				ERROR("The image will be left unmodified.\n");
-				partitioned_file_close(param.image_file);
+			if (!partitioned_file_write_region(
+						param.image_file,
+					image_regions + region)) {
+				partitioned_file_close(
+						param.image_file);
 				return 1;
 			}
+		}
+	}
+
+	if (!batch_file)
+		partitioned_file_close(param.image_file);
+	return 0;
+}
+
+/*
+ * Split a manifest line into words in place, like a shell would for simple
+ * quoting: words are separated by blanks, '' and "" quote and a backslash
+ * escapes the next character. A # at the start of a word comments out the
+ * rest of the line. Returns the number of words or -1 on a syntax error.
+ */
+static int split_line(char *line, char **words, int max_words)
+{
+	char *in = line, *out;
+	int count = 0;
+
+	while (1) {
+		while (isspace((unsigned char)*in))
+			in++;
+		if (!*in || *in == '#')
+			return count;
+		if (count == max_words) {
+			ERROR("Too many arguments.\n");
+			return -1;
+		}
+
+		words[count++] = out = in;
+		char quote = 0;
+		while (*in && (quote || !isspace((unsigned char)*in))) {
+			if (quote && *in == quote) {
+				quote = 0;
+				in++;
+			} else if (!quote && (*in == '\'' || *in == '"')) {
+				quote = *in++;
+			} else if (*in == '\\' && quote != '\'' && in[1]) {
+				in++;
+				*out++ = *in++;
+			} else {
+				*out++ = *in++;
+			}
+		}
+		if (quote) {
+			ERROR("Unterminated quote.\n");
+			return -1;
+		}
+		if (*in)
+			in++;
+		*out = '\0';
+	}
+}
 
-			if (strcmp(param.region_name, SECTION_NAME_PRIMARY_CBFS)
-									== 0)
-				seen_primary_cbfs = true;
+#define BATCH_MAX_ARGS	64
 
-			param.image_region = image_regions + region;
-			if (dispatch_command(commands[i])) {
-				partitioned_file_close(param.image_file);
+/*
+ * Run every command of a manifest on the image, which is only read once.
+ * The regions the commands modify are written back after all of them
+ * succeeded, so a failing manifest leaves the image untouched.
+ */
+static int cbfs_batch(const char *image_name, int argc, char **argv)
+{
+	const char *manifest = NULL;
+	char *line = NULL;
+	size_t line_size = 0;
+	unsigned line_num = 0;
+	int base_verbose, ret = 1;
+	partitioned_file_t *image_file = NULL;
+	FILE *f;
+
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "f:vh", long_options,
+				    &option_index);
+		if (c == -1) {
+			if (optind < argc) {
+				ERROR("%s: excessive argument -- '%s'\n",
+				      argv[0], argv[optind]);
 				return 1;
 			}
-
-			param.region_name = strtok(NULL, ",");
+			break;
 		}
 
-		if (commands[i].function == cbfs_create && !seen_primary_cbfs) {
-			ERROR("The creation -r list must include the mandatory '%s' section.\n",
-						SECTION_NAME_PRIMARY_CBFS);
-			ERROR("The image will be left unmodified.\n");
-			partitioned_file_close(param.image_file);
+		switch (c) {
+		case 'f':
+			manifest = optarg;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		default:
+			usage(argv[0]);
 			return 1;
 		}
+	}
 
-		if (commands[i].modifies_region) {
-			assert(param.image_file);
-			for (unsigned region = 0; region < num_regions;
-								++region) {
+	if (!manifest) {
+		ERROR("You need to specify -f/--file.\n");
+		return 1;
+	}
 
-				if (!partitioned_file_write_region(
-							param.image_file,
-						image_regions + region)) {
-					partitioned_file_close(
-							param.image_file);
-					return 1;
-				}
-			}
+	f = fopen(manifest, "r");
+	if (!f) {
+		ERROR("Could not open %s: %s\n", manifest, strerror(errno));
+		return 1;
+	}
+
+	image_file = partitioned_file_reopen(image_name, true);
+	if (!image_file)
+		goto out;
+
+	base_verbose = verbose;
+	batch_running = true;
+	while (getline(&line, &line_size, f) != -1) {
+		char *args[BATCH_MAX_ARGS + 1];
+		size_t i;
+		int num;
+
+		line_num++;
+		/* getopt expects the program name in front of the arguments. */
+		args[0] = argv[0];
+		num = split_line(line, args + 1, BATCH_MAX_ARGS - 1);
+		if (num < 0) {
+			ERROR("%s:%u: Invalid command.\n", manifest, line_num);
+			goto out;
 		}
+		if (!num)
+			continue;
+		args[num + 1] = NULL;
 
-		partitioned_file_close(param.image_file);
-		return 0;
+		for (i = 0; i < ARRAY_SIZE(commands); i++) {
+			if (strcmp(args[1], commands[i].name) == 0)
+				break;
+		}
+		if (i == ARRAY_SIZE(commands) ||
+		    commands[i].function == cbfs_create) {
+			ERROR("%s:%u: Command '%s' can't be used in a batch.\n",
+			      manifest, line_num, args[1]);
+			goto out;
+		}
+
+		/* Drop the command name and have getopt start over. */
+		args[1] = args[0];
+		reset_getopt();
+		verbose = base_verbose;
+		if (run_command(i, image_name, num, args + 1, image_file)) {
+			ERROR("%s:%u: Command '%s' failed.\n", manifest,
+			      line_num, commands[i].name);
+			goto out;
+		}
+	}
+
+	for (size_t i = 0; i < batch_num_regions; i++) {
+		if (!partitioned_file_write_region(image_file,
+						   batch_regions + i))
+			goto out;
+	}
+	ret = 0;
+
+out:
+	batch_running = false;
+	if (ret)
+		ERROR("The image will be left unmodified.\n");
+	free(batch_regions);
+	batch_regions = NULL;
+	batch_num_regions = 0;
+	free(line);
+	partitioned_file_close(image_file);
+	fclose(f);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	size_t i;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	char *image_name = argv[1];
+	char *cmd = argv[2];
+	optind += 2;
+
+	if (strcmp(cmd, "batch") == 0)
+		return cbfs_batch(image_name, argc, argv);
+
+	for (i = 0; i < ARRAY_SIZE(commands); i++) {
+		if (strcmp(cmd, commands[i].name) == 0)
+			return run_command(i, image_name, argc, argv, NULL);
 	}
 
 	ERROR("Unknown command '%s'.\n", cmd);
@@ -151,6 +151,7 @@ enum comp_algo {
 	CBFS_COMPRESS_NONE = 0,
 	CBFS_COMPRESS_LZMA = 1,
 	CBFS_COMPRESS_LZ4 = 2,
+	CBFS_COMPRESS_ZSTD = 3,
 };
 
 struct typedesc_t {
@@ -162,12 +163,20 @@ static const struct typedesc_t types_cbfs_compression[] = {
 	{CBFS_COMPRESS_NONE, "none"},
 	{CBFS_COMPRESS_LZMA, "LZMA"},
 	{CBFS_COMPRESS_LZ4, "LZ4"},
+	{CBFS_COMPRESS_ZSTD, "ZSTD"},
 	{0, NULL},
 };
 
 comp_func_ptr compression_function(enum comp_algo algo);
 decomp_func_ptr decompression_function(enum comp_algo algo);
 
+/* compress_cache.c */
+/* Cache compressed data in |dir|, NULL disables the cache. At exit, the number
+   of cache hits and misses is appended to |stats| if it isn't NULL. */
+void compression_cache_init(const char *dir, const char *stats);
+int compression_cache_compress(enum comp_algo algo, comp_func_ptr compress,
+			       char *in, int in_len, char *out, int *out_len);
+
 uint64_t intfiletype(const char *name);
 
 /* cbfs-mkpayload.c */
@@ -198,6 +207,8 @@ void print_supported_filetypes(void);
 
 /* lzma/lzma.c */
 int do_lzma_compress(char *in, int in_len, char *out, int *out_len);
+/* Threads used by do_lzma_compress(), the output is the same for any count. */
+void do_lzma_set_threads(int threads);
 int do_lzma_uncompress(char *dst, int dst_len, char *src, int src_len,
 			size_t *actual_size);
 
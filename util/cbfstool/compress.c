@@ -1,14 +1,18 @@
 /* compression handling for cbfstool */
 /* SPDX-License-Identifier: GPL-2.0-only */
 
+#include <pthread.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "common.h"
 #include "lz4/lib/lz4frame.h"
 #include <commonlib/bsd/compression.h>
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
 
-static int lz4_compress(char *in, int in_len, char *out, int *out_len)
+static int lz4_compress_frame(char *in, int in_len, char *out, int *out_len)
 {
 	LZ4F_preferences_t prefs = {
 		.compressionLevel = 20,
@@ -29,6 +33,12 @@ static int lz4_compress(char *in, int in_len, char *out, int *out_len)
 	return 0;
 }
 
+static int lz4_compress(char *in, int in_len, char *out, int *out_len)
+{
+	return compression_cache_compress(CBFS_COMPRESS_LZ4, lz4_compress_frame,
+					  in, in_len, out, out_len);
+}
+
 static int lz4_decompress(char *in, int in_len, char *out, int out_len,
 			  size_t *actual_size)
 {
@@ -42,7 +52,8 @@ static int lz4_decompress(char *in, int in_len, char *out, int out_len,
 
 static int lzma_compress(char *in, int in_len, char *out, int *out_len)
 {
-	return do_lzma_compress(in, in_len, out, out_len);
+	return compression_cache_compress(CBFS_COMPRESS_LZMA, do_lzma_compress,
+					  in, in_len, out, out_len);
 }
 
 static int lzma_decompress(char *in, int in_len, char *out, unused int out_len,
@@ -50,6 +61,54 @@ static int lzma_decompress(char *in, int in_len, char *out, unused int out_len,
 {
 	return do_lzma_uncompress(out, out_len, in, in_len, actual_size);
 }
+
+#ifdef HAVE_LIBZSTD
+static int zstd_compress_frame(char *in, int in_len, char *out, int *out_len)
+{
+	size_t worst_size = ZSTD_compressBound(in_len);
+	void *bounce = malloc(worst_size);
+	size_t result;
+
+	if (!bounce)
+		return -1;
+	/* The decoder doesn't check the checksum, don't store one. */
+	result = ZSTD_compress(bounce, worst_size, in, in_len, 19);
+	if (ZSTD_isError(result) || result >= (size_t)in_len) {
+		free(bounce);
+		return -1;
+	}
+	memcpy(out, bounce, result);
+	*out_len = result;
+	free(bounce);
+	return 0;
+}
+
+static int zstd_compress(char *in, int in_len, char *out, int *out_len)
+{
+	return compression_cache_compress(CBFS_COMPRESS_ZSTD,
+					  zstd_compress_frame, in, in_len, out,
+					  out_len);
+}
+#endif
+
+/* uzstdn() keeps its decoding tables in static storage, it's firmware code. */
+static pthread_mutex_t zstd_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int zstd_decompress(char *in, int in_len, char *out, int out_len,
+			   size_t *actual_size)
+{
+	size_t result;
+
+	pthread_mutex_lock(&zstd_lock);
+	result = uzstdn(in, in_len, out, out_len);
+	pthread_mutex_unlock(&zstd_lock);
+	if (result == 0)
+		return -1;
+	if (actual_size != NULL)
+		*actual_size = result;
+	return 0;
+}
+
 static int none_compress(char *in, int in_len, char *out, int *out_len)
 {
 	memcpy(out, in, in_len);
@@ -79,6 +138,15 @@ comp_func_ptr compression_function(enum comp_algo algo)
 	case CBFS_COMPRESS_LZ4:
 		compress = lz4_compress;
 		break;
+	case CBFS_COMPRESS_ZSTD:
+#ifdef HAVE_LIBZSTD
+		compress = zstd_compress;
+		break;
+#else
+		ERROR("cbfstool was built without libzstd, "
+		      "can't compress with Zstandard!\n");
+		return NULL;
+#endif
 	default:
 		ERROR("Unknown compression algorithm %d!\n", algo);
 		return NULL;
@@ -99,6 +167,9 @@ decomp_func_ptr decompression_function(enum comp_algo algo)
 	case CBFS_COMPRESS_LZ4:
 		decompress = lz4_decompress;
 		break;
+	case CBFS_COMPRESS_ZSTD:
+		decompress = zstd_decompress;
+		break;
 	default:
 		ERROR("Unknown compression algorithm %d!\n", algo);
 		return NULL;
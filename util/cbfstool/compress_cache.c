@@ -0,0 +1,218 @@
+/* On-disk cache of compressed data for cbfstool */
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vb2_sha.h>
+#include "common.h"
+
+/*
+ * Every entry is a file named after the SHA-256 of the cbfstool binary, the
+ * algorithm and the SHA-256 of the input. Hashing the binary covers the
+ * compression parameters and the version of the compressors, so entries are
+ * shared between builds only if the tool is the same. Failed compressions are
+ * cached as well, they fall back to storing the data uncompressed.
+ */
+
+#define CACHE_MAGIC	"CBFSCC01"
+#define KEY_SIZE	VB2_SHA256_DIGEST_SIZE
+
+struct cache_entry_header {
+	char magic[8];
+	uint32_t algo;
+	uint32_t in_len;
+	int32_t result;
+	uint32_t out_len;
+};
+
+static char *cache_dir;
+static char *stats_file;
+static bool tool_hashed;
+static uint8_t tool_digest[KEY_SIZE];
+static unsigned int hits, misses;
+
+static void write_stats(void)
+{
+	FILE *f;
+
+	if (!stats_file || !(hits + misses))
+		return;
+
+	/* One line per process, the build adds them up. */
+	f = fopen(stats_file, "a");
+	if (!f)
+		return;
+	fprintf(f, "%u %u\n", hits, misses);
+	fclose(f);
+}
+
+void compression_cache_init(const char *dir, const char *stats)
+{
+	static bool registered;
+
+	free(cache_dir);
+	free(stats_file);
+	cache_dir = dir ? strdup(dir) : NULL;
+	stats_file = stats ? strdup(stats) : NULL;
+
+	if (!registered) {
+		atexit(write_stats);
+		registered = true;
+	}
+}
+
+static bool hash_tool(void)
+{
+	char *exe = NULL;
+	size_t size = 0, len;
+	bool ret = false;
+	FILE *f;
+
+	if (tool_hashed)
+		return true;
+
+	/* This isn't in common.c, cbfs-compression-tool doesn't link it. */
+	f = fopen("/proc/self/exe", "rb");
+	if (!f)
+		return false;
+	do {
+		char *tmp = realloc(exe, size + 64 * KiB);
+		if (!tmp)
+			goto out;
+		exe = tmp;
+		len = fread(exe + size, 1, 64 * KiB, f);
+		size += len;
+	} while (len == 64 * KiB);
+
+	if (!ferror(f) && !vb2_digest_buffer((uint8_t *)exe, size,
+					     VB2_HASH_SHA256, tool_digest,
+					     sizeof(tool_digest)))
+		tool_hashed = ret = true;
+out:
+	free(exe);
+	fclose(f);
+	return ret;
+}
+
+static char *entry_path(enum comp_algo algo, const char *in, int in_len)
+{
+	uint8_t key[KEY_SIZE * 2 + sizeof(uint32_t)];
+	uint8_t digest[KEY_SIZE];
+	uint32_t algo32 = algo;
+	char *path, *p;
+	size_t i;
+
+	memcpy(key, tool_digest, KEY_SIZE);
+	memcpy(key + KEY_SIZE, &algo32, sizeof(algo32));
+	if (vb2_digest_buffer((const uint8_t *)in, in_len, VB2_HASH_SHA256,
+			      key + KEY_SIZE + sizeof(algo32), KEY_SIZE) ||
+	    vb2_digest_buffer(key, sizeof(key), VB2_HASH_SHA256, digest,
+			      sizeof(digest)))
+		return NULL;
+
+	path = malloc(strlen(cache_dir) + 1 + 2 * sizeof(digest) + 1);
+	if (!path)
+		return NULL;
+	p = path + sprintf(path, "%s/", cache_dir);
+	for (i = 0; i < sizeof(digest); i++)
+		p += sprintf(p, "%02x", digest[i]);
+	return path;
+}
+
+static bool cache_read(const char *path, enum comp_algo algo, int in_len,
+		       char *out, int *out_len, int *result)
+{
+	struct cache_entry_header header;
+	bool found = false;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return false;
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) ||
+	    header.algo != (uint32_t)algo || header.in_len != (uint32_t)in_len ||
+	    header.out_len > (uint32_t)in_len)
+		goto out;
+
+	if (!header.result &&
+	    fread(out, 1, header.out_len, f) != header.out_len)
+		goto out;
+
+	*out_len = header.out_len;
+	*result = header.result;
+	found = true;
+out:
+	fclose(f);
+	return found;
+}
+
+static void cache_write(const char *path, enum comp_algo algo, int in_len,
+			const char *out, int out_len, int result)
+{
+	struct cache_entry_header header = {
+		.algo = algo,
+		.in_len = in_len,
+		.result = result,
+		.out_len = result ? 0 : out_len,
+	};
+	char tmp[strlen(path) + 32];
+	FILE *f;
+
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+
+	/* Other builds may use the same cache concurrently, only ever
+	   rename complete entries into place. */
+	snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+	f = fopen(tmp, "wb");
+	if (!f) {
+		WARN("Can't write compression cache entry %s: %s\n", tmp,
+		     strerror(errno));
+		return;
+	}
+	if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+	    fwrite(out, 1, header.out_len, f) != header.out_len) {
+		fclose(f);
+		unlink(tmp);
+		return;
+	}
+	if (fclose(f) || rename(tmp, path))
+		unlink(tmp);
+}
+
+int compression_cache_compress(enum comp_algo algo, comp_func_ptr compress,
+			       char *in, int in_len, char *out, int *out_len)
+{
+	char *path;
+	int result;
+
+	if (!cache_dir || in_len <= 0)
+		return compress(in, in_len, out, out_len);
+
+	if (!hash_tool()) {
+		WARN("Can't identify cbfstool, not using the compression cache.\n");
+		free(cache_dir);
+		cache_dir = NULL;
+		return compress(in, in_len, out, out_len);
+	}
+
+	path = entry_path(algo, in, in_len);
+	if (!path)
+		return compress(in, in_len, out, out_len);
+
+	if (cache_read(path, algo, in_len, out, out_len, &result)) {
+		hits++;
+	} else {
+		result = compress(in, in_len, out, out_len);
+		cache_write(path, algo, in_len, out, result ? 0 : *out_len,
+			    result);
+		misses++;
+	}
+
+	free(path);
+	return result;
+}
@@ -0,0 +1,829 @@
+/* imgdifftool, CLI utility for comparing firmware images */
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vb2_sha.h>
+#include <commonlib/endian.h>
+
+#include "common.h"
+#include "cbfs.h"
+#include "cbfs_image.h"
+#include "cbfs_sections.h"
+#include "fmap.h"
+#include "ifdtool.h"
+
+/*
+ * Both images are decoded into a flat list of entries: the regions of the
+ * Intel Firmware Descriptor, the FMAP areas and the files of every CBFS. The
+ * images are loaded and decoded in one thread each, then a pool of threads
+ * hashes all entries of both images. Compressed CBFS files, including the
+ * program data of stages and payload segments, are hashed after
+ * decompression, so a file that was only recompressed is told apart from one
+ * whose contents changed.
+ */
+
+#define IFD_SIGNATURE		0x0FF0A55A
+#define HASH_SIZE		VB2_SHA256_DIGEST_SIZE
+#define SHORT_HASH_SIZE		8
+
+enum section_type {
+	SECTION_IFD,
+	SECTION_FMAP,
+	SECTION_CBFS,
+};
+
+struct entry {
+	enum section_type section_type;
+	char section[FMAP_STRLEN + 8];
+	char *name;
+	/* FLREG of IFD regions, flags of FMAP areas, file type in CBFS */
+	uint32_t type;
+	uint32_t offset;
+	uint32_t size;
+	/* Only used for CBFS files */
+	uint32_t compression;
+	size_t data_size;
+
+	char *data;
+	bool decoded;
+	uint8_t hash[HASH_SIZE];
+	struct entry *match;
+};
+
+struct image {
+	const char *path;
+	struct buffer buffer;
+	uint8_t hash[HASH_SIZE];
+	bool failed;
+
+	struct entry *entries;
+	size_t num_entries;
+	size_t max_entries;
+};
+
+static const char *optstring = "j:pvh?";
+static struct option long_options[] = {
+	{"jobs",      required_argument, 0, 'j' },
+	{"parseable", no_argument,       0, 'p' },
+	{"verbose",   no_argument,       0, 'v' },
+	{"help",      no_argument,       0, 'h' },
+	{NULL,        0,                 0,  0  }
+};
+
+static struct {
+	unsigned int jobs;
+	bool parseable;
+	bool show_all;
+} param;
+
+/* The -i/-x region names of ifdtool */
+static const char *const ifd_region_names[MAX_REGIONS] = {
+	"fd", "bios", "me", "gbe", "pd", "res1", "res2", "res3", "ec",
+};
+
+static void usage(const char *name)
+{
+	printf("imgdifftool: compare the IFD, FMAP and CBFS contents of two "
+	       "firmware images\n\n"
+	       "USAGE: %s [-h] [-v] [-p] [-j jobs] OLD NEW\n"
+	       "\tOPTIONs:\n"
+	       "\t\t-j|--jobs <n>    : Number of threads (default: number of CPUs)\n"
+	       "\t\t-p|--parseable   : Print one tab separated line per entry\n"
+	       "\t\t-v|--verbose     : Print unchanged entries as well\n"
+	       "\t\t-h|--help        : Print this help\n"
+	       "\n"
+	       "The exit status is 0 if the images are the same, 1 if they "
+	       "differ and 2 on errors.\n",
+	       name);
+}
+
+static struct entry *add_entry(struct image *image, enum section_type type,
+			       const char *section, const char *name,
+			       size_t name_len)
+{
+	struct entry *entry;
+
+	if (image->num_entries == image->max_entries) {
+		size_t max = image->max_entries ? image->max_entries * 2 : 256;
+		struct entry *tmp = realloc(image->entries,
+					    max * sizeof(*tmp));
+		if (!tmp)
+			return NULL;
+		image->entries = tmp;
+		image->max_entries = max;
+	}
+
+	entry = &image->entries[image->num_entries];
+	memset(entry, 0, sizeof(*entry));
+	entry->name = strndup(name, name_len);
+	if (!entry->name)
+		return NULL;
+	entry->section_type = type;
+	snprintf(entry->section, sizeof(entry->section), "%s", section);
+	image->num_entries++;
+	return entry;
+}
+
+/* Points the entry at its data, if the data is inside the image. */
+static void set_entry_data(struct image *image, struct entry *entry)
+{
+	if (entry->offset <= image->buffer.size &&
+	    entry->size <= image->buffer.size - entry->offset)
+		entry->data = image->buffer.data + entry->offset;
+}
+
+static int decode_ifd(struct image *image)
+{
+	const uint32_t *flreg;
+	uint32_t flmap0, frba;
+	size_t fd;
+
+	/* The descriptor starts the flash, its signature is at offset 0 or,
+	   from the 5 series on, at 0x10. */
+	for (fd = 0; fd <= 0x10; fd += 0x10) {
+		if (fd + 8 <= image->buffer.size &&
+		    read_le32(image->buffer.data + fd) == IFD_SIGNATURE)
+			break;
+	}
+	if (fd > 0x10)
+		return 0;
+
+	flmap0 = read_le32(image->buffer.data + fd + 4);
+	frba = ((flmap0 >> 16) & 0xff) << 4;
+	if (frba + sizeof(frba_t) > image->buffer.size) {
+		WARN("%s: Flash region section is outside the image.\n",
+		     image->path);
+		return 0;
+	}
+	flreg = (const uint32_t *)(image->buffer.data + frba);
+
+	for (unsigned int i = 0; i < MAX_REGIONS; i++) {
+		uint32_t value = read_le32(&flreg[i]);
+		/* IFDv1 leaves the upper bits of base and limit zero, so the
+		   IFDv2 masks work for both. */
+		uint32_t base = (value & 0x7fff) << 12;
+		uint32_t limit = ((value >> 4) & 0x7fff000) | 0xfff;
+		struct entry *entry;
+
+		/* Unused regions have a base above their limit. */
+		if (base > limit)
+			continue;
+
+		entry = add_entry(image, SECTION_IFD, "IFD",
+				  ifd_region_names[i],
+				  strlen(ifd_region_names[i]));
+		if (!entry)
+			return -1;
+		entry->type = value;
+		entry->offset = base;
+		entry->size = limit - base + 1;
+		set_entry_data(image, entry);
+	}
+	return 0;
+}
+
+static int decode_cbfs(struct image *image, const char *region,
+		       uint32_t offset, uint32_t size)
+{
+	struct cbfs_image cbfs;
+	struct buffer buffer;
+	struct cbfs_file *file;
+	char section[FMAP_STRLEN + 8];
+
+	buffer_splice(&buffer, &image->buffer, offset, size);
+
+	/* Don't make cbfs_image_from_buffer() complain about every region
+	   that isn't a CBFS. */
+	buffer_clone(&cbfs.buffer, &buffer);
+	if (!cbfs_is_valid_cbfs(&cbfs) &&
+	    (offset || !cbfs_find_header(buffer.data, buffer.size, ~0u)))
+		return 0;
+	if (cbfs_image_from_buffer(&cbfs, &buffer, ~0u))
+		return 0;
+
+	snprintf(section, sizeof(section), "CBFS %s", region);
+	for (file = cbfs_find_first_entry(&cbfs);
+	     file && cbfs_is_valid_entry(&cbfs, file);
+	     file = cbfs_find_next_entry(&cbfs, file)) {
+		uint32_t type = ntohl(file->type);
+		uint32_t addr = cbfs_get_entry_addr(&cbfs, file);
+		uint32_t data_size;
+		struct entry *entry;
+
+		if (type == CBFS_COMPONENT_NULL ||
+		    type == CBFS_COMPONENT_DELETED)
+			continue;
+		/* Don't trust the file header, it's the image being checked. */
+		if (ntohl(file->offset) < sizeof(*file) ||
+		    ntohl(file->offset) > size - addr ||
+		    ntohl(file->len) > size - addr - ntohl(file->offset)) {
+			WARN("%s: %s in %s is truncated.\n", image->path,
+			     file->filename, region);
+			continue;
+		}
+
+		entry = add_entry(image, SECTION_CBFS, section, file->filename,
+				  strnlen(file->filename, ntohl(file->offset) -
+					  sizeof(*file)));
+		if (!entry)
+			return -1;
+		entry->type = type;
+		entry->offset = offset + addr;
+		entry->size = ntohl(file->len);
+		entry->compression = cbfs_file_get_compression_info(file,
+								    &data_size);
+		entry->data_size = data_size;
+		entry->data = CBFS_SUBHEADER(file);
+	}
+	return 0;
+}
+
+/* A region that starts where a smaller one starts holds that one, the CBFS
+   is the smaller region. */
+static bool is_parent_area(const struct fmap *fmap,
+			   const struct fmap_area *area)
+{
+	for (unsigned int i = 0; i < fmap->nareas; i++) {
+		if (fmap->areas[i].offset == area->offset &&
+		    fmap->areas[i].size < area->size)
+			return true;
+	}
+	return false;
+}
+
+static int decode_fmap(struct image *image)
+{
+	const struct fmap *fmap;
+	long int fmap_offset;
+
+	fmap_offset = fmap_find((const uint8_t *)image->buffer.data,
+				image->buffer.size);
+	if (fmap_offset < 0)
+		return decode_cbfs(image, SECTION_NAME_PRIMARY_CBFS, 0,
+				   image->buffer.size);
+
+	fmap = (const struct fmap *)(image->buffer.data + fmap_offset);
+	if ((size_t)fmap_offset + fmap_size(fmap) > image->buffer.size) {
+		WARN("%s: FMAP is truncated.\n", image->path);
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < fmap->nareas; i++) {
+		const struct fmap_area *area = &fmap->areas[i];
+		const char *name = (const char *)area->name;
+		struct entry *entry;
+
+		entry = add_entry(image, SECTION_FMAP, "FMAP", name,
+				  strnlen(name, FMAP_STRLEN));
+		if (!entry)
+			return -1;
+		entry->type = area->flags;
+		entry->offset = area->offset;
+		entry->size = area->size;
+		set_entry_data(image, entry);
+	}
+
+	/* List the files after all areas, each section is printed in one
+	   piece. */
+	for (unsigned int i = 0; i < fmap->nareas; i++) {
+		const struct fmap_area *area = &fmap->areas[i];
+		char name[FMAP_STRLEN + 1] = { 0 };
+
+		if (area->offset > image->buffer.size ||
+		    area->size > image->buffer.size - area->offset ||
+		    is_parent_area(fmap, area))
+			continue;
+		memcpy(name, area->name, FMAP_STRLEN);
+		if (decode_cbfs(image, name, area->offset, area->size))
+			return -1;
+	}
+	return 0;
+}
+
+static void *load_image(void *arg)
+{
+	struct image *image = arg;
+
+	if (buffer_from_file(&image->buffer, image->path) ||
+	    decode_ifd(image) || decode_fmap(image))
+		image->failed = true;
+	return NULL;
+}
+
+/* Decompresses in_len bytes of data with algo and adds them to the hash. */
+static int hash_data(struct vb2_digest_context *ctx, uint32_t algo, char *in,
+		     size_t in_len, size_t out_len, size_t *actual_size)
+{
+	decomp_func_ptr decompress = decompression_function(algo);
+	char *out;
+	int ret;
+
+	if (algo == CBFS_COMPRESS_NONE) {
+		*actual_size = in_len;
+		return vb2_digest_extend(ctx, (uint8_t *)in, in_len);
+	}
+	if (!decompress)
+		return -1;
+
+	out = malloc(out_len ? out_len : 1);
+	if (!out)
+		return -1;
+	ret = decompress(in, in_len, out, out_len, actual_size);
+	if (!ret)
+		ret = vb2_digest_extend(ctx, (uint8_t *)out, *actual_size);
+	free(out);
+	return ret;
+}
+
+static int hash_stage(struct vb2_digest_context *ctx, struct entry *entry)
+{
+	struct buffer reader;
+	struct cbfs_stage stage;
+
+	if (entry->size < sizeof(stage))
+		return -1;
+
+	/* Everything but the compression and the compressed length. */
+	buffer_init(&reader, NULL, entry->data, entry->size);
+	stage.compression = xdr_le.get32(&reader);
+	if (vb2_digest_extend(ctx, (uint8_t *)reader.data, 16))
+		return -1;
+	stage.entry = xdr_le.get64(&reader);
+	stage.load = xdr_le.get64(&reader);
+	stage.len = xdr_le.get32(&reader);
+	if (vb2_digest_extend(ctx, (uint8_t *)reader.data, 4))
+		return -1;
+	stage.memlen = xdr_le.get32(&reader);
+
+	if (stage.len > reader.size)
+		return -1;
+	if (entry->compression == CBFS_COMPRESS_NONE)
+		entry->compression = stage.compression;
+	return hash_data(ctx, stage.compression, reader.data, stage.len,
+			 stage.memlen, &entry->data_size);
+}
+
+static int hash_payload(struct vb2_digest_context *ctx, struct entry *entry)
+{
+	struct cbfs_payload_segment segment;
+	struct buffer reader;
+	size_t size;
+
+	entry->data_size = 0;
+	buffer_init(&reader, NULL, entry->data, entry->size);
+	while (reader.size >= sizeof(segment)) {
+		/* Type, load address and size in memory, not the layout. */
+		uint8_t *raw = (uint8_t *)reader.data;
+		if (vb2_digest_extend(ctx, raw, 4) ||
+		    vb2_digest_extend(ctx, raw + 12, 8) ||
+		    vb2_digest_extend(ctx, raw + 24, 4))
+			return -1;
+
+		segment.type = xdr_be.get32(&reader);
+		segment.compression = xdr_be.get32(&reader);
+		segment.offset = xdr_be.get32(&reader);
+		segment.load_addr = xdr_be.get64(&reader);
+		segment.len = xdr_be.get32(&reader);
+		segment.mem_len = xdr_be.get32(&reader);
+
+		if (segment.type == PAYLOAD_SEGMENT_ENTRY)
+			return 0;
+		if (segment.type == PAYLOAD_SEGMENT_BSS)
+			continue;
+
+		if (segment.offset > entry->size ||
+		    segment.len > entry->size - segment.offset)
+			return -1;
+		if (entry->compression == CBFS_COMPRESS_NONE)
+			entry->compression = segment.compression;
+		if (hash_data(ctx, segment.compression,
+			      entry->data + segment.offset, segment.len,
+			      segment.mem_len, &size))
+			return -1;
+		entry->data_size += size;
+	}
+	return -1;
+}
+
+static void hash_entry(struct entry *entry)
+{
+	struct vb2_digest_context ctx;
+	uint32_t compression = entry->compression;
+	int ret;
+
+	if (!entry->data)
+		return;
+
+	if (vb2_digest_init(&ctx, VB2_HASH_SHA256))
+		return;
+	if (entry->section_type != SECTION_CBFS)
+		ret = vb2_digest_extend(&ctx, (uint8_t *)entry->data,
+					entry->size);
+	else if (entry->type == CBFS_COMPONENT_STAGE)
+		ret = hash_stage(&ctx, entry);
+	else if (entry->type == CBFS_COMPONENT_SELF)
+		ret = hash_payload(&ctx, entry);
+	else
+		ret = hash_data(&ctx, compression, entry->data, entry->size,
+				entry->data_size, &entry->data_size);
+
+	if (ret) {
+		/* Still compare something, the stored data. */
+		WARN("Can't decode %s in %s, comparing the stored data.\n",
+		     entry->name, entry->section);
+		entry->data_size = entry->size;
+		if (vb2_digest_init(&ctx, VB2_HASH_SHA256) ||
+		    vb2_digest_extend(&ctx, (uint8_t *)entry->data,
+				      entry->size))
+			return;
+	}
+	if (!vb2_digest_finalize(&ctx, entry->hash, sizeof(entry->hash)))
+		entry->decoded = true;
+}
+
+struct work_queue {
+	struct entry **entries;
+	size_t count;
+	size_t next;
+	pthread_mutex_t lock;
+};
+
+static void *hash_worker(void *arg)
+{
+	struct work_queue *queue = arg;
+
+	while (1) {
+		size_t i;
+
+		pthread_mutex_lock(&queue->lock);
+		i = queue->next++;
+		pthread_mutex_unlock(&queue->lock);
+		if (i >= queue->count)
+			break;
+		hash_entry(queue->entries[i]);
+	}
+	return NULL;
+}
+
+static int compare_work_size(const void *a, const void *b)
+{
+	const struct entry *e1 = *(const struct entry * const *)a;
+	const struct entry *e2 = *(const struct entry * const *)b;
+
+	if (e1->size != e2->size)
+		return e1->size < e2->size ? 1 : -1;
+	return 0;
+}
+
+/* Hashes all entries of the images, the largest ones first so that no thread
+   is left with a big one at the end. */
+static int hash_entries(struct image *images, size_t num_images)
+{
+	struct work_queue queue = { 0 };
+	pthread_t *threads;
+	unsigned int started = 0;
+
+	for (size_t i = 0; i < num_images; i++)
+		queue.count += images[i].num_entries;
+	queue.entries = malloc((queue.count + 1) * sizeof(*queue.entries));
+	threads = malloc((param.jobs + 1) * sizeof(*threads));
+	if (!queue.entries || !threads) {
+		free(queue.entries);
+		free(threads);
+		return -1;
+	}
+
+	queue.count = 0;
+	for (size_t i = 0; i < num_images; i++)
+		for (size_t j = 0; j < images[i].num_entries; j++)
+			queue.entries[queue.count++] = &images[i].entries[j];
+	qsort(queue.entries, queue.count, sizeof(*queue.entries),
+	      compare_work_size);
+
+	pthread_mutex_init(&queue.lock, NULL);
+	for (unsigned int i = 0; i < param.jobs; i++) {
+		if (pthread_create(&threads[i], NULL, hash_worker, &queue))
+			break;
+		started++;
+	}
+	/* Help out, or do all the work if no thread could be started. */
+	hash_worker(&queue);
+	for (unsigned int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&queue.lock);
+
+	for (size_t i = 0; i < num_images; i++)
+		vb2_digest_buffer((uint8_t *)images[i].buffer.data,
+				  images[i].buffer.size, VB2_HASH_SHA256,
+				  images[i].hash, sizeof(images[i].hash));
+
+	free(queue.entries);
+	free(threads);
+	return 0;
+}
+
+enum diff_status {
+	DIFF_SAME,
+	DIFF_MOVED,
+	DIFF_RECOMPRESSED,
+	DIFF_CHANGED,
+	DIFF_ADDED,
+	DIFF_REMOVED,
+	DIFF_COUNT,
+};
+
+static const char *const diff_status_names[DIFF_COUNT] = {
+	"same", "moved", "recompressed", "changed", "added", "removed",
+};
+
+static enum diff_status diff_entries(const struct entry *old,
+				     const struct entry *new)
+{
+	if (!old)
+		return DIFF_ADDED;
+	if (!new)
+		return DIFF_REMOVED;
+	if (!old->decoded || !new->decoded || old->type != new->type ||
+	    memcmp(old->hash, new->hash, sizeof(old->hash)))
+		return DIFF_CHANGED;
+	if (old->compression != new->compression || old->size != new->size)
+		return DIFF_RECOMPRESSED;
+	if (old->offset != new->offset)
+		return DIFF_MOVED;
+	return DIFF_SAME;
+}
+
+static void match_entries(struct image *old, struct image *new)
+{
+	for (size_t i = 0; i < old->num_entries; i++) {
+		struct entry *o = &old->entries[i];
+
+		/* Files with the same name are matched up in order. */
+		for (size_t j = 0; j < new->num_entries; j++) {
+			struct entry *n = &new->entries[j];
+
+			if (n->match || strcmp(o->section, n->section) ||
+			    strcmp(o->name, n->name))
+				continue;
+			o->match = n;
+			n->match = o;
+			break;
+		}
+	}
+}
+
+static const char *hex_hash(const uint8_t *hash, size_t len, char *buf)
+{
+	for (size_t i = 0; i < len; i++)
+		sprintf(buf + 2 * i, "%02x", hash[i]);
+	return buf;
+}
+
+static const char *comp_name(uint32_t compression)
+{
+	for (size_t i = 0; types_cbfs_compression[i].name; i++)
+		if (types_cbfs_compression[i].type == compression)
+			return types_cbfs_compression[i].name;
+	return "(unknown)";
+}
+
+static const char *type_name(uint32_t type)
+{
+	for (size_t i = 0; filetypes[i].name; i++)
+		if (filetypes[i].type == type)
+			return filetypes[i].name;
+	return "(unknown)";
+}
+
+static void print_parseable_side(const struct entry *entry)
+{
+	char hash[2 * HASH_SIZE + 1] = "";
+
+	if (!entry) {
+		printf("\t\t\t\t\t\t");
+		return;
+	}
+	if (entry->decoded)
+		hex_hash(entry->hash, HASH_SIZE, hash);
+	printf("\t0x%x\t%u\t0x%x\t%s\t%zu\t%s", entry->offset, entry->size,
+	       entry->type,
+	       entry->section_type == SECTION_CBFS ?
+			comp_name(entry->compression) : "",
+	       entry->section_type == SECTION_CBFS ?
+			entry->data_size : entry->size,
+	       hash);
+}
+
+static void print_parseable(const struct entry *old, const struct entry *new,
+			    enum diff_status status)
+{
+	const struct entry *any = old ? old : new;
+
+	printf("%s\t%s\t%s", any->section, any->name,
+	       diff_status_names[status]);
+	print_parseable_side(old);
+	print_parseable_side(new);
+	printf("\n");
+}
+
+static void print_delta(const char *what, long long old, long long new)
+{
+	if (old == new)
+		printf("  %s %lld", what, old);
+	else
+		printf("  %s %lld -> %lld (%+lld)", what, old, new, new - old);
+}
+
+static void print_entry(const struct entry *old, const struct entry *new,
+			enum diff_status status)
+{
+	static const char *section;
+	const struct entry *any = old ? old : new;
+	char hash1[2 * SHORT_HASH_SIZE + 1], hash2[2 * SHORT_HASH_SIZE + 1];
+
+	if (!section || strcmp(section, any->section)) {
+		section = any->section;
+		printf("%s:\n", section);
+	}
+
+	printf("  %-13s %-32s", diff_status_names[status], any->name);
+	if (any->section_type == SECTION_CBFS)
+		printf(" %-10s", type_name(any->type));
+
+	if (!old || !new) {
+		printf("  0x%08x  size %u", any->offset, any->size);
+		if (any->section_type == SECTION_CBFS &&
+		    any->compression != CBFS_COMPRESS_NONE)
+			printf(" (%s, %zu)", comp_name(any->compression),
+			       any->data_size);
+		printf("\n");
+		return;
+	}
+
+	if (old->offset != new->offset)
+		printf("  0x%08x -> 0x%08x", old->offset, new->offset);
+	else
+		printf("  0x%08x", old->offset);
+	print_delta("size", old->size, new->size);
+	if (any->section_type == SECTION_CBFS) {
+		if (old->data_size != old->size ||
+		    new->data_size != new->size)
+			print_delta("data", old->data_size, new->data_size);
+		if (old->compression != new->compression)
+			printf("  %s -> %s", comp_name(old->compression),
+			       comp_name(new->compression));
+	} else if (old->type != new->type) {
+		printf("  %s 0x%x -> 0x%x",
+		       any->section_type == SECTION_IFD ? "flreg" : "flags",
+		       old->type, new->type);
+	}
+	if (status == DIFF_CHANGED && old->decoded && new->decoded)
+		printf("  %s -> %s", hex_hash(old->hash, SHORT_HASH_SIZE, hash1),
+		       hex_hash(new->hash, SHORT_HASH_SIZE, hash2));
+	printf("\n");
+}
+
+static void report(const struct entry *old, const struct entry *new,
+		   unsigned int *count)
+{
+	enum diff_status status = diff_entries(old, new);
+
+	count[status]++;
+	if (status == DIFF_SAME && !param.show_all)
+		return;
+	if (param.parseable)
+		print_parseable(old, new, status);
+	else
+		print_entry(old, new, status);
+}
+
+static int print_diff(struct image *old, struct image *new)
+{
+	unsigned int count[DIFF_COUNT] = { 0 };
+	char hash1[2 * SHORT_HASH_SIZE + 1], hash2[2 * SHORT_HASH_SIZE + 1];
+	size_t j = 0;
+
+	if (!param.parseable)
+		printf("--- %s (%zu bytes, %s)\n+++ %s (%zu bytes, %s)\n",
+		       old->path, old->buffer.size,
+		       hex_hash(old->hash, SHORT_HASH_SIZE, hash1), new->path,
+		       new->buffer.size, hex_hash(new->hash, SHORT_HASH_SIZE, hash2));
+
+	/* In the order of the old image, with new entries where they are in
+	   the new image. */
+	for (size_t i = 0; i < old->num_entries; i++) {
+		const struct entry *o = &old->entries[i];
+
+		/* Entries that were reordered are reported where they were
+		   in the old image. */
+		if (o->match) {
+			size_t k = o->match - new->entries;
+
+			for (; j < k; j++)
+				if (!new->entries[j].match)
+					report(NULL, &new->entries[j], count);
+			if (j == k)
+				j++;
+		}
+		report(o, o->match, count);
+	}
+	for (; j < new->num_entries; j++)
+		if (!new->entries[j].match)
+			report(NULL, &new->entries[j], count);
+
+	if (!param.parseable)
+		printf("%u added, %u removed, %u changed, %u recompressed, "
+		       "%u moved, %u same\n", count[DIFF_ADDED],
+		       count[DIFF_REMOVED], count[DIFF_CHANGED],
+		       count[DIFF_RECOMPRESSED], count[DIFF_MOVED],
+		       count[DIFF_SAME]);
+
+	/* Anything that isn't in an entry, e.g. padding, counts as well. */
+	if (old->buffer.size == new->buffer.size &&
+	    !memcmp(old->hash, new->hash, sizeof(old->hash)))
+		return 0;
+	if (!param.parseable && count[DIFF_SAME] == old->num_entries &&
+	    count[DIFF_SAME] == new->num_entries)
+		printf("The images only differ outside of the entries.\n");
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct image images[2] = { 0 };
+	pthread_t thread;
+	bool threaded;
+	long cpus;
+	int ret;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	param.jobs = cpus > 0 ? cpus : 1;
+
+	while (1) {
+		int optindex = 0;
+		char *suffix = NULL;
+		int c = getopt_long(argc, argv, optstring, long_options,
+				    &optindex);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'j':
+			param.jobs = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix) || !param.jobs) {
+				ERROR("Invalid number of jobs '%s'.\n", optarg);
+				return 2;
+			}
+			break;
+		case 'p':
+			param.parseable = true;
+			break;
+		case 'v':
+			param.show_all = true;
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (argc - optind != 2) {
+		usage(argv[0]);
+		return 2;
+	}
+	images[0].path = argv[optind];
+	images[1].path = argv[optind + 1];
+
+	threaded = !pthread_create(&thread, NULL, load_image, &images[1]);
+	load_image(&images[0]);
+	if (threaded)
+		pthread_join(thread, NULL);
+	else
+		load_image(&images[1]);
+	if (images[0].failed || images[1].failed)
+		return 2;
+
+	/* The calling thread works as well. */
+	param.jobs--;
+	if (hash_entries(images, ARRAY_SIZE(images)))
+		return 2;
+
+	match_entries(&images[0], &images[1]);
+	ret = print_diff(&images[0], &images[1]);
+
+	for (size_t i = 0; i < ARRAY_SIZE(images); i++) {
+		for (size_t j = 0; j < images[i].num_entries; j++)
+			free(images[i].entries[j].name);
+		free(images[i].entries);
+		buffer_delete(&images[i].buffer);
+	}
+	return ret;
+}
@@ -0,0 +1,217 @@
+/* LzFindMt.c -- multithreaded Match finder for LZ algorithms */
+
+#include "LzFindMt.h"
+
+/* A record is the number of distance values followed by the values. */
+static uint32_t MtRecordMaxSize(const struct CMatchFinderMt *p)
+{
+  return 1 + (p->MatchFinder->matchMaxLen + 1) * 2;
+}
+
+/* Returns 0 once the matches of the last position were stored. */
+static int MtFillBlock(struct CMatchFinderMt *p, uint32_t index)
+{
+  struct CMatchFinder *mf = p->MatchFinder;
+  uint32_t *block = p->blocks + index * kMtBlockSize;
+  uint32_t limit = kMtBlockSize - MtRecordMaxSize(p);
+  uint32_t pos = 0;
+
+  while (pos <= limit && p->mfVTable.GetNumAvailableBytes(mf) != 0)
+  {
+    uint32_t num = p->mfVTable.GetMatches(mf, block + pos + 1);
+    block[pos] = num;
+    pos += num + 1;
+  }
+  p->blockSizes[index] = pos;
+  return p->mfVTable.GetNumAvailableBytes(mf) != 0;
+}
+
+static void *MtThread(void *arg)
+{
+  struct CMatchFinderMt *p = (struct CMatchFinderMt *)arg;
+  uint32_t index;
+  int more;
+
+  do
+  {
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop && p->numProduced - p->numConsumed == kMtNumBlocks)
+      pthread_cond_wait(&p->cond, &p->lock);
+    if (p->stop)
+    {
+      pthread_mutex_unlock(&p->lock);
+      break;
+    }
+    index = p->numProduced % kMtNumBlocks;
+    pthread_mutex_unlock(&p->lock);
+
+    more = MtFillBlock(p, index);
+
+    pthread_mutex_lock(&p->lock);
+    p->numProduced++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+  }
+  while (more);
+
+  return NULL;
+}
+
+static void MtNextBlock(struct CMatchFinderMt *p)
+{
+  uint32_t index = 0;
+
+  if (!p->threadRunning)
+  {
+    /* The thread couldn't be started, find the matches in this thread. */
+    MtFillBlock(p, index);
+  }
+  else
+  {
+    pthread_mutex_lock(&p->lock);
+    if (p->haveBlock)
+    {
+      p->numConsumed++;
+      pthread_cond_broadcast(&p->cond);
+    }
+    while (p->numProduced == p->numConsumed)
+      pthread_cond_wait(&p->cond, &p->lock);
+    index = p->numConsumed % kMtNumBlocks;
+    pthread_mutex_unlock(&p->lock);
+  }
+
+  p->curBlock = p->blocks + index * kMtBlockSize;
+  p->curBlockSize = p->blockSizes[index];
+  p->curBlockPos = 0;
+  p->haveBlock = 1;
+}
+
+static const uint32_t *MtNextRecord(struct CMatchFinderMt *p)
+{
+  const uint32_t *record;
+
+  if (!p->haveBlock || p->curBlockPos >= p->curBlockSize)
+    MtNextBlock(p);
+  record = p->curBlock + p->curBlockPos;
+  p->curBlockPos += record[0] + 1;
+  p->pointerToCurPos++;
+  p->numAvail--;
+  return record;
+}
+
+static void MatchFinderMt_Init(struct CMatchFinderMt *p)
+{
+  struct CMatchFinder *mf = p->MatchFinder;
+
+  MatchFinderMt_ReleaseStream(p);
+  p->mfVTable.Init(mf);
+  p->pointerToCurPos = p->mfVTable.GetPointerToCurrentPos(mf);
+  p->numAvail = p->mfVTable.GetNumAvailableBytes(mf);
+  p->haveBlock = 0;
+  p->numProduced = 0;
+  p->numConsumed = 0;
+  p->stop = 0;
+  if (p->numAvail != 0 && pthread_create(&p->thread, NULL, MtThread, p) == 0)
+    p->threadRunning = 1;
+}
+
+static uint8_t MatchFinderMt_GetIndexByte(struct CMatchFinderMt *p, int32_t index)
+{
+  return p->pointerToCurPos[index];
+}
+
+static uint32_t MatchFinderMt_GetNumAvailableBytes(struct CMatchFinderMt *p)
+{
+  return p->numAvail;
+}
+
+static const uint8_t *MatchFinderMt_GetPointerToCurrentPos(struct CMatchFinderMt *p)
+{
+  return p->pointerToCurPos;
+}
+
+static uint32_t MatchFinderMt_GetMatches(struct CMatchFinderMt *p, uint32_t *distances)
+{
+  const uint32_t *record = MtNextRecord(p);
+  uint32_t i;
+
+  for (i = 0; i < record[0]; i++)
+    distances[i] = record[1 + i];
+  return record[0];
+}
+
+static void MatchFinderMt_Skip(struct CMatchFinderMt *p, uint32_t num)
+{
+  while (num-- != 0)
+    MtNextRecord(p);
+}
+
+void MatchFinderMt_Construct(struct CMatchFinderMt *p)
+{
+  p->MatchFinder = 0;
+  p->blocks = 0;
+  p->threadRunning = 0;
+}
+
+void MatchFinderMt_ReleaseStream(struct CMatchFinderMt *p)
+{
+  if (!p->threadRunning)
+    return;
+  pthread_mutex_lock(&p->lock);
+  p->stop = 1;
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+  pthread_join(p->thread, NULL);
+  p->threadRunning = 0;
+}
+
+void MatchFinderMt_Destruct(struct CMatchFinderMt *p, struct ISzAlloc *alloc)
+{
+  MatchFinderMt_ReleaseStream(p);
+  if (p->blocks == 0)
+    return;
+  pthread_cond_destroy(&p->cond);
+  pthread_mutex_destroy(&p->lock);
+  alloc->Free(alloc, p->blocks);
+  p->blocks = 0;
+}
+
+SRes MatchFinderMt_Create(struct CMatchFinderMt *p, struct CMatchFinder *mf, struct ISzAlloc *alloc)
+{
+  p->MatchFinder = mf;
+  if (!mf->directInput || !mf->btMode || MtRecordMaxSize(p) > kMtBlockSize)
+    return SZ_ERROR_PARAM;
+  MatchFinder_CreateVTable(mf, &p->mfVTable);
+
+  if (p->blocks == 0)
+  {
+    p->blocks = (uint32_t *)alloc->Alloc(alloc, kMtNumBlocks * kMtBlockSize * sizeof(uint32_t));
+    if (p->blocks == 0)
+      return SZ_ERROR_MEM;
+    if (pthread_mutex_init(&p->lock, NULL) != 0)
+    {
+      alloc->Free(alloc, p->blocks);
+      p->blocks = 0;
+      return SZ_ERROR_THREAD;
+    }
+    if (pthread_cond_init(&p->cond, NULL) != 0)
+    {
+      pthread_mutex_destroy(&p->lock);
+      alloc->Free(alloc, p->blocks);
+      p->blocks = 0;
+      return SZ_ERROR_THREAD;
+    }
+  }
+  return SZ_OK;
+}
+
+void MatchFinderMt_CreateVTable(struct CMatchFinderMt *p, struct IMatchFinder *vTable)
+{
+  (void)p;
+  vTable->Init = (Mf_Init_Func)MatchFinderMt_Init;
+  vTable->GetIndexByte = (Mf_GetIndexByte_Func)MatchFinderMt_GetIndexByte;
+  vTable->GetNumAvailableBytes = (Mf_GetNumAvailableBytes_Func)MatchFinderMt_GetNumAvailableBytes;
+  vTable->GetPointerToCurrentPos = (Mf_GetPointerToCurrentPos_Func)MatchFinderMt_GetPointerToCurrentPos;
+  vTable->GetMatches = (Mf_GetMatches_Func)MatchFinderMt_GetMatches;
+  vTable->Skip = (Mf_Skip_Func)MatchFinderMt_Skip;
+}
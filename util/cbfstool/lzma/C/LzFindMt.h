@@ -0,0 +1,56 @@
+/* LzFindMt.h -- multithreaded Match finder for LZ algorithms */
+
+#ifndef __LZ_FIND_MT_H
+#define __LZ_FIND_MT_H
+
+#include <pthread.h>
+
+#include "LzFind.h"
+
+/*
+  The match finder runs in its own thread and stores the matches of every
+  position of the input, in order, in a ring of blocks that the encoder thread
+  consumes. Skipping a position is the same as finding its matches for the
+  binary tree match finders, so the encoder sees exactly the matches it would
+  get from the single threaded match finder and produces the same output.
+
+  Only in-memory input (directInput) is supported, the encoder thread reads the
+  input bytes while the match finder thread is running.
+*/
+
+#define kMtNumBlocks 64
+#define kMtBlockSize (1 << 14)
+
+struct CMatchFinderMt
+{
+  /* Only used by the encoder thread */
+  const uint8_t *pointerToCurPos;
+  uint32_t numAvail;
+  const uint32_t *curBlock;
+  uint32_t curBlockPos;
+  uint32_t curBlockSize;
+  int haveBlock;
+
+  /* Only used by the match finder thread after MatchFinderMt_Init() */
+  struct CMatchFinder *MatchFinder;
+  struct IMatchFinder mfVTable;
+
+  uint32_t *blocks;
+  uint32_t blockSizes[kMtNumBlocks];
+  uint32_t numProduced; /* protected by lock */
+  uint32_t numConsumed; /* protected by lock */
+  int stop;             /* protected by lock */
+  int threadRunning;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+void MatchFinderMt_Construct(struct CMatchFinderMt *p);
+void MatchFinderMt_Destruct(struct CMatchFinderMt *p, struct ISzAlloc *alloc);
+SRes MatchFinderMt_Create(struct CMatchFinderMt *p, struct CMatchFinder *mf, struct ISzAlloc *alloc);
+void MatchFinderMt_CreateVTable(struct CMatchFinderMt *p, struct IMatchFinder *vTable);
+/* Stops the match finder thread, it can be called more than once. */
+void MatchFinderMt_ReleaseStream(struct CMatchFinderMt *p);
+
+#endif
@@ -6,6 +6,7 @@
 #include "LzmaEnc.h"
 
 #include "LzFind.h"
+#include "LzFindMt.h"
 
 #define kBlockSizeMax ((1 << LZMA_NUM_BLOCK_SIZE_BITS) - 1)
 
@@ -214,6 +215,7 @@ struct CLzmaEnc
   void *matchFinderObj;
 
   struct CMatchFinder matchFinderBase;
+  struct CMatchFinderMt matchFinderMt;
 
   uint32_t optimumEndIndex;
   uint32_t optimumCurrentIndex;
@@ -372,6 +374,7 @@ SRes LzmaEnc_SetProps(CLzmaEncHandle pp, const struct CLzmaEncProps *props2)
   p->matchFinderBase.cutValue = props.mc;
 
   p->writeEndMark = props.writeEndMark;
+  p->multiThread = (props.numThreads > 1);
 
   return SZ_OK;
 }
@@ -1583,6 +1586,7 @@ static void LzmaEnc_Construct(struct CLzmaEnc *p)
 {
   RangeEnc_Construct(&p->rc);
   MatchFinder_Construct(&p->matchFinderBase);
+  MatchFinderMt_Construct(&p->matchFinderMt);
 
   {
     struct CLzmaEncProps props;
@@ -1618,6 +1622,7 @@ static void LzmaEnc_FreeLits(struct CLzmaEnc *p, struct ISzAlloc *alloc)
 
 static void LzmaEnc_Destruct(struct CLzmaEnc *p, struct ISzAlloc *alloc, struct ISzAlloc *allocBig)
 {
+  MatchFinderMt_Destruct(&p->matchFinderMt, allocBig);
   MatchFinder_Free(&p->matchFinderBase, allocBig);
   LzmaEnc_FreeLits(p, alloc);
   RangeEnc_Free(&p->rc, alloc);
@@ -1819,8 +1824,18 @@ static SRes LzmaEnc_Alloc(struct CLzmaEnc *p, uint32_t keepWindowSize, struct IS
   {
     if (!MatchFinder_Create(&p->matchFinderBase, p->dictSize, beforeSize, p->numFastuint8_ts, LZMA_MATCH_LEN_MAX, allocBig))
       return SZ_ERROR_MEM;
-    p->matchFinderObj = &p->matchFinderBase;
-    MatchFinder_CreateVTable(&p->matchFinderBase, &p->matchFinder);
+    /* The match finder thread needs the whole input in memory. */
+    if (p->multiThread && p->matchFinderBase.directInput && p->matchFinderBase.btMode)
+    {
+      RINOK(MatchFinderMt_Create(&p->matchFinderMt, &p->matchFinderBase, allocBig));
+      p->matchFinderObj = &p->matchFinderMt;
+      MatchFinderMt_CreateVTable(&p->matchFinderMt, &p->matchFinder);
+    }
+    else
+    {
+      p->matchFinderObj = &p->matchFinderBase;
+      MatchFinder_CreateVTable(&p->matchFinderBase, &p->matchFinder);
+    }
   }
   return SZ_OK;
 }
@@ -43,37 +43,13 @@ static void SzFree(unused void *u, void *address)
 
 static struct ISzAlloc LZMAalloc = { SzAlloc, SzFree };
 
-/* Streaming API */
+static int num_threads = 1;
 
-struct vector_t {
-	char *p;
-	size_t pos;
-	size_t size;
-};
-
-static struct vector_t instream, outstream;
-
-static SRes Read(unused void *u, void *buf, size_t *size)
-{
-	if ((instream.size - instream.pos) < *size)
-		*size = instream.size - instream.pos;
-	memcpy(buf, instream.p + instream.pos, *size);
-	instream.pos += *size;
-	return SZ_OK;
-}
-
-static size_t Write(unused void *u, const void *buf, size_t size)
+void do_lzma_set_threads(int threads)
 {
-	if(outstream.size - outstream.pos < size)
-		size = outstream.size - outstream.pos;
-	memcpy(outstream.p + outstream.pos, buf, size);
-	outstream.pos += size;
-	return size;
+	num_threads = threads;
 }
 
-static struct ISeqInStream is = { Read };
-static struct ISeqOutStream os = { Write };
-
 /**
  * Compress a buffer with lzma
  * Don't copy the result back if it is too large.
@@ -99,7 +75,9 @@ int do_lzma_compress(char *in, int in_len, char *out, int *out_len)
 	props.fb = 273; /* NumFastBytes */
 	props.mc = 0; /* MatchFinderCycles, default: 0 */
 	props.algo = 1; /* AlgorithmNo, apparently, 0 and 1 are valid values. 0 = fast mode */
-	props.numThreads = 1;
+	/* More than one thread runs the match finder in a second thread,
+	   the output doesn't change. */
+	props.numThreads = num_threads;
 
 	switch (props.algo) {
 	case 0:	// quick: HC4
@@ -115,10 +93,15 @@ int do_lzma_compress(char *in, int in_len, char *out, int *out_len)
 	}
 
 	CLzmaEncHandle p = LzmaEnc_Create(&LZMAalloc);
+	if (!p) {
+		ERROR("LZMA: LzmaEnc_Create failed.\n");
+		return -1;
+	}
 
 	int res = LzmaEnc_SetProps(p, &props);
 	if (res != SZ_OK) {
 		ERROR("LZMA: LzmaEnc_SetProps failed.\n");
+		LzmaEnc_Destroy(p, &LZMAalloc, &LZMAalloc);
 		return -1;
 	}
 
@@ -127,28 +110,30 @@ int do_lzma_compress(char *in, int in_len, char *out, int *out_len)
 	res = LzmaEnc_WriteProperties(p, propsEncoded, &propsSize);
 	if (res != SZ_OK) {
 		ERROR("LZMA: LzmaEnc_WriteProperties failed.\n");
+		LzmaEnc_Destroy(p, &LZMAalloc, &LZMAalloc);
 		return -1;
 	}
 
-	instream.p = in;
-	instream.pos = 0;
-	instream.size = in_len;
-
-	outstream.p = out;
-	outstream.pos = 0;
-	outstream.size = in_len;
-
-	put_64(propsEncoded + LZMA_PROPS_SIZE, in_len);
-	Write(&os, propsEncoded, LZMA_PROPS_SIZE+8);
-
-	res = LzmaEnc_Encode(p, &os, &is, 0, &LZMAalloc, &LZMAalloc);
+	/* The output may not be larger than the input. */
+	size_t header_size = LZMA_PROPS_SIZE + 8;
+	size_t dest_len = 0;
+	if ((size_t)in_len > header_size) {
+		put_64(propsEncoded + LZMA_PROPS_SIZE, in_len);
+		memcpy(out, propsEncoded, header_size);
+		dest_len = in_len - header_size;
+		res = LzmaEnc_MemEncode(p, (uint8_t *)out + header_size,
+					&dest_len, (uint8_t *)in, in_len, 0,
+					NULL, &LZMAalloc, &LZMAalloc);
+	} else {
+		res = SZ_ERROR_OUTPUT_EOF;
+	}
 	LzmaEnc_Destroy(p, &LZMAalloc, &LZMAalloc);
 	if (res != SZ_OK) {
-		ERROR("LZMA: LzmaEnc_Encode failed %d.\n", res);
+		ERROR("LZMA: LzmaEnc_MemEncode failed %d.\n", res);
 		return -1;
 	}
 
-	*out_len = outstream.pos;
+	*out_len = header_size + dest_len;
 	return 0;
 }
 
@@ -18,6 +18,7 @@
 #include <assert.h>
 #include <regex.h>
 #include <commonlib/cbmem_id.h>
+#include <commonlib/hw_access_serialized.h>
 #include <commonlib/timestamp_serialized.h>
 #include <commonlib/tcpa_log_serialized.h>
 #include <commonlib/coreboot_tables.h>
@@ -45,7 +46,7 @@ struct mapping {
 	size_t size;
 };
 
-#define CBMEM_VERSION "1.1"
+#define CBMEM_VERSION "1.2"
 
 /* verbose output? */
 static int verbose = 0;
@@ -239,6 +240,37 @@ static int find_cbmem_entry(uint32_t id, uint64_t *addr, size_t *size)
 	return ret;
 }
 
+/*
+ * Map a CBMEM object found through a coreboot table reference. The matching
+ * CBMEM entry tells its size, so the whole object is mapped at once. Firmware
+ * that doesn't list CBMEM entries only gets header_size bytes mapped here, the
+ * caller grows the mapping with remap_memory() once it knows the size.
+ */
+static const void *map_cbmem_ref(struct mapping *mapping, uint32_t id,
+				  uint64_t addr, size_t header_size)
+{
+	uint64_t entry_addr;
+	size_t entry_size;
+
+	if (!find_cbmem_entry(id, &entry_addr, &entry_size) &&
+	    entry_addr == addr && entry_size >= header_size)
+		return map_memory(mapping, addr, entry_size);
+
+	return map_memory(mapping, addr, header_size);
+}
+
+/* Make sure at least sz bytes are mapped, returns NULL on error. */
+static const void *remap_memory(struct mapping *mapping, size_t sz)
+{
+	unsigned long long phys = mapping->phys;
+
+	if (sz <= mapping_size(mapping))
+		return mapping_virt(mapping);
+
+	unmap_memory(mapping);
+	return map_memory(mapping, phys, sz);
+}
+
 /*
  * Try finding the timestamp table and coreboot cbmem console starting from the
  * passed in memory offset.  Could be called recursively in case a forwarding
@@ -536,6 +568,27 @@ static const char *timestamp_name(uint32_t id)
 	return "<unknown>";
 }
 
+enum timestamp_format {
+	TIMESTAMPS_TEXT,
+	TIMESTAMPS_PARSEABLE,
+	TIMESTAMPS_JSON,
+	TIMESTAMPS_CSV,
+};
+
+/* Print a string quoted, escaping quotes by doubling them (CSV) or not (JSON). */
+static void print_quoted(const char *s, int double_quotes)
+{
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"')
+			putchar(double_quotes ? '"' : '\\');
+		else if (*s == '\\' && !double_quotes)
+			putchar('\\');
+		putchar(*s);
+	}
+	putchar('"');
+}
+
 static uint64_t timestamp_print_parseable_entry(uint32_t id, uint64_t stamp,
 						uint64_t prev_stamp)
 {
@@ -555,6 +608,38 @@ static uint64_t timestamp_print_parseable_entry(uint32_t id, uint64_t stamp,
 	return step_time;
 }
 
+static uint64_t timestamp_print_json_entry(uint32_t id, uint64_t stamp,
+					   uint64_t prev_stamp, int first)
+{
+	uint64_t step_time;
+
+	step_time = arch_convert_raw_ts_entry(stamp - prev_stamp);
+
+	printf("%s\n    {\"id\": %u, \"name\": ", first ? "" : ",", id);
+	print_quoted(timestamp_name(id), 0);
+	printf(", \"time_us\": %llu, \"step_us\": %llu}",
+	       (unsigned long long)arch_convert_raw_ts_entry(stamp),
+	       (unsigned long long)step_time);
+
+	return step_time;
+}
+
+static uint64_t timestamp_print_csv_entry(uint32_t id, uint64_t stamp,
+					  uint64_t prev_stamp)
+{
+	uint64_t step_time;
+
+	step_time = arch_convert_raw_ts_entry(stamp - prev_stamp);
+
+	printf("%u,", id);
+	print_quoted(timestamp_name(id), 1);
+	printf(",%llu,%llu\n",
+	       (unsigned long long)arch_convert_raw_ts_entry(stamp),
+	       (unsigned long long)step_time);
+
+	return step_time;
+}
+
 static uint64_t timestamp_print_entry(uint32_t id, uint64_t stamp, uint64_t prev_stamp)
 {
 	const char *name;
@@ -576,6 +661,21 @@ static uint64_t timestamp_print_entry(uint32_t id, uint64_t stamp, uint64_t prev
 	return step_time;
 }
 
+static uint64_t timestamp_print(enum timestamp_format format, uint32_t id,
+				uint64_t stamp, uint64_t prev_stamp, int first)
+{
+	switch (format) {
+	case TIMESTAMPS_PARSEABLE:
+		return timestamp_print_parseable_entry(id, stamp, prev_stamp);
+	case TIMESTAMPS_JSON:
+		return timestamp_print_json_entry(id, stamp, prev_stamp, first);
+	case TIMESTAMPS_CSV:
+		return timestamp_print_csv_entry(id, stamp, prev_stamp);
+	default:
+		return timestamp_print_entry(id, stamp, prev_stamp);
+	}
+}
+
 static int compare_timestamp_entries(const void *a, const void *b)
 {
 	const struct timestamp_entry *tse_a = (struct timestamp_entry *)a;
@@ -590,10 +690,11 @@ static int compare_timestamp_entries(const void *a, const void *b)
 }
 
 /* dump the timestamp table */
-static void dump_timestamps(int mach_readable)
+static void dump_timestamps(enum timestamp_format format)
 {
 	const struct timestamp_table *tst_p;
-	struct timestamp_table *sorted_tst_p;
+	struct timestamp_table *sorted_tst_p = NULL;
+	const struct timestamp_entry *entries;
 	size_t size;
 	uint64_t prev_stamp;
 	uint64_t total_time;
@@ -605,60 +706,80 @@ static void dump_timestamps(int mach_readable)
 	}
 
 	size = sizeof(*tst_p);
-	tst_p = map_memory(&timestamp_mapping, timestamps.cbmem_addr, size);
+	tst_p = map_cbmem_ref(&timestamp_mapping, CBMEM_ID_TIMESTAMP,
+			      timestamps.cbmem_addr, size);
 	if (!tst_p)
 		die("Unable to map timestamp header\n");
 
-	timestamp_set_tick_freq(tst_p->tick_freq_mhz);
-
-	if (!mach_readable)
-		printf("%d entries total:\n\n", tst_p->num_entries);
 	size += tst_p->num_entries * sizeof(tst_p->entries[0]);
 
-	unmap_memory(&timestamp_mapping);
-
-	tst_p = map_memory(&timestamp_mapping, timestamps.cbmem_addr, size);
+	tst_p = remap_memory(&timestamp_mapping, size);
 	if (!tst_p)
 		die("Unable to map full timestamp table\n");
 
+	timestamp_set_tick_freq(tst_p->tick_freq_mhz);
+
+	switch (format) {
+	case TIMESTAMPS_TEXT:
+		printf("%d entries total:\n\n", tst_p->num_entries);
+		break;
+	case TIMESTAMPS_JSON:
+		printf("{\n  \"tick_freq_mhz\": %lu,\n  \"entries\": [",
+		       tick_freq_mhz);
+		break;
+	case TIMESTAMPS_CSV:
+		printf("id,name,time_us,step_us\n");
+		break;
+	default:
+		break;
+	}
+
 	/* Report the base time within the table. */
 	prev_stamp = 0;
-	if (mach_readable)
-		timestamp_print_parseable_entry(0,  tst_p->base_time,
-						prev_stamp);
-	else
-		timestamp_print_entry(0,  tst_p->base_time, prev_stamp);
+	timestamp_print(format, 0, tst_p->base_time, prev_stamp, 1);
 	prev_stamp = tst_p->base_time;
 
-	sorted_tst_p = malloc(size);
-	if (!sorted_tst_p)
-		die("Failed to allocate memory");
-	aligned_memcpy(sorted_tst_p, tst_p, size);
+	/* Stages add their timestamps in order, so sorting is rarely needed. */
+	entries = tst_p->entries;
+	for (uint32_t i = 1; i < tst_p->num_entries; i++) {
+		if (entries[i].entry_stamp >= entries[i - 1].entry_stamp)
+			continue;
 
-	qsort(&sorted_tst_p->entries[0], sorted_tst_p->num_entries,
-	      sizeof(struct timestamp_entry), compare_timestamp_entries);
+		sorted_tst_p = malloc(size);
+		if (!sorted_tst_p)
+			die("Failed to allocate memory");
+		aligned_memcpy(sorted_tst_p, tst_p, size);
+
+		qsort(&sorted_tst_p->entries[0], sorted_tst_p->num_entries,
+		      sizeof(struct timestamp_entry), compare_timestamp_entries);
+		entries = sorted_tst_p->entries;
+		break;
+	}
 
 	total_time = 0;
-	for (uint32_t i = 0; i < sorted_tst_p->num_entries; i++) {
+	for (uint32_t i = 0; i < tst_p->num_entries; i++) {
 		uint64_t stamp;
-		const struct timestamp_entry *tse = &sorted_tst_p->entries[i];
+		const struct timestamp_entry *tse = &entries[i];
 
 		/* Make all timestamps absolute. */
-		stamp = tse->entry_stamp + sorted_tst_p->base_time;
-		if (mach_readable)
-			total_time +=
-				timestamp_print_parseable_entry(tse->entry_id,
-							stamp, prev_stamp);
-		else
-			total_time += timestamp_print_entry(tse->entry_id,
-							stamp, prev_stamp);
+		stamp = tse->entry_stamp + tst_p->base_time;
+		total_time += timestamp_print(format, tse->entry_id, stamp,
+					      prev_stamp, 0);
 		prev_stamp = stamp;
 	}
 
-	if (!mach_readable) {
+	switch (format) {
+	case TIMESTAMPS_TEXT:
 		printf("\nTotal Time: ");
 		print_norm(total_time);
 		printf("\n");
+		break;
+	case TIMESTAMPS_JSON:
+		printf("\n  ],\n  \"total_us\": %llu\n}\n",
+		       (unsigned long long)total_time);
+		break;
+	default:
+		break;
 	}
 
 	unmap_memory(&timestamp_mapping);
@@ -678,15 +799,14 @@ static void dump_tcpa_log(void)
 	}
 
 	size = sizeof(*tclt_p);
-	tclt_p = map_memory(&tcpa_mapping, tcpa_log.cbmem_addr, size);
+	tclt_p = map_cbmem_ref(&tcpa_mapping, CBMEM_ID_TCPA_LOG,
+			       tcpa_log.cbmem_addr, size);
 	if (!tclt_p)
 		die("Unable to map tcpa log header\n");
 
 	size += tclt_p->num_entries * sizeof(tclt_p->entries[0]);
 
-	unmap_memory(&tcpa_mapping);
-
-	tclt_p = map_memory(&tcpa_mapping, tcpa_log.cbmem_addr, size);
+	tclt_p = remap_memory(&tcpa_mapping, size);
 	if (!tclt_p)
 		die("Unable to map full tcpa log table\n");
 
@@ -729,7 +849,8 @@ static void dump_console(int one_boot_only)
 	}
 
 	size = sizeof(*console_p);
-	console_p = map_memory(&console_mapping, console.cbmem_addr, size);
+	console_p = map_cbmem_ref(&console_mapping, CBMEM_ID_CONSOLE,
+				  console.cbmem_addr, size);
 	if (!console_p)
 		die("Unable to map console object.\n");
 
@@ -738,7 +859,6 @@ static void dump_console(int one_boot_only)
 		size = cursor;
 	else
 		size = console_p->size;
-	unmap_memory(&console_mapping);
 
 	console_c = malloc(size + 1);
 	if (!console_c) {
@@ -747,8 +867,7 @@ static void dump_console(int one_boot_only)
 	}
 	console_c[size] = '\0';
 
-	console_p = map_memory(&console_mapping, console.cbmem_addr,
-		size + sizeof(*console_p));
+	console_p = remap_memory(&console_mapping, size + sizeof(*console_p));
 
 	if (!console_p)
 		die("Unable to map full console object.\n");
@@ -1066,6 +1185,185 @@ static void dump_coverage(void)
 	unmap_memory(&coverage_mapping);
 }
 
+static void dump_hw_access(void)
+{
+	static const char *const type_names[] = HW_ACCESS_TYPE_NAMES;
+	const struct hw_access_table *table;
+	struct mapping hw_access_mapping;
+	uint64_t start;
+	size_t size;
+	uint32_t i;
+	int type;
+
+	if (find_cbmem_entry(CBMEM_ID_HW_ACCESS, &start, &size)) {
+		fprintf(stderr, "No hardware access counters found\n");
+		return;
+	}
+
+	if (size < sizeof(*table))
+		die("Hardware access counters are truncated\n");
+
+	table = map_memory(&hw_access_mapping, start, size);
+	if (!table)
+		die("Unable to map hardware access counters\n");
+
+	if (table->num_entries > (size - sizeof(*table)) / sizeof(table->entries[0]))
+		die("Hardware access counters are corrupted\n");
+
+	printf("%-24s", "boot state");
+	for (type = 0; type < HW_ACCESS_TYPES; type++)
+		printf(" %9s %9s", type_names[type], "us");
+	printf("\n");
+
+	for (i = 0; i < table->num_entries; i++) {
+		const struct hw_access_state_entry *e = &table->entries[i];
+
+		printf("%-24.*s", HW_ACCESS_STATE_NAME_LEN, e->name);
+		for (type = 0; type < HW_ACCESS_TYPES; type++) {
+			const struct hw_access_counter *c = &e->counters[type];
+
+			printf(" %9u", c->count);
+			if (table->tick_freq_mhz)
+				printf(" %9llu", (unsigned long long)(c->ticks /
+								   table->tick_freq_mhz));
+			else
+				printf(" %9s", "-");
+		}
+		printf("\n");
+	}
+
+	unmap_memory(&hw_access_mapping);
+}
+
+/*
+ * Binary export of CBMEM objects, for collecting them from many machines
+ * without running cbmem once per object. The file starts with an
+ * export_header, followed by an export_record and the raw contents for every
+ * object until the end of the file. All fields are in host byte order.
+ */
+#define EXPORT_MAGIC "CBMEMEXP"
+#define EXPORT_VERSION 1
+
+struct export_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+struct export_record {
+	uint32_t id;
+	uint32_t reserved;
+	uint64_t address;
+	uint64_t size;
+};
+
+#define MAX_EXPORT_IDS 32
+
+/* Exported in addition to the objects requested with -E. */
+static const uint32_t default_export_ids[] = {
+	CBMEM_ID_CBTABLE,
+	CBMEM_ID_TIMESTAMP,
+	CBMEM_ID_CONSOLE,
+	CBMEM_ID_TCPA_LOG,
+	CBMEM_ID_HW_ACCESS,
+};
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	while (len) {
+		ssize_t ret = write(fd, p, len);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int export_cbmem_entry(int fd, uint32_t id)
+{
+	struct export_record record = { .id = id };
+	struct mapping export_mapping;
+	const void *data;
+	uint64_t start;
+	size_t size;
+	int ret;
+
+	if (find_cbmem_entry(id, &start, &size)) {
+		debug("No CBMEM entry %08x to export\n", id);
+		return 0;
+	}
+
+	data = map_memory(&export_mapping, start, size);
+	if (!data) {
+		fprintf(stderr, "Unable to map CBMEM entry %08x\n", id);
+		return 0;
+	}
+
+	record.address = start;
+	record.size = size;
+	/* write() copies from /dev/mem in the kernel, so alignment is no
+	   concern here, unlike for memcpy(). */
+	ret = write_all(fd, &record, sizeof(record)) ||
+	      write_all(fd, data, size);
+
+	unmap_memory(&export_mapping);
+	return ret ? -1 : 0;
+}
+
+static void export_cbmem(const char *path, const uint32_t *ids, size_t num_ids)
+{
+	struct export_header header = { .version = EXPORT_VERSION };
+	uint32_t exported[ARRAY_SIZE(default_export_ids) + MAX_EXPORT_IDS];
+	size_t num_exported = 0;
+	int fd;
+
+	if (!strcmp(path, "-"))
+		fd = STDOUT_FILENO;
+	else
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Could not open %s: %s\n", path,
+			strerror(errno));
+		exit(1);
+	}
+
+	memcpy(header.magic, EXPORT_MAGIC, sizeof(header.magic));
+	if (write_all(fd, &header, sizeof(header)))
+		goto error;
+
+	for (size_t i = 0; i < ARRAY_SIZE(default_export_ids) + num_ids; i++) {
+		uint32_t id = i < ARRAY_SIZE(default_export_ids) ?
+			default_export_ids[i] :
+			ids[i - ARRAY_SIZE(default_export_ids)];
+		size_t j;
+
+		for (j = 0; j < num_exported; j++)
+			if (exported[j] == id)
+				break;
+		if (j < num_exported)
+			continue;
+		exported[num_exported++] = id;
+
+		if (export_cbmem_entry(fd, id))
+			goto error;
+	}
+
+	if (fd != STDOUT_FILENO && close(fd))
+		goto error;
+	return;
+
+error:
+	fprintf(stderr, "Could not write to %s: %s\n", path, strerror(errno));
+	exit(1);
+}
+
 static void print_version(void)
 {
 	printf("cbmem v%s -- ", CBMEM_VERSION);
@@ -1082,16 +1380,20 @@ static void print_version(void)
 
 static void print_usage(const char *name, int exit_code)
 {
-	printf("usage: %s [-cCltTLxVvh?]\n", name);
+	printf("usage: %s [-cCAltTLxVvh?] [-f FORMAT] [-e FILE [-E ID]...]\n", name);
 	printf("\n"
 	     "   -c | --console:                   print cbmem console\n"
 	     "   -1 | --oneboot:                   print cbmem console for last boot only\n"
 	     "   -C | --coverage:                  dump coverage information\n"
+	     "   -A | --hw-access:                 print hardware access counters per boot state\n"
 	     "   -l | --list:                      print cbmem table of contents\n"
 	     "   -x | --hexdump:                   print hexdump of cbmem area\n"
 	     "   -r | --rawdump ID:                print rawdump of specific ID (in hex) of cbtable\n"
 	     "   -t | --timestamps:                print timestamp information\n"
 	     "   -T | --parseable-timestamps:      print parseable timestamps\n"
+	     "   -f | --timestamp-format FORMAT:   print timestamps as text, parseable, json or csv\n"
+	     "   -e | --export FILE:               write CBMEM objects to FILE (- for stdout) in binary\n"
+	     "   -E | --export-id ID:              also export specific ID (in hex), can be repeated\n"
 	     "   -L | --tcpa-log                   print TCPA log\n"
 	     "   -V | --verbose:                   verbose (debugging) output\n"
 	     "   -v | --version:                   print the version\n"
@@ -1220,24 +1522,32 @@ int main(int argc, char** argv)
 	int print_defaults = 1;
 	int print_console = 0;
 	int print_coverage = 0;
+	int print_hw_access = 0;
 	int print_list = 0;
 	int print_hexdump = 0;
 	int print_rawdump = 0;
 	int print_timestamps = 0;
 	int print_tcpa_log = 0;
-	int machine_readable_timestamps = 0;
+	enum timestamp_format timestamp_format = TIMESTAMPS_TEXT;
 	int one_boot_only = 0;
 	unsigned int rawdump_id = 0;
+	const char *export_path = NULL;
+	uint32_t export_ids[MAX_EXPORT_IDS];
+	size_t num_export_ids = 0;
 
 	int opt, option_index = 0;
 	static struct option long_options[] = {
 		{"console", 0, 0, 'c'},
 		{"oneboot", 0, 0, '1'},
 		{"coverage", 0, 0, 'C'},
+		{"hw-access", 0, 0, 'A'},
 		{"list", 0, 0, 'l'},
 		{"tcpa-log", 0, 0, 'L'},
 		{"timestamps", 0, 0, 't'},
 		{"parseable-timestamps", 0, 0, 'T'},
+		{"timestamp-format", required_argument, 0, 'f'},
+		{"export", required_argument, 0, 'e'},
+		{"export-id", required_argument, 0, 'E'},
 		{"hexdump", 0, 0, 'x'},
 		{"rawdump", required_argument, 0, 'r'},
 		{"verbose", 0, 0, 'V'},
@@ -1245,7 +1555,7 @@ int main(int argc, char** argv)
 		{"help", 0, 0, 'h'},
 		{0, 0, 0, 0}
 	};
-	while ((opt = getopt_long(argc, argv, "c1CltTLxVvh?r:",
+	while ((opt = getopt_long(argc, argv, "c1CAltTLxVvh?r:f:e:E:",
 				  long_options, &option_index)) != EOF) {
 		switch (opt) {
 		case 'c':
@@ -1261,6 +1571,10 @@ int main(int argc, char** argv)
 			print_coverage = 1;
 			print_defaults = 0;
 			break;
+		case 'A':
+			print_hw_access = 1;
+			print_defaults = 0;
+			break;
 		case 'l':
 			print_list = 1;
 			print_defaults = 0;
@@ -1284,8 +1598,33 @@ int main(int argc, char** argv)
 			break;
 		case 'T':
 			print_timestamps = 1;
-			machine_readable_timestamps = 1;
+			timestamp_format = TIMESTAMPS_PARSEABLE;
+			print_defaults = 0;
+			break;
+		case 'f':
+			print_timestamps = 1;
 			print_defaults = 0;
+			if (!strcmp(optarg, "text"))
+				timestamp_format = TIMESTAMPS_TEXT;
+			else if (!strcmp(optarg, "parseable"))
+				timestamp_format = TIMESTAMPS_PARSEABLE;
+			else if (!strcmp(optarg, "json"))
+				timestamp_format = TIMESTAMPS_JSON;
+			else if (!strcmp(optarg, "csv"))
+				timestamp_format = TIMESTAMPS_CSV;
+			else
+				print_usage(argv[0], 1);
+			break;
+		case 'e':
+			export_path = optarg;
+			print_defaults = 0;
+			break;
+		case 'E':
+			if (num_export_ids == ARRAY_SIZE(export_ids)) {
+				fprintf(stderr, "Too many export IDs.\n");
+				exit(1);
+			}
+			export_ids[num_export_ids++] = strtoul(optarg, NULL, 16);
 			break;
 		case 'V':
 			verbose = 1;
@@ -1309,6 +1648,19 @@ int main(int argc, char** argv)
 		print_usage(argv[0], 1);
 	}
 
+	if (num_export_ids && !export_path) {
+		fprintf(stderr, "Error: -E requires -e.\n");
+		print_usage(argv[0], 1);
+	}
+
+	if (export_path && !strcmp(export_path, "-") &&
+	    (print_console || print_coverage || print_hw_access || print_list ||
+	     print_hexdump || print_rawdump || print_timestamps ||
+	     print_tcpa_log)) {
+		fprintf(stderr, "Error: Can't export to stdout and print at the same time.\n");
+		exit(1);
+	}
+
 	mem_fd = open("/dev/mem", O_RDONLY, 0);
 	if (mem_fd < 0) {
 		fprintf(stderr, "Failed to gain memory access: %s\n",
@@ -1387,6 +1739,9 @@ int main(int argc, char** argv)
 	if (print_coverage)
 		dump_coverage();
 
+	if (print_hw_access)
+		dump_hw_access();
+
 	if (print_list)
 		dump_cbmem_toc();
 
@@ -1397,11 +1752,14 @@ int main(int argc, char** argv)
 		dump_cbmem_raw(rawdump_id);
 
 	if (print_defaults || print_timestamps)
-		dump_timestamps(machine_readable_timestamps);
+		dump_timestamps(timestamp_format);
 
 	if (print_tcpa_log)
 		dump_tcpa_log();
 
+	if (export_path)
+		export_cbmem(export_path, export_ids, num_export_ids);
+
 	unmap_memory(&lbtable_mapping);
 
 	close(mem_fd);
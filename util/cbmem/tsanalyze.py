@@ -0,0 +1,274 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-only
+
+"""
+Compare boot times of many boots, based on the timestamps cbmem prints.
+
+Every input file holds the timestamps of one boot, as printed by `cbmem -T`
+or `cbmem -f csv` or `cbmem -f json`. The boots are aligned by timestamp ID.
+A phase is the time between two consecutive timestamps, it is named after
+both IDs. For every phase the report shows the median, p95 and p99.
+
+With --candidate, the boots given with --baseline are compared to the
+candidate boots, e.g. two firmware builds, using a one sided Mann-Whitney U
+test. A phase regressed if the candidate is significantly slower and its
+median grew by more than the given thresholds. The exit status is 1 if any
+phase regressed, so the script can gate rollouts.
+"""
+
+import argparse
+import csv
+import json
+import math
+import sys
+
+
+def parse_boot(path):
+    """Return a list of (id, name, absolute time in us) of one boot."""
+    with open(path) as f:
+        text = f.read()
+
+    stripped = text.lstrip()
+    if stripped.startswith('{'):
+        return [(int(e['id']), e['name'], int(e['time_us']))
+                for e in json.loads(text)['entries']]
+
+    if stripped.startswith('id,'):
+        return [(int(row['id']), row['name'], int(row['time_us']))
+                for row in csv.DictReader(stripped.splitlines())]
+
+    entries = []
+    for line in text.splitlines():
+        fields = line.split('\t', 3)
+        if len(fields) != 4:
+            continue
+        try:
+            entries.append((int(fields[0]), fields[3], int(fields[1])))
+        except ValueError:
+            continue
+    return entries
+
+
+def boot_phases(entries, names):
+    """Return a dict of phase key to duration in us for one boot.
+
+    A timestamp ID that occurs more than once in a boot, e.g. for every
+    loaded stage, is numbered so each occurrence gets its own phase.
+    """
+    phases = {}
+    seen = {}
+    prev_key = None
+    prev_time = None
+
+    for ts_id, name, time in sorted(entries, key=lambda e: e[2]):
+        seen[ts_id] = seen.get(ts_id, 0) + 1
+        key = str(ts_id) if seen[ts_id] == 1 else '%d#%d' % (ts_id, seen[ts_id])
+        names.setdefault(key, name)
+        if prev_key is not None:
+            phases['%s-%s' % (prev_key, key)] = time - prev_time
+        prev_key = key
+        prev_time = time
+
+    if entries:
+        times = [e[2] for e in entries]
+        phases['total'] = max(times) - min(times)
+    return phases
+
+
+def load_boots(paths, names):
+    boots = []
+    for path in paths:
+        entries = parse_boot(path)
+        if not entries:
+            sys.stderr.write('%s: no timestamps found, skipping\n' % path)
+            continue
+        boots.append(boot_phases(entries, names))
+    return boots
+
+
+def collect(boots):
+    """Return a dict of phase key to the list of its durations."""
+    samples = {}
+    for boot in boots:
+        for key, duration in boot.items():
+            samples.setdefault(key, []).append(duration)
+    return samples
+
+
+def percentile(values, p):
+    """Linearly interpolated percentile of a sorted list."""
+    if not values:
+        return float('nan')
+    pos = (len(values) - 1) * p / 100.0
+    lo = int(math.floor(pos))
+    hi = min(lo + 1, len(values) - 1)
+    return values[lo] + (values[hi] - values[lo]) * (pos - lo)
+
+
+def mann_whitney_greater(a, b):
+    """One sided p-value of b being larger than a.
+
+    Uses the normal approximation with tie correction, which is good enough
+    for the sample sizes of a boot time comparison (roughly 8 and more per
+    side). Returns None if there are too few samples.
+    """
+    n1, n2 = len(a), len(b)
+    if n1 < 3 or n2 < 3:
+        return None
+
+    values = sorted([(v, 0) for v in a] + [(v, 1) for v in b])
+    n = n1 + n2
+    rank_sum_b = 0.0
+    tie_term = 0.0
+    i = 0
+    while i < n:
+        j = i
+        while j < n and values[j][0] == values[i][0]:
+            j += 1
+        rank = (i + 1 + j) / 2.0
+        rank_sum_b += rank * sum(1 for k in range(i, j) if values[k][1])
+        tie_term += (j - i) ** 3 - (j - i)
+        i = j
+
+    u = rank_sum_b - n2 * (n2 + 1) / 2.0
+    mean = n1 * n2 / 2.0
+    var = n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1)))
+    if var <= 0:
+        return 1.0
+    z = (u - mean - 0.5) / math.sqrt(var)
+    return 0.5 * math.erfc(z / math.sqrt(2))
+
+
+def phase_order(samples, boots):
+    """Order phases the way they occur in the boots."""
+    first = {}
+    for boot in boots:
+        for pos, key in enumerate(boot):
+            first[key] = min(first.get(key, pos), pos)
+    return sorted(samples, key=lambda k: (k == 'total', first.get(k, 0), k))
+
+
+def phase_name(key, names):
+    if key == 'total':
+        return 'total'
+    _, end = key.split('-', 1)
+    return '%s (%s)' % (key, names.get(end, '<unknown>'))
+
+
+def fmt(value):
+    if value is None:
+        return '-'
+    if isinstance(value, float):
+        if math.isnan(value):
+            return '-'
+        return '%d' % round(value)
+    return str(value)
+
+
+def summarize(values):
+    values = sorted(values)
+    return [len(values), percentile(values, 50), percentile(values, 95),
+            percentile(values, 99)]
+
+
+def report_single(boots, names, write_row):
+    samples = collect(boots)
+    write_row(['phase', 'n', 'p50_us', 'p95_us', 'p99_us'])
+    for key in phase_order(samples, boots):
+        write_row([phase_name(key, names)] + summarize(samples[key]))
+    return 0
+
+
+def report_compare(baseline, candidate, names, args, write_row):
+    base = collect(baseline)
+    cand = collect(candidate)
+    keys = [k for k in phase_order(base, baseline) if k in cand]
+    alpha = args.alpha
+    if not args.no_correction and keys:
+        alpha /= len(keys)
+
+    regressions = 0
+    write_row(['phase', 'base_n', 'base_p50_us', 'base_p95_us',
+               'base_p99_us', 'cand_n', 'cand_p50_us', 'cand_p95_us',
+               'cand_p99_us', 'delta_p50_us', 'delta_p50_pct', 'p_value',
+               'verdict'])
+    for key in keys:
+        b = summarize(base[key])
+        c = summarize(cand[key])
+        delta = c[1] - b[1]
+        pct = delta * 100.0 / b[1] if b[1] else float('nan')
+        p = mann_whitney_greater(base[key], cand[key])
+
+        verdict = ''
+        if p is None:
+            verdict = 'too few samples'
+        elif (p < alpha and delta >= args.min_us and
+              (not b[1] or delta >= b[1] * args.min_pct / 100.0)):
+            verdict = 'REGRESSION'
+            regressions += 1
+
+        write_row([phase_name(key, names)] + b + c +
+                  [delta, '%.1f' % pct if not math.isnan(pct) else '-',
+                   '%.2g' % p if p is not None else '-', verdict])
+
+    for key in sorted(set(base) ^ set(cand)):
+        sys.stderr.write('phase %s only found in the %s boots\n' %
+                         (key, 'baseline' if key in base else 'candidate'))
+
+    sys.stderr.write('%d baseline boots, %d candidate boots, '
+                     '%d phase(s) regressed\n' %
+                     (len(baseline), len(candidate), regressions))
+    return 1 if regressions else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Analyze and compare cbmem timestamp dumps.')
+    parser.add_argument('--baseline', '-b', nargs='+', required=True,
+                        metavar='FILE',
+                        help='timestamp dumps of the baseline boots')
+    parser.add_argument('--candidate', '-c', nargs='+', metavar='FILE',
+                        help='timestamp dumps of the boots to compare to '
+                        'the baseline')
+    parser.add_argument('--csv', action='store_true',
+                        help='print the report as CSV')
+    parser.add_argument('--alpha', type=float, default=0.01,
+                        help='significance level (default: %(default)s)')
+    parser.add_argument('--no-correction', action='store_true',
+                        help='don\'t divide the significance level by the '
+                        'number of phases (Bonferroni correction)')
+    parser.add_argument('--min-us', type=float, default=100,
+                        help='ignore median increases below this many us '
+                        '(default: %(default)s)')
+    parser.add_argument('--min-pct', type=float, default=5,
+                        help='ignore median increases below this percentage '
+                        '(default: %(default)s)')
+    args = parser.parse_args()
+
+    names = {}
+    baseline = load_boots(args.baseline, names)
+    candidate = load_boots(args.candidate or [], names)
+    if not baseline or (args.candidate and not candidate):
+        sys.exit('No boots to analyze.')
+
+    rows = []
+    if args.candidate:
+        ret = report_compare(baseline, candidate, names, args, rows.append)
+    else:
+        ret = report_single(baseline, names, rows.append)
+
+    rows = [[fmt(v) for v in row] for row in rows]
+    if args.csv:
+        csv.writer(sys.stdout, lineterminator='\n').writerows(rows)
+    else:
+        widths = [max(len(row[i]) for row in rows)
+                  for i in range(len(rows[0]))]
+        for row in rows:
+            print('  '.join(v.ljust(widths[i]) if i == 0 else
+                            v.rjust(widths[i]) for i, v in enumerate(row))
+                  .rstrip())
+    return ret
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -18,6 +18,7 @@ typedef uint8_t u8;
 #define CBFS_COMPRESS_NONE  0
 #define CBFS_COMPRESS_LZMA  1
 #define CBFS_COMPRESS_LZ4   2
+#define CBFS_COMPRESS_ZSTD  3
 
 /** These are standard component types for well known
     components (i.e - those that coreboot needs to consume.